@@ -1,23 +1,113 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <errno.h>
+#include <math.h>       // log2()/exp2() for counts kept in log space
+#include <complex.h>    // Digit-sum walks evaluated around a circle
 #include <time.h>
 #include <unistd.h>     // For alarm(), read(), STDIN_FILENO
 #include <signal.h>     // For signal(), SIGALRM
 #include <termios.h>    // For disabling terminal echo
+#include <stdint.h>
+#include <stddef.h>     // For offsetof()
+#include <fcntl.h>      // For open()
+#include <sys/mman.h>   // For mmap() in the wordlist mode
+#include <sys/stat.h>   // For fstat()
+#include <pthread.h>    // Worker pool for the wordlist mode
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>  // SSE2/AVX2 intrinsics for the counting kernels
+#define PW_HAVE_X86_SIMD 1
+#endif
 
 // --- Constants ---
 #define INITIAL_TIME 60       // Starting time in seconds
 #define TIME_DECREMENT 5      // Seconds to decrease time each round
 #define MIN_TIME 10           // Minimum time limit
-#define MAX_PASSWORD_LEN 100  // Max buffer size for password input
+#define INPUT_INITIAL_CAPACITY 128 // Starting size of the password input buffer; it grows as needed
 #define BASE_MIN_LEN 6        // Starting minimum password length
+#define BENCH_ITERATIONS 2000000 // Passwords classified per benchmark length
+#define POLICY_LANES 8        // Policy table padding: one AVX2 vector of int32 thresholds
+#define BULK_CHUNK_BYTES (16 << 20) // Largest wordlist chunk handed to one worker
+#define BULK_MIN_CHUNK_BYTES (64 << 10) // Smallest chunk, so tiny files don't shatter
+#define BULK_CHUNKS_PER_THREAD 16   // Enough chunks per worker for stealing to even out the load
+#define MAX_THREADS 1024      // Most workers --check and --generate will start
+#define STREAM_CHUNK_BYTES (64 << 10) // Read size for --validate
+#define SWEEP_DEFAULT_ROUNDS 20 // Rounds --sweep analyzes unless told otherwise
+#define GENERATE_BATCH_BYTES (1 << 20) // Passwords a --generate worker builds per write()
+#define COUNT_TABLE_BUDGET (1 << 24) // uint64_t words one PasswordCounter may hold (128 MB)
+#define COUNT_WORK_BUDGET (1LL << 32) // Residue updates one per-class count may spend
+#define COUNT_SAMPLE_LIMBS 64 // Widest count password_counter_sample() handles (lengths to ~620)
+#define COUNT_SUPERSET_DRAWS 1024 // Most draws count_superset_sample() may expect per password
+#define ESTIMATE_WORK_BUDGET (1LL << 31) // Coefficient updates one estimate may spend stepping tallies
+
+// --- Rule Bits (ValidationResult.violations) ---
+#define RULE_MIN_LENGTH     (1u << 0)
+#define RULE_MIN_UPPERCASE  (1u << 1)
+#define RULE_MIN_LOWERCASE  (1u << 2)
+#define RULE_MIN_DIGITS     (1u << 3)
+#define RULE_MIN_SYMBOLS    (1u << 4)
+#define RULE_START_UPPER    (1u << 5)
+#define RULE_END_SYMBOL     (1u << 6)
+#define RULE_NO_CONSECUTIVE (1u << 7)
+#define RULE_PALINDROME     (1u << 8)
+#define RULE_DIGIT_SUM      (1u << 9)
+#define RULE_ENCODING       (1u << 10) // UTF-8 mode only; reported ahead of every other rule
+#define RULE_COUNT          11 // Rules are numbered in display order; bit i is rule i
+
+// --- Rule Sets (which "ridiculous" rules a policy enables; keys the specialized validators) ---
+#define RULESET_START_END   (1u << 0)
+#define RULESET_NO_REPEAT   (1u << 1)
+#define RULESET_PALINDROME  (1u << 2)
+#define RULESET_DIGIT_SUM   (1u << 3)
+#define RULESET_COUNT       16
+
+#define PW_ALWAYS_INLINE static inline __attribute__((always_inline))
+
+// --- Character Classes ---
+// Locale-independent classification matching the "C" locale: A-Z, a-z, 0-9,
+// and every other graphic byte 0x21-0x7E is a symbol. Bytes >= 0x80 are none of these.
+#define CC_UPPER  0x01
+#define CC_LOWER  0x02
+#define CC_DIGIT  0x04
+#define CC_SYMBOL 0x08
+#define CC_PRINT  0x10  // 0x20-0x7E, i.e. graphic characters plus space
+
+#define CC_IN(b, lo, hi) ((b) >= (lo) && (b) <= (hi))
+#define CC_CLASS_OF(b) \
+    (CC_IN(b, 'A', 'Z') ? CC_UPPER | CC_PRINT : \
+     CC_IN(b, 'a', 'z') ? CC_LOWER | CC_PRINT : \
+     CC_IN(b, '0', '9') ? CC_DIGIT | CC_PRINT : \
+     CC_IN(b, 0x21, 0x7E) ? CC_SYMBOL | CC_PRINT : \
+     (b) == 0x20 ? CC_PRINT : 0)
+#define CC_ENTRY(b) { CC_CLASS_OF(b), CC_IN(b, '0', '9') ? (b) - '0' : 0 }
+#define CC_ROW4(b)   CC_ENTRY(b), CC_ENTRY((b) + 1), CC_ENTRY((b) + 2), CC_ENTRY((b) + 3)
+#define CC_ROW16(b)  CC_ROW4(b), CC_ROW4((b) + 4), CC_ROW4((b) + 8), CC_ROW4((b) + 12)
+#define CC_ROW64(b)  CC_ROW16(b), CC_ROW16((b) + 16), CC_ROW16((b) + 32), CC_ROW16((b) + 48)
+
+#define CHAR_IS(b, cls) (char_table[(unsigned char)(b)].cls_bits & (cls))
+
+// Display names, indexed by rule number (bit position of RULE_*).
+static const char *const rule_names[RULE_COUNT] = {
+    "Minimum Length", "Minimum Uppercase", "Minimum Lowercase", "Minimum Digits",
+    "Minimum Symbols", "Starts with Uppercase", "Ends with Symbol",
+    "No Consecutive Identical Characters", "Palindrome", "Digit Sum", "Valid UTF-8",
+};
 
 // --- Global Variables ---
 volatile sig_atomic_t timed_out = 0; // Flag set by signal handler
 
 // --- Structures ---
+typedef struct {
+    unsigned char cls_bits;    // CC_* bits
+    unsigned char digit_value; // 0-9 for digits, 0 otherwise
+} CharInfo;
+
+// Built entirely at compile time; never depends on setlocale().
+static const CharInfo char_table[256] = {
+    CC_ROW64(0x00), CC_ROW64(0x40), CC_ROW64(0x80), CC_ROW64(0xC0),
+};
+
 typedef struct {
     // Basic Requirements
     int min_length;
@@ -33,25 +123,451 @@ typedef struct {
     int req_digit_sum;
     int digit_sum_target; // Only relevant if req_digit_sum is true
 
+    // Text handling
+    int utf8; // Count and classify UTF-8 code points instead of bytes
+
 } PasswordRequirements;
 
+// Per-class tallies produced by the counting kernels.
+typedef struct {
+    int upper;
+    int lower;
+    int digits;
+    int symbols;
+    int digit_sum;
+} ClassCounts;
+
+// Everything the rules need to know about a password, gathered in one pass.
+// Once computed, any policy can be checked against it in O(1) with check_features().
+typedef struct {
+    size_t length;
+    ClassCounts counts;
+    long first_repeat;          // Index i with p[i] == p[i+1], or -1 if none
+    long max_run;               // Longest run of one repeated byte (0 for an empty password)
+    int is_palindrome;
+    unsigned char first_class;  // CC_* bits of the first byte (0 if empty)
+    unsigned char last_class;   // CC_* bits of the last byte (0 if empty)
+    long encoding_error;        // UTF-8 mode: byte offset of the first invalid sequence, or -1
+} PasswordFeatures;
+// In UTF-8 mode, length, indices, runs and classes are in code points rather than bytes.
+
+// One range of unicode_ranges: code points first .. first + count - 1.
+typedef struct {
+    uint32_t first;
+    uint16_t count;
+    uint8_t cls; // CC_* bits, possibly with UC_ALTERNATING
+} UnicodeRange;
+
+// Outcome of check_password(); filled without any I/O.
+typedef struct {
+    unsigned violations;  // RULE_* bit of the rule that failed, 0 if valid
+    size_t length;        // Observed length
+    ClassCounts counts;   // Observed class counts and digit sum
+    long position;        // Offending index for positional rules, -1 otherwise
+    char repeated[5];     // The repeated character (its UTF-8 bytes in UTF-8 mode), for RULE_NO_CONSECUTIVE
+} ValidationResult;
+
+// Per-rule detail for the collect-all mode.
+typedef struct {
+    int observed;   // Length, count or digit sum seen; 1/0 (holds/broken) for pattern rules
+    int required;   // What the policy asks for; 1 for pattern rules
+    long position;  // Offending index, or -1
+} RuleDetail;
+
+// Outcome of check_password_all(): every rule evaluated, every failure recorded.
+typedef struct {
+    unsigned active;      // RULE_* bits the policy enables
+    unsigned violations;  // Every RULE_* bit that failed
+    RuleDetail rules[RULE_COUNT]; // Indexed by rule number (bit position)
+} ValidationReport;
+
+typedef void (*scan_kernel_fn)(const unsigned char *p, size_t len, PasswordFeatures *scan);
+
+typedef struct CompiledPolicy CompiledPolicy;
+typedef unsigned (*policy_validator_fn)(const CompiledPolicy *policy, const char *password, size_t len);
+
+// A PasswordRequirements decoded once for validating many passwords.
+struct CompiledPolicy {
+    PasswordRequirements reqs;
+    unsigned active;              // RULE_* bits the policy enables
+    unsigned rule_set;            // RULESET_* bits; selects the specialized code below
+    scan_kernel_fn kernel;        // Scan kernel that tracks only what rule_set needs
+    policy_validator_fn validate; // Scan + evaluation with no code for disabled rules
+};
+
+// One password inside a larger buffer.
+typedef struct {
+    const char *ptr;
+    size_t len;
+} PasswordSpan;
+
+// Many policies stored column-wise, so one password's features can be compared
+// against a block of policies per vector instruction. Columns are padded to a
+// multiple of POLICY_LANES with entries that never match.
+typedef struct {
+    size_t count;               // Number of real policies
+    size_t capacity;            // Padded column length
+    int32_t *min_length;
+    int32_t *min_uppercase;
+    int32_t *min_lowercase;
+    int32_t *min_digits;
+    int32_t *min_symbols;
+    int32_t *rule_set;          // RULESET_* bits
+    int32_t *digit_sum_target;  // -1 for digit-sum policies no password can meet
+    void *storage;              // Single allocation backing every column
+} PolicyTable;
+
+// Tallies from validating a range of wordlist lines.
+typedef struct {
+    size_t lines;
+    size_t passed;
+    size_t rule_failures[RULE_COUNT]; // Lines breaking each rule (a line may break several)
+} BulkStats;
+
+// Growable byte buffer, so output leaves in a few large write() calls.
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} OutputBuffer;
+
+// One worker's share of wordlist chunks: it pops from the front, thieves take from the back.
+typedef struct {
+    pthread_mutex_t lock;
+    size_t next; // First chunk index still queued
+    size_t end;  // One past the last queued chunk
+} ChunkDeque;
+
+// Shared state for a parallel wordlist run.
+typedef struct {
+    const CompiledPolicy *policy;
+    const char *data;
+    const size_t *bounds;    // Chunk i is data[bounds[i] .. bounds[i + 1])
+    size_t chunk_count;
+    int workers;
+    ChunkDeque *deques;      // One per worker
+    OutputBuffer *outputs;   // Passing lines per chunk; NULL when not printing
+    unsigned char *done;     // Per chunk, guarded by out_lock
+    size_t flushed;          // Chunks [0, flushed) have been written out
+    pthread_mutex_t out_lock;
+    int out_error;
+} BulkJob;
+
+// Per-thread counters, cache-line aligned so workers never share a line.
+typedef struct {
+    BulkJob *job;
+    int id;
+    BulkStats stats;
+} __attribute__((aligned(64))) BulkWorker;
+
+// Validator fed a password in pieces. Memory use is constant unless the
+// palindrome rule is active, which needs the whole password at the end.
+typedef struct {
+    PasswordRequirements reqs;
+    unsigned rule_set;          // RULESET_* bits of reqs
+    scan_kernel_fn kernel;      // Per-piece kernel: counts, plus runs when NO_REPEAT is on
+    PasswordFeatures features;  // Everything fed so far; is_palindrome is settled at the end
+    long run;                   // Identical characters at the end of what was fed so far
+    uint32_t last;              // Last character fed (a byte, or a code point in UTF-8 mode)
+    char repeated[5];           // Character at features.first_repeat
+    size_t bytes;               // Bytes fed so far
+    unsigned char partial[4];   // UTF-8 mode: an incomplete sequence at the end of the last piece
+    size_t partial_len;
+    char *held;                 // Palindrome rule only: every byte fed so far
+    size_t held_capacity;
+} StreamValidator;
+
+// One character of a password being typed. In UTF-8 mode it is a lead byte
+// plus the continuation bytes after it, which is also what backspace removes.
+typedef struct {
+    uint32_t cp;              // Code point (the byte outside UTF-8 mode), LIVE_INVALID if malformed
+    CharInfo info;            // Class of cp; zero if malformed
+    unsigned char seq[4];     // First bytes of the character
+    size_t nbytes;
+    size_t offset;            // Byte offset in the password
+    ClassCounts before;       // Tallies of the characters before this one
+    int suffix_pal;           // Palindrome rule only: node of the longest palindrome ending here
+    int new_pal;              // ...and whether this character added it to the tree
+} LiveChar;
+
+// A distinct palindrome in the password being typed: a node of its
+// palindromic tree (eertree). Node 0 is the root of length -1, node 1 the
+// empty palindrome; every other node is cp + parent + cp.
+typedef struct {
+    int len;
+    int parent;
+    uint32_t cp;
+    int link;                 // Longest proper suffix that is a palindrome
+    int quick;                // First palindrome below link preceded (inside this one) by another character than link
+    int diff;                 // len - link's len; 0 for the roots
+    int series;               // Longest suffix palindrome whose diff differs from this one's
+} LivePalindrome;
+
+// Validator that follows a password keystroke by keystroke. Every append and
+// delete updates the tallies in O(1), so the rules can be checked at any
+// moment without rescanning. Under the palindrome rule it also keeps the
+// palindromic tree of the input, O(log n) per keystroke, which answers both
+// "is it a palindrome" and the prefix oracle's folded completions.
+typedef struct {
+    PasswordRequirements reqs;
+    LiveChar *chars;
+    size_t count;
+    size_t capacity;
+    size_t bytes;
+    ClassCounts counts;
+    size_t repeat_pairs;      // Adjacent identical characters
+    long first_repeat;        // Index of the first such pair, or -1
+    size_t invalid;           // Malformed UTF-8 characters
+    long first_invalid;       // Index of the first one, or -1
+    LivePalindrome *pals;     // Palindrome rule only: the tree's nodes, in creation order
+    size_t pal_count;
+    size_t pal_capacity;
+    int *pal_slots;           // Open-addressed (parent, cp) -> node table; 0 marks a free slot
+    size_t pal_slot_count;    // A power of two, at least twice pal_count
+} IncrementalValidator;
+
+// Outcome of analyze_policy().
+typedef struct {
+    unsigned rules;      // RULE_* bits of the rules in conflict, 0 if the policy is satisfiable
+    const char *reason;  // Explanation for display, NULL if satisfiable
+} PolicyVerdict;
+
+// Shape of the passwords synthesize_password() builds for one policy (see synthesis_plan()).
+typedef struct {
+    int palindrome;    // The counts below describe the first half, which is mirrored
+    int framed;        // Opens with an uppercase letter and closes with a symbol
+    int no_repeat;     // Digits are kept apart by non-digits
+    int centre;        // CC_* class of a palindrome's middle character, -1 for even lengths
+    int centre_digit;  // Value of the middle character when centre is CC_DIGIT
+    size_t upper, lower, symbols, digits; // Characters in the free part (fillers are lowercase)
+    long digit_sum;    // Sum of the free part's digits, -1 if unconstrained
+    size_t length;     // Total password length
+} SynthesisPlan;
+
+// How many ways k digits (0-9) add up to each sum: the coefficients of
+// (1 + y + ... + y^9)^k, kept per k once built (see digit_sum_rows_reserve()).
+typedef struct {
+    int max_rows;            // Rows k = 0..max_rows - 1 may be built
+    int rows;                // Rows built so far
+    int sums;                // Sums kept per row: 0..sums - 1
+    int limbs;               // uint64_t limbs per count, enough for every row allowed
+    uint64_t *ways;          // rows x sums counts
+} DigitSumRows;
+
+// Completion counts for one policy at one length (see password_counter_init()).
+// Layer i holds, for each state reachable after i steps from which the policy
+// can still be met, the number of ways to finish; counts are little-endian
+// uint64_t limbs. The root is the total. Unless asked to keep every layer,
+// only two are kept while counting and the root is all that stays valid.
+typedef struct {
+    PasswordRequirements reqs;
+    size_t length;
+    int steps;               // Characters chosen: the length, or half of it rounded up for palindromes
+    int centre;              // Non-zero if the last step is a palindrome's middle character
+    int no_repeat;
+    int limbs;               // uint64_t limbs per count
+    int radix[4];            // Needs left (uppercase, lowercase, symbols, digits) run 0..minimum
+    int stride[4];
+    int vectors;             // Need vectors: the product of radix
+    int lasts;               // Previous-character slots: 1 without no-repeat, else none, 4 classes, digits
+    int digit_lasts;         // 10 when the previous digit's value matters (no-repeat with a digit sum), else 1
+    int sums;                // Digit sum still owed, 0..target (1 without the rule)
+    int kept;                // Every layer is kept, so the tables can be sampled
+    int32_t *rank;           // (steps + 1) x vectors: a vector's entry in its layer, -1 if absent
+    size_t *layer_offset;    // First count of each layer, in counts (layers alternate unless kept)
+    uint64_t *counts;
+    uint64_t *zero;          // limbs zero words: the root of a policy no password of this length meets
+    const uint64_t *root;
+    DigitSumRows digit_rows; // Digit-sum rule only: sums up to target / w, for count_by_class()
+    // Sampling without kept tables (see count_superset_init()): the policy less no-repeat
+    int options;             // Choices for a palindrome's centre, 1 without one
+    int free_steps;          // Steps shuffled: all but the start-end and centre characters
+    uint64_t *rest;          // options x 5 x (free_steps + 1) counts
+    uint64_t *superset;      // options + 1 counts: the passwords under each option, then all
+} PasswordCounter;
+
+// One way count_by_class() takes a class: a share of its full series, or
+// (sign -1) the part that misses its minimum.
+typedef struct {
+    const uint32_t *poly;    // Polynomial factor in t and x (see count_poly_mul()), NULL for 1
+    int deg;                 // Its degree in x
+    int sign;
+    uint32_t beta;           // Size the class adds to the shuffled blocks' b(x)
+    int e;                   // Factors b(x) / size standing outside the shuffle
+    uint32_t scale;          // Constant factor (size for a block outside)
+} ClassCountPart;
+
+// Class tallies (uppercase, lowercase, symbols, digits) capped at a policy's
+// minimums, as coefficients of a polynomial (see password_count_estimate()).
+typedef struct {
+    int radix[4];            // Tally values per axis: 0..minimum
+    int stride[4];
+    int size;                // Coefficients per polynomial: the product of radix
+} TallyShape;
+
+// How password_count_estimate() walks one length; masks and weights as
+// count_step_mask() and count_step_weight() give them.
+typedef struct {
+    size_t steps;            // Characters chosen: the length, or half of it rounded up for palindromes
+    unsigned first_mask;     // Classes the first step may draw from
+    unsigned last_mask;      // Classes the last step may draw from
+    int w;                   // Tallies (and digit-sum multiples) one character adds
+    int last_w;              // The same for the last step: 1 for a palindrome's centre
+} EstimateWalk;
+
+// Shared state for a --generate run.
+typedef struct {
+    const SynthesisPlan *plan;
+    const PasswordCounter *counter; // Sample uniformly from these tables instead of synthesizing
+    size_t length;           // Characters per password
+    int unbounded;           // Stream until the output fails
+    size_t remaining;        // Passwords no worker has claimed yet, guarded by lock
+    int stop;                // Set once output fails, guarded by lock
+    pthread_mutex_t lock;
+    pthread_mutex_t out_lock; // Serializes write() so batches never interleave
+    int fd;
+    int out_error;           // errno of the first failed write, guarded by out_lock
+} GenerateJob;
+
+// Per-thread RNG and output batch, cache-line aligned so workers never share a line.
+typedef struct {
+    GenerateJob *job;
+    uint64_t rng;
+    OutputBuffer batch;
+} __attribute__((aligned(64))) GenerateWorker;
+
+typedef size_t (*policy_match_fn)(const PolicyTable *table, const PasswordFeatures *features,
+                                  uint64_t *satisfied);
+
 // --- Function Prototypes ---
 void handle_timeout(int sig);
 void generate_requirements(PasswordRequirements *reqs, int round);
+int requirement_rolls(int round);
+void generate_requirements_roll(PasswordRequirements *reqs, int round, int roll);
 void display_requirements(const PasswordRequirements *reqs, int time_limit);
-int get_hidden_input(char *buffer, int max_len);
+long get_hidden_input(char **buffer, size_t *capacity, int utf8, IncrementalValidator *live);
 int validate_password(const char *password, const PasswordRequirements *reqs);
+int validate_password_n(const char *password, size_t len, const PasswordRequirements *reqs);
+unsigned check_password(const char *password, size_t len, const PasswordRequirements *reqs,
+                        ValidationResult *result);
+void report_validation(FILE *out, const PasswordRequirements *reqs, const ValidationResult *result);
+unsigned check_password_all(const char *password, size_t len, const PasswordRequirements *reqs,
+                            ValidationReport *report);
+void report_checklist(FILE *out, const ValidationReport *report);
+unsigned check_features(const PasswordFeatures *features, const PasswordRequirements *reqs);
+unsigned policy_active_rules(const PasswordRequirements *reqs);
+void compile_policy(const PasswordRequirements *reqs, CompiledPolicy *policy);
+size_t validate_batch(const CompiledPolicy *policy, const PasswordSpan *spans, size_t count,
+                      uint64_t *pass_bits, unsigned *violations);
+size_t validate_batch_lines(const CompiledPolicy *policy, const char *buf, size_t len, size_t max_lines,
+                            uint64_t *pass_bits, unsigned *violations, size_t *passed);
 void set_terminal_echo(int enable);
+void display_live_status(const IncrementalValidator *iv);
+void scan_password(const char *password, size_t len, PasswordFeatures *scan);
+void scan_password_scalar(const unsigned char *p, size_t len, PasswordFeatures *scan);
+#ifdef PW_HAVE_X86_SIMD
+void scan_password_sse2(const unsigned char *p, size_t len, PasswordFeatures *scan);
+void scan_password_avx2(const unsigned char *p, size_t len, PasswordFeatures *scan);
+#endif
+scan_kernel_fn select_scan_kernel(const char **name);
+int is_palindrome_n(const char *password, size_t len);
+long find_first_repeat_n(const char *password, size_t len);
+int utf8_check(const char *password, size_t len);
+void scan_password_utf8(const unsigned char *p, size_t len, PasswordFeatures *scan);
+scan_kernel_fn select_scan_kernel_utf8(unsigned rule_set);
+void scan_password_for(const char *password, size_t len, const PasswordRequirements *reqs,
+                       PasswordFeatures *scan);
+scan_kernel_fn select_scan_kernel_for(unsigned rule_set);
+unsigned policy_rule_set(const PasswordRequirements *reqs);
+int policy_table_init(PolicyTable *table, const PasswordRequirements *policies, size_t count);
+void policy_table_free(PolicyTable *table);
+size_t match_policies(const PolicyTable *table, const PasswordFeatures *features, uint64_t *satisfied);
+size_t match_policies_scalar(const PolicyTable *table, const PasswordFeatures *features, uint64_t *satisfied);
+#ifdef PW_HAVE_X86_SIMD
+size_t match_policies_sse2(const PolicyTable *table, const PasswordFeatures *features, uint64_t *satisfied);
+size_t match_policies_avx2(const PolicyTable *table, const PasswordFeatures *features, uint64_t *satisfied);
+#endif
+int parse_policy_spec(const char *spec, PasswordRequirements *reqs);
+void format_policy_spec(const PasswordRequirements *reqs, char *buf, size_t size);
+void bulk_validate_range(const CompiledPolicy *policy, const char *begin, const char *end,
+                         BulkStats *stats, OutputBuffer *passing);
+int bulk_validate_parallel(const CompiledPolicy *policy, const char *data, size_t size,
+                           int threads, int print_passing, BulkStats *stats);
+int run_check_mode(int argc, char *argv[]);
+void stream_validator_init(StreamValidator *sv, const PasswordRequirements *reqs);
+int stream_validator_feed(StreamValidator *sv, const char *chunk, size_t len);
+unsigned stream_validator_finish(StreamValidator *sv, ValidationResult *result);
+void stream_validator_free(StreamValidator *sv);
+int run_validate_mode(int argc, char *argv[]);
+void incremental_validator_init(IncrementalValidator *iv, const PasswordRequirements *reqs);
+int incremental_validator_push(IncrementalValidator *iv, unsigned char byte);
+void incremental_validator_pop(IncrementalValidator *iv);
+void incremental_validator_features(const IncrementalValidator *iv, PasswordFeatures *features);
+unsigned incremental_validator_violations(const IncrementalValidator *iv);
+unsigned incremental_validator_check(const IncrementalValidator *iv, ValidationResult *result);
+void incremental_validator_free(IncrementalValidator *iv);
+unsigned incremental_validator_prefix_check(const IncrementalValidator *iv, size_t max_length);
+unsigned check_prefix(const char *prefix, size_t len, const PasswordRequirements *reqs, size_t max_length);
+unsigned analyze_policy(const PasswordRequirements *reqs, size_t max_length, PolicyVerdict *verdict);
+int run_sweep_mode(int argc, char *argv[]);
+int synthesis_plan(const PasswordRequirements *reqs, SynthesisPlan *plan);
+size_t synthesize_password(const SynthesisPlan *plan, uint64_t *rng, char *out);
+int generate_parallel(const SynthesisPlan *plan, const PasswordCounter *counter, size_t count,
+                      int unbounded, int threads, uint64_t seed, int fd);
+int run_generate_mode(int argc, char *argv[]);
+int password_counter_init(PasswordCounter *pc, const PasswordRequirements *reqs, size_t length,
+                          int keep_tables);
+void password_counter_free(PasswordCounter *pc);
+int password_counter_sample(const PasswordCounter *pc, uint64_t *rng, char *out);
+size_t count_format(const uint64_t *n, int limbs, char *buf, size_t size);
+int password_count_estimate(const PasswordRequirements *reqs, size_t length, double *log2_count);
+int run_count_mode(int argc, char *argv[]);
+int run_benchmark(void);
+static unsigned prefix_dead_rule(const PasswordFeatures *f, uint32_t last, const uint32_t *chars,
+                                 const IncrementalValidator *live, const PasswordRequirements *reqs,
+                                 size_t max_length);
+static void repeated_char(const char *password, size_t len, const PasswordRequirements *reqs,
+                          const PasswordFeatures *features, char *sequence);
+static int run_long_input_benchmark(void);
+static int run_utf8_benchmark(void);
+static int run_policy_benchmark(void);
+static int run_synthesis_benchmark(void);
+static int run_count_benchmark(void);
+static inline int count_is_zero(const uint64_t *n, int limbs);
+static double count_log2(const uint64_t *n, int limbs);
+static void format_log2(double log2_value, char *buf, size_t size);
 
 // --- Main Game Logic ---
-int main() {
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        return run_benchmark();
+    }
+    if (argc > 1 && strcmp(argv[1], "--check") == 0) {
+        return run_check_mode(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--validate") == 0) {
+        return run_validate_mode(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--generate") == 0) {
+        return run_generate_mode(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--count") == 0) {
+        return run_count_mode(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--sweep") == 0) {
+        return run_sweep_mode(argc, argv);
+    }
+    int utf8 = argc > 1 && strcmp(argv[1], "--utf8") == 0; // Passwords are UTF-8 text
+
     srand(time(NULL)); // Seed the random number generator
 
     int round = 1;
     int current_time_limit = INITIAL_TIME;
     PasswordRequirements current_reqs;
-    char password_buffer[MAX_PASSWORD_LEN];
+    char *password_buffer = NULL; // Grows with the input; no length cap
+    size_t password_capacity = 0;
     int successful_round = 1; // Flag to control game loop
+    int skipped_rounds = 0;   // Rounds whose requirements no password can meet
 
     printf("--- Password Generation Game ---\n");
     printf("You will be given password requirements and a time limit.\n");
@@ -67,8 +583,19 @@ int main() {
 
         // Generate and display requirements for this round
         generate_requirements(&current_reqs, round);
+        current_reqs.utf8 = utf8;
         display_requirements(&current_reqs, current_time_limit);
 
+        // Never start the timer on a round nobody can win
+        PolicyVerdict verdict;
+        if (analyze_policy(&current_reqs, SIZE_MAX, &verdict) != 0) {
+            printf("This round cannot be won (%s). Skipping it.\n", verdict.reason);
+            round++;
+            skipped_rounds++;
+            sleep(1);
+            continue;
+        }
+
         // Reset timeout flag and set the alarm
         timed_out = 0;
         alarm(current_time_limit); // Start the timer
@@ -77,7 +604,10 @@ int main() {
         fflush(stdout); // Make sure prompt is shown before potentially blocking read
 
         // Get password input (hidden)
-        int input_result = get_hidden_input(password_buffer, MAX_PASSWORD_LEN);
+        IncrementalValidator live;
+        incremental_validator_init(&live, &current_reqs);
+        long input_result = get_hidden_input(&password_buffer, &password_capacity, utf8, &live);
+        incremental_validator_free(&live);
 
         // Cancel the alarm regardless of whether input was received or timeout occurred
         alarm(0);
@@ -99,7 +629,7 @@ int main() {
         printf("\n"); // Add a newline after hidden input is done
 
         // Validate the entered password
-        if (validate_password(password_buffer, &current_reqs)) {
+        if (validate_password_n(password_buffer, (size_t)input_result, &current_reqs)) {
             printf("Success! Requirements met.\n");
             round++;
             // Decrease time limit, but not below MIN_TIME
@@ -120,8 +650,9 @@ int main() {
     } else if (timed_out) {
          printf("You ran out of time on round %d.\n", round);
     }
-     printf("You completed %d round(s).\n", round - 1);
+     printf("You completed %d round(s).\n", round - 1 - skipped_rounds);
 
+    free(password_buffer);
 
     return 0;
 }
@@ -155,6 +686,24 @@ void handle_timeout(int sig) {
  * @param round The current round number (starting from 1).
  */
 void generate_requirements(PasswordRequirements *reqs, int round) {
+    generate_requirements_roll(reqs, round, rand() % requirement_rolls(round));
+}
+
+/**
+ * @brief Number of distinct random outcomes generate_requirements() has for a round.
+ */
+int requirement_rolls(int round) {
+    return round >= 7 ? round * 2 + 1 : 1; // Only the digit-sum target is random
+}
+
+/**
+ * @brief generate_requirements() with its random choice made explicit, so
+ * every policy a round can produce can be enumerated.
+ * @param reqs Pointer to the PasswordRequirements struct to populate.
+ * @param round The round number (starting from 1).
+ * @param roll The random outcome, 0 to requirement_rolls(round) - 1.
+ */
+void generate_requirements_roll(PasswordRequirements *reqs, int round, int roll) {
     // --- Reset all requirements ---
     memset(reqs, 0, sizeof(PasswordRequirements)); // Important to clear flags!
 
@@ -203,7 +752,7 @@ void generate_requirements(PasswordRequirements *reqs, int round) {
         // Ensure we require at least one digit for this rule
         if (reqs->min_digits < 1) reqs->min_digits = 1;
         // Generate a target sum. Base 5, increases with round, random element.
-        reqs->digit_sum_target = 5 + (round / 2) + (rand() % (round * 2 + 1));
+        reqs->digit_sum_target = 5 + (round / 2) + roll;
     }
 
      // --- Final Sanity Check (Optional but Recommended) ---
@@ -253,6 +802,9 @@ void display_requirements(const PasswordRequirements *reqs, int time_limit) {
          !reqs->req_palindrome && !reqs->req_digit_sum) {
          printf("  - (None this round)\n");
      }
+    if (reqs->utf8) {
+        printf("  (UTF-8: lengths and classes count Unicode characters)\n");
+    }
 }
 
 /**
@@ -270,35 +822,66 @@ void set_terminal_echo(int enable) {
     (void)tcsetattr(STDIN_FILENO, TCSANOW, &tty);
 }
 
+/**
+ * @brief Rewrites the prompt line with how many active rules the input typed
+ * so far meets, and which rule no completion of it can meet any more, if any.
+ * Does nothing unless stdout is a terminal.
+ * @param iv The validator following the input.
+ */
+void display_live_status(const IncrementalValidator *iv) {
+    if (!isatty(STDOUT_FILENO)) return;
+    unsigned active = policy_active_rules(&iv->reqs);
+    unsigned unmet = incremental_validator_violations(iv) & active;
+    unsigned dead = incremental_validator_prefix_check(iv, SIZE_MAX);
+    printf("\rEnter password: [%d/%d rules met%s%s] \033[K",
+           __builtin_popcount(active) - __builtin_popcount(unmet), __builtin_popcount(active),
+           dead ? "; dead end: " : "", dead ? rule_names[__builtin_ctz(dead)] : "");
+    fflush(stdout);
+}
+
 /**
  * @brief Reads a line of input from the user without echoing it to the terminal.
- * Handles the backspace character for basic editing.
- * @param buffer The buffer to store the input.
- * @param max_len The maximum size of the buffer (including null terminator).
+ * Handles the backspace character for basic editing. The buffer grows as
+ * needed, so input is never truncated.
+ * @param buffer The buffer to store the input; may start out NULL. Reallocated as needed.
+ * @param capacity Current size of *buffer; updated when it grows.
+ * @param utf8 If non-zero, bytes >= 0x80 are kept (as parts of UTF-8 characters)
+ * and backspace removes a whole character; otherwise only printable ASCII is kept.
+ * @param live If not NULL, follows every edit, and how many rules the input
+ * meets so far is shown on the prompt line when stdout is a terminal.
  * @return The number of characters read (excluding null terminator), or -1 on error.
  * Returns 0 if timeout occurred before any input.
  */
-int get_hidden_input(char *buffer, int max_len) {
-    if (buffer == NULL || max_len <= 0) {
+long get_hidden_input(char **buffer, size_t *capacity, int utf8, IncrementalValidator *live) {
+    if (buffer == NULL || capacity == NULL) {
         return -1; // Invalid arguments
     }
+    if (*buffer == NULL || *capacity == 0) {
+        free(*buffer);
+        *capacity = INPUT_INITIAL_CAPACITY;
+        *buffer = malloc(*capacity);
+        if (*buffer == NULL) {
+            *capacity = 0;
+            return -1;
+        }
+    }
 
     set_terminal_echo(0); // Disable echoing
 
-    int i = 0;
+    long i = 0;
     char ch;
     ssize_t bytes_read;
 
-    memset(buffer, 0, max_len); // Clear the buffer
+    memset(*buffer, 0, *capacity); // Clear the buffer
 
-    while (i < max_len - 1) {
+    for (;;) {
         // Read one character at a time
         // This read call will be interrupted by the SIGALRM signal
         bytes_read = read(STDIN_FILENO, &ch, 1);
 
         if (timed_out) { // Check flag immediately after read returns
              set_terminal_echo(1); // Re-enable echo before returning
-             buffer[i] = '\0'; // Null terminate potentially partial input
+             (*buffer)[i] = '\0'; // Null terminate potentially partial input
              return 0; // Indicate timeout occurred
         }
 
@@ -318,17 +901,35 @@ int get_hidden_input(char *buffer, int max_len) {
         } else if (ch == 127 || ch == 8) { // Handle backspace (ASCII 127 or 8)
             if (i > 0) {
                 i--;
+                while (utf8 && i > 0 && ((*buffer)[i] & 0xC0) == 0x80) i--; // Back to the lead byte
+                if (live) incremental_validator_pop(live);
                  // Optionally print backspace, space, backspace to erase visually
                  // write(STDOUT_FILENO, "\b \b", 3);
             }
-        } else if (isprint(ch)) { // Only add printable characters
-             buffer[i++] = ch;
+        } else if (CHAR_IS(ch, CC_PRINT) || (utf8 && (unsigned char)ch >= 0x80)) { // Only add printable characters
+             if ((size_t)i + 1 >= *capacity) { // Keep room for the terminator
+                 char *grown = realloc(*buffer, *capacity * 2);
+                 if (grown == NULL) {
+                     set_terminal_echo(1);
+                     perror("realloc");
+                     return -1;
+                 }
+                 *buffer = grown;
+                 *capacity *= 2;
+             }
+             (*buffer)[i++] = ch;
+             if (live && incremental_validator_push(live, (unsigned char)ch) != 0) {
+                 set_terminal_echo(1);
+                 perror("realloc");
+                 return -1;
+             }
              // Optionally print '*' for visual feedback
              // write(STDOUT_FILENO, "*", 1);
         }
+        if (live) display_live_status(live);
     }
 
-    buffer[i] = '\0'; // Null-terminate the string
+    (*buffer)[i] = '\0'; // Null-terminate the string
     set_terminal_echo(1); // Re-enable echoing
 
     return i; // Return number of characters entered
@@ -336,116 +937,7238 @@ int get_hidden_input(char *buffer, int max_len) {
 
 /**
  * @brief Validates if the given password meets ALL specified requirements, including ridiculous ones.
- * @param password The password string to validate.
+ * @param password The NUL-terminated password string to validate.
  * @param reqs Pointer to the PasswordRequirements struct.
  * @return 1 if the password is valid, 0 otherwise.
  */
 int validate_password(const char *password, const PasswordRequirements *reqs) {
-    int len = 0;
-    int upper_count = 0;
-    int lower_count = 0;
-    int digit_count = 0;
-    int symbol_count = 0;
-    int current_digit_sum = 0;
-
-    // --- Basic Length Check ---
-    len = strlen(password);
-    if (len < reqs->min_length) {
-        printf("    Validation Fail: Too short (Length: %d, Required: %d)\n", len, reqs->min_length);
-        return 0;
+    return validate_password_n(password, strlen(password), reqs);
+}
+
+/**
+ * @brief Validates an explicit (pointer, length) password against ALL requirements,
+ * printing the reason for a failure.
+ * @param password The password bytes (need not be NUL-terminated).
+ * @param len Number of bytes in the password.
+ * @param reqs Pointer to the PasswordRequirements struct.
+ * @return 1 if the password is valid, 0 otherwise.
+ */
+int validate_password_n(const char *password, size_t len, const PasswordRequirements *reqs) {
+    ValidationResult result;
+    if (check_password(password, len, reqs, &result) == 0) {
+        return 1;
     }
+    report_validation(stdout, reqs, &result);
+    return 0;
+}
 
-    // --- Iterate and Count Basic Types + Calculate Digit Sum ---
-    for (int i = 0; password[i] != '\0'; i++) {
-        if (isupper(password[i])) {
-            upper_count++;
-        } else if (islower(password[i])) {
-            lower_count++;
-        } else if (isdigit(password[i])) {
-            digit_count++;
-            current_digit_sum += password[i] - '0'; // Convert char digit to int and add
-        } else if (ispunct(password[i])) { // ispunct checks for punctuation characters
-            symbol_count++;
-        }
+/**
+ * @brief Evaluates every rule against a password's features: integer compares only.
+ * Always inlined: when rule_set is a constant the disabled rules compile away,
+ * which is how the specialized validators are built.
+ * @return The RULE_* bits of all violated rules.
+ */
+PW_ALWAYS_INLINE unsigned evaluate_rules_for(const PasswordFeatures *f, const PasswordRequirements *reqs,
+                                             const unsigned rule_set) {
+    const ClassCounts *c = &f->counts;
+    size_t len = f->length;
+    unsigned violations = 0;
+
+    // --- Basic Length and Count Checks ---
+    if ((long)len < reqs->min_length)     violations |= RULE_MIN_LENGTH;
+    if (c->upper < reqs->min_uppercase)   violations |= RULE_MIN_UPPERCASE;
+    if (c->lower < reqs->min_lowercase)   violations |= RULE_MIN_LOWERCASE;
+    if (c->digits < reqs->min_digits)     violations |= RULE_MIN_DIGITS;
+    if (c->symbols < reqs->min_symbols)   violations |= RULE_MIN_SYMBOLS;
+
+    // --- Ridiculous Requirements (only if active) ---
+    if (rule_set & RULESET_START_END) {
+        if (!(f->first_class & CC_UPPER)) violations |= RULE_START_UPPER;
+        if (!(f->last_class & CC_SYMBOL)) violations |= RULE_END_SYMBOL;
+    }
+    if ((rule_set & RULESET_NO_REPEAT) && f->max_run > 1) {
+        violations |= RULE_NO_CONSECUTIVE;
+    }
+    if ((rule_set & RULESET_PALINDROME) && !f->is_palindrome) {
+        violations |= RULE_PALINDROME;
+    }
+    if ((rule_set & RULESET_DIGIT_SUM) &&
+        (c->digit_sum != reqs->digit_sum_target ||
+         // Impossible policy: a target sum with no digits required. Belt-and-suspenders.
+         (reqs->min_digits == 0 && reqs->digit_sum_target != 0))) {
+        violations |= RULE_DIGIT_SUM;
     }
+    if (f->encoding_error >= 0) violations |= RULE_ENCODING;
+    return violations;
+}
 
-    // --- Check Basic Counts ---
-    if (upper_count < reqs->min_uppercase) {
-        printf("    Validation Fail: Not enough uppercase (Found: %d, Required: %d)\n", upper_count, reqs->min_uppercase);
-        return 0;
+/**
+ * @brief Second validation stage: checks a policy against precomputed features.
+ * Costs a handful of integer compares, so one password can be checked against
+ * many policies after a single scan_password().
+ * @param features Features from scan_password() (full kernel).
+ * @param reqs Pointer to the PasswordRequirements struct.
+ * @return The RULE_* bits of all violated rules, 0 if the password is valid.
+ */
+unsigned check_features(const PasswordFeatures *features, const PasswordRequirements *reqs) {
+    return evaluate_rules_for(features, reqs, policy_rule_set(reqs));
+}
+
+/**
+ * @brief Fills a ValidationResult for the first rule, in display order, a
+ * password's features violate.
+ * @param features The password's features.
+ * @param violations All violated RULE_* bits.
+ * @param repeated The character at features->first_repeat (NUL-terminated bytes), if any.
+ * @param result Output.
+ * @return The RULE_* bit reported, or 0.
+ */
+static unsigned describe_first_violation(const PasswordFeatures *features, unsigned violations,
+                                         const char *repeated, ValidationResult *result) {
+    result->violations = violations & -violations; // Lowest bit = first rule in display order
+    if (violations & RULE_ENCODING) {
+        result->violations = RULE_ENCODING; // The other rules were judged on bytes, not characters
     }
-    if (lower_count < reqs->min_lowercase) {
-        printf("    Validation Fail: Not enough lowercase (Found: %d, Required: %d)\n", lower_count, reqs->min_lowercase);
-        return 0;
+    result->length = features->length;
+    result->counts = features->counts;
+    result->position = -1;
+    result->repeated[0] = '\0';
+
+    if (result->violations == RULE_START_UPPER) {
+        result->position = 0;
+    } else if (result->violations == RULE_END_SYMBOL) {
+        result->position = (long)features->length - 1;
+    } else if (result->violations == RULE_NO_CONSECUTIVE) {
+        result->position = features->first_repeat;
+        strcpy(result->repeated, repeated);
+    } else if (result->violations == RULE_ENCODING) {
+        result->position = features->encoding_error;
     }
-    if (digit_count < reqs->min_digits) {
-        printf("    Validation Fail: Not enough digits (Found: %d, Required: %d)\n", digit_count, reqs->min_digits);
-        return 0;
+    return result->violations;
+}
+
+/**
+ * @brief Checks a password against the requirements without doing any I/O.
+ * Rules are numbered in the order they are displayed; the first failure wins.
+ * The password is read exactly once, by scan_password().
+ * @param password The password bytes (need not be NUL-terminated).
+ * @param len Number of bytes in the password.
+ * @param reqs Pointer to the PasswordRequirements struct.
+ * @param result Receives the violated rule, observed counts and offending position.
+ * @return The RULE_* bit that failed, or 0 if the password is valid.
+ */
+unsigned check_password(const char *password, size_t len, const PasswordRequirements *reqs,
+                        ValidationResult *result) {
+    PasswordFeatures features;
+    char repeated[5];
+    scan_password_for(password, len, reqs, &features);
+    repeated_char(password, len, reqs, &features, repeated);
+    return describe_first_violation(&features, check_features(&features, reqs), repeated, result);
+}
+
+/**
+ * @brief Checks a password against every rule at once, for front ends that
+ * render a full checklist. Does no I/O and still reads the password once.
+ * @param password The password bytes (need not be NUL-terminated).
+ * @param len Number of bytes in the password.
+ * @param reqs Pointer to the PasswordRequirements struct.
+ * @param report Receives the active rules, all violations and per-rule detail.
+ * @return The RULE_* bits of all violated rules, 0 if the password is valid.
+ */
+unsigned check_password_all(const char *password, size_t len, const PasswordRequirements *reqs,
+                            ValidationReport *report) {
+    PasswordFeatures features;
+    scan_password_for(password, len, reqs, &features);
+
+    const ClassCounts *c = &features.counts;
+    unsigned v = check_features(&features, reqs);
+    RuleDetail *r = report->rules;
+
+    report->violations = v;
+    report->active = policy_active_rules(reqs);
+
+    for (int i = 0; i < RULE_COUNT; i++) {
+        r[i].observed = !(v & (1u << i));
+        r[i].required = 1;
+        r[i].position = -1;
     }
-    if (symbol_count < reqs->min_symbols) {
-        printf("    Validation Fail: Not enough symbols (Found: %d, Required: %d)\n", symbol_count, reqs->min_symbols);
-        return 0;
+    r[0] = (RuleDetail){ (int)features.length, reqs->min_length, -1 };
+    r[1] = (RuleDetail){ c->upper, reqs->min_uppercase, -1 };
+    r[2] = (RuleDetail){ c->lower, reqs->min_lowercase, -1 };
+    r[3] = (RuleDetail){ c->digits, reqs->min_digits, -1 };
+    r[4] = (RuleDetail){ c->symbols, reqs->min_symbols, -1 };
+    if (v & RULE_START_UPPER)    r[5].position = 0;
+    if (v & RULE_END_SYMBOL)     r[6].position = (long)features.length - 1;
+    if (v & RULE_NO_CONSECUTIVE) {
+        r[7] = (RuleDetail){ (int)features.max_run, 1, features.first_repeat };
     }
+    r[9] = (RuleDetail){ c->digit_sum, reqs->digit_sum_target, -1 };
+    r[10].position = features.encoding_error;
+    return v;
+}
 
-    // --- Check Ridiculous Requirements (only if active) ---
+/**
+ * @brief Prints a human-readable explanation of a failed check.
+ * This is the only place validation results are formatted.
+ * @param out Stream to write to.
+ * @param reqs The requirements it was checked against.
+ * @param result The result filled by check_password() or stream_validator_finish().
+ */
+void report_validation(FILE *out, const PasswordRequirements *reqs, const ValidationResult *result) {
+    const ClassCounts *c = &result->counts;
+    long pos = result->position;
 
-    // 1. Starts with Uppercase, Ends with Symbol
-    if (reqs->req_start_upper_end_symbol) {
-        if (len == 0) { // Should be caught by min_length, but safe check
-             printf("    Validation Fail: Cannot check start/end on empty password.\n");
-             return 0;
-        }
-        if (!isupper(password[0])) {
-            printf("    Validation Fail: Must start with an uppercase letter.\n");
-            return 0;
+    switch (result->violations) {
+    case 0:
+        break;
+    case RULE_MIN_LENGTH:
+        fprintf(out, "    Validation Fail: Too short (Length: %zu, Required: %d)\n", result->length, reqs->min_length);
+        break;
+    case RULE_MIN_UPPERCASE:
+        fprintf(out, "    Validation Fail: Not enough uppercase (Found: %d, Required: %d)\n", c->upper, reqs->min_uppercase);
+        break;
+    case RULE_MIN_LOWERCASE:
+        fprintf(out, "    Validation Fail: Not enough lowercase (Found: %d, Required: %d)\n", c->lower, reqs->min_lowercase);
+        break;
+    case RULE_MIN_DIGITS:
+        fprintf(out, "    Validation Fail: Not enough digits (Found: %d, Required: %d)\n", c->digits, reqs->min_digits);
+        break;
+    case RULE_MIN_SYMBOLS:
+        fprintf(out, "    Validation Fail: Not enough symbols (Found: %d, Required: %d)\n", c->symbols, reqs->min_symbols);
+        break;
+    case RULE_START_UPPER:
+        if (result->length == 0) { // Should be caught by min_length, but safe check
+            fprintf(out, "    Validation Fail: Cannot check start/end on empty password.\n");
+        } else {
+            fprintf(out, "    Validation Fail: Must start with an uppercase letter.\n");
         }
-        if (!ispunct(password[len - 1])) {
-            printf("    Validation Fail: Must end with a symbol.\n");
-            return 0;
+        break;
+    case RULE_END_SYMBOL:
+        fprintf(out, "    Validation Fail: Must end with a symbol.\n");
+        break;
+    case RULE_NO_CONSECUTIVE:
+        fprintf(out, "    Validation Fail: Found consecutive identical characters ('%s%s') at position %d.\n",
+                result->repeated, result->repeated, (int)pos);
+        break;
+    case RULE_PALINDROME:
+        fprintf(out, "    Validation Fail: Password is not a palindrome.\n");
+        break;
+    case RULE_DIGIT_SUM:
+        if (c->digit_sum != reqs->digit_sum_target) {
+            fprintf(out, "    Validation Fail: Sum of digits is %d, but required sum is %d.\n", c->digit_sum, reqs->digit_sum_target);
+        } else {
+            fprintf(out, "    Internal Logic Warning: Digit sum required, but min digits is 0!\n");
         }
+        break;
+    case RULE_ENCODING:
+        fprintf(out, "    Validation Fail: Not valid UTF-8 (at byte %ld).\n", pos);
+        break;
     }
+}
 
-    // 2. No Consecutive Identical Characters
-    if (reqs->req_no_consecutive_chars) {
-        for (int i = 0; i < len - 1; i++) {
-            if (password[i] == password[i + 1]) {
-                printf("    Validation Fail: Found consecutive identical characters ('%c%c') at position %d.\n", password[i], password[i+1], i);
-                return 0;
-            }
+/**
+ * @brief Prints one checklist line per active rule, marking each as met or not.
+ * @param out Stream to write to.
+ * @param report The report filled by check_password_all().
+ */
+void report_checklist(FILE *out, const ValidationReport *report) {
+    for (int i = 0; i < RULE_COUNT; i++) {
+        unsigned bit = 1u << i;
+        const RuleDetail *r = &report->rules[i];
+        if (!(report->active & bit)) continue;
+
+        fprintf(out, "  [%c] %s", (report->violations & bit) ? ' ' : 'x', rule_names[i]);
+        if (bit <= RULE_MIN_SYMBOLS) {
+            fprintf(out, " (Found: %d, Required: %d)", r->observed, r->required);
+        } else if (bit == RULE_DIGIT_SUM) {
+            fprintf(out, " (Sum: %d, Required: %d)", r->observed, r->required);
+        }
+        if (r->position >= 0) {
+            fprintf(out, " at position %ld", r->position);
         }
+        fputc('\n', out);
     }
+}
 
-    // 3. Palindrome Check
-    if (reqs->req_palindrome) {
-        int is_palindrome = 1; // Assume true initially
-        for (int i = 0; i < len / 2; i++) {
-            if (password[i] != password[len - 1 - i]) {
-                is_palindrome = 0;
-                break;
-            }
+// --- Batch Validation ---
+
+/**
+ * @brief Lists the rules a policy actually enables.
+ * @param reqs Pointer to the PasswordRequirements struct.
+ * @return RULE_* bits; the length rule is always active.
+ */
+unsigned policy_active_rules(const PasswordRequirements *reqs) {
+    unsigned active = RULE_MIN_LENGTH;
+    if (reqs->min_uppercase > 0) active |= RULE_MIN_UPPERCASE;
+    if (reqs->min_lowercase > 0) active |= RULE_MIN_LOWERCASE;
+    if (reqs->min_digits > 0)    active |= RULE_MIN_DIGITS;
+    if (reqs->min_symbols > 0)   active |= RULE_MIN_SYMBOLS;
+    if (reqs->req_start_upper_end_symbol) active |= RULE_START_UPPER | RULE_END_SYMBOL;
+    if (reqs->req_no_consecutive_chars)   active |= RULE_NO_CONSECUTIVE;
+    if (reqs->req_palindrome)             active |= RULE_PALINDROME;
+    if (reqs->req_digit_sum)              active |= RULE_DIGIT_SUM;
+    if (reqs->utf8)                       active |= RULE_ENCODING;
+    return active;
+}
+
+/**
+ * @brief Reduces a policy to the set of "ridiculous" rules it enables.
+ * @param reqs Pointer to the PasswordRequirements struct.
+ * @return RULESET_* bits.
+ */
+unsigned policy_rule_set(const PasswordRequirements *reqs) {
+    unsigned rule_set = 0;
+    if (reqs->req_start_upper_end_symbol) rule_set |= RULESET_START_END;
+    if (reqs->req_no_consecutive_chars)   rule_set |= RULESET_NO_REPEAT;
+    if (reqs->req_palindrome)             rule_set |= RULESET_PALINDROME;
+    if (reqs->req_digit_sum)              rule_set |= RULESET_DIGIT_SUM;
+    return rule_set;
+}
+
+// One validator per rule set, each with a compile-time constant rule_set.
+#define SPECIALIZED_VALIDATOR(set) \
+    static unsigned validate_ruleset_##set(const CompiledPolicy *policy, const char *password, size_t len) { \
+        PasswordFeatures features; \
+        policy->kernel((const unsigned char *)password, len, &features); \
+        return evaluate_rules_for(&features, &policy->reqs, (set)); \
+    }
+SPECIALIZED_VALIDATOR(0)  SPECIALIZED_VALIDATOR(1)  SPECIALIZED_VALIDATOR(2)  SPECIALIZED_VALIDATOR(3)
+SPECIALIZED_VALIDATOR(4)  SPECIALIZED_VALIDATOR(5)  SPECIALIZED_VALIDATOR(6)  SPECIALIZED_VALIDATOR(7)
+SPECIALIZED_VALIDATOR(8)  SPECIALIZED_VALIDATOR(9)  SPECIALIZED_VALIDATOR(10) SPECIALIZED_VALIDATOR(11)
+SPECIALIZED_VALIDATOR(12) SPECIALIZED_VALIDATOR(13) SPECIALIZED_VALIDATOR(14) SPECIALIZED_VALIDATOR(15)
+
+static const policy_validator_fn specialized_validators[RULESET_COUNT] = {
+    validate_ruleset_0,  validate_ruleset_1,  validate_ruleset_2,  validate_ruleset_3,
+    validate_ruleset_4,  validate_ruleset_5,  validate_ruleset_6,  validate_ruleset_7,
+    validate_ruleset_8,  validate_ruleset_9,  validate_ruleset_10, validate_ruleset_11,
+    validate_ruleset_12, validate_ruleset_13, validate_ruleset_14, validate_ruleset_15,
+};
+
+/**
+ * @brief Decodes a policy once so batch validation does not repeat the work per password.
+ * Picks the validator specialized for the policy's rule set, and a scan kernel that
+ * skips repeat/palindrome tracking when those rules are off.
+ * @param reqs The requirements to compile.
+ * @param policy Output compiled policy.
+ */
+void compile_policy(const PasswordRequirements *reqs, CompiledPolicy *policy) {
+    policy->reqs = *reqs;
+    policy->active = policy_active_rules(reqs);
+    policy->rule_set = policy_rule_set(reqs);
+    policy->kernel = reqs->utf8 ? select_scan_kernel_utf8(policy->rule_set)
+                                : select_scan_kernel_for(policy->rule_set);
+    policy->validate = specialized_validators[policy->rule_set];
+}
+
+/**
+ * @brief Validates many passwords against one compiled policy.
+ * @param policy The compiled policy.
+ * @param spans The passwords.
+ * @param count Number of spans.
+ * @param pass_bits Bitmap with room for count bits; bit i is set iff spans[i] passes.
+ * Every word covering [0, count) is overwritten.
+ * @param violations If not NULL, receives the RULE_* bits of every violation per password.
+ * @return Number of passwords that passed.
+ */
+size_t validate_batch(const CompiledPolicy *policy, const PasswordSpan *spans, size_t count,
+                      uint64_t *pass_bits, unsigned *violations) {
+    policy_validator_fn validate = policy->validate;
+    size_t passed = 0;
+
+    memset(pass_bits, 0, ((count + 63) / 64) * sizeof(uint64_t));
+    for (size_t i = 0; i < count; i++) {
+        unsigned v = validate(policy, spans[i].ptr, spans[i].len);
+        if (violations) violations[i] = v;
+        if (v == 0) {
+            pass_bits[i / 64] |= (uint64_t)1 << (i % 64);
+            passed++;
         }
-        if (!is_palindrome) {
-            printf("    Validation Fail: Password is not a palindrome.\n");
-            return 0;
+    }
+    return passed;
+}
+
+/**
+ * @brief Validates a newline-separated buffer of passwords against one compiled policy.
+ * A trailing '\r' is stripped from each line; a final line without '\n' is included.
+ * @param policy The compiled policy.
+ * @param buf The buffer of lines.
+ * @param len Buffer length in bytes.
+ * @param max_lines Capacity of pass_bits (in bits) and violations.
+ * @param pass_bits Bitmap; bit i is set iff line i passes.
+ * @param violations If not NULL, receives the RULE_* bits of every violation per line.
+ * @param passed If not NULL, receives the number of lines that passed.
+ * @return Number of lines validated (at most max_lines).
+ */
+size_t validate_batch_lines(const CompiledPolicy *policy, const char *buf, size_t len, size_t max_lines,
+                            uint64_t *pass_bits, unsigned *violations, size_t *passed) {
+    enum { SPAN_CHUNK = 256 }; // Multiple of 64 so every chunk starts on a bitmap word
+    PasswordSpan spans[SPAN_CHUNK];
+    const char *cur = buf;
+    const char *end = buf + len;
+    size_t lines = 0;
+    size_t total_passed = 0;
+
+    while (cur < end && lines < max_lines) {
+        size_t n = 0;
+        while (n < SPAN_CHUNK && cur < end && lines + n < max_lines) {
+            const char *nl = memchr(cur, '\n', (size_t)(end - cur));
+            const char *stop = nl ? nl : end;
+            size_t line_len = (size_t)(stop - cur);
+            if (line_len > 0 && cur[line_len - 1] == '\r') line_len--;
+            spans[n].ptr = cur;
+            spans[n].len = line_len;
+            n++;
+            cur = nl ? nl + 1 : end;
         }
+        total_passed += validate_batch(policy, spans, n, pass_bits + lines / 64,
+                                       violations ? violations + lines : NULL);
+        lines += n;
     }
+    if (passed) *passed = total_passed;
+    return lines;
+}
 
-    // 4. Digit Sum Check
-    if (reqs->req_digit_sum) {
-        if (current_digit_sum != reqs->digit_sum_target) {
-            printf("    Validation Fail: Sum of digits is %d, but required sum is %d.\n", current_digit_sum, reqs->digit_sum_target);
-            return 0;
+// --- Fused Scan Kernels ---
+
+/*
+ * Every kernel comes in four variants: with or without repeated-pair
+ * tracking, and with or without the palindrome compare. The bodies are
+ * always inlined with constant track_* flags, so the variants used for
+ * policies without those rules contain no code for them. Untracked fields
+ * keep their neutral values (first_repeat = -1, max_run <= 1, is_palindrome = 1).
+ */
+#define SCAN_ISA_SCALAR 0
+#define SCAN_ISA_SSE2   1
+#define SCAN_ISA_AVX2   2
+
+/**
+ * @brief Detects the best instruction set for the scan kernels using CPUID, once.
+ * @return One of the SCAN_ISA_* values.
+ */
+static int detect_scan_isa(void) {
+    static int isa = -1;
+    if (isa < 0) {
+        isa = SCAN_ISA_SCALAR;
+#ifdef PW_HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            isa = SCAN_ISA_AVX2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            isa = SCAN_ISA_SSE2;
         }
-         // Also check if the required min digits was 0 but the sum target wasn't 0 (makes it impossible)
-         // This check should ideally be handled in generation, but belt-and-suspenders here.
-         if (reqs->min_digits == 0 && reqs->digit_sum_target != 0) {
-             printf("    Internal Logic Warning: Digit sum required, but min digits is 0!\n");
-             // It's impossible to meet, so fail it.
-             return 0;
-         }
+#endif
+    }
+    return isa;
+}
+
+#ifdef PW_HAVE_X86_SIMD
+/**
+ * @brief Whether the CPU has SSSE3 (pshufb, palignr), which the SSE2-tier UTF-8 validator needs.
+ */
+static int cpu_has_ssse3(void) {
+    static int has = -1;
+    if (has < 0) {
+        __builtin_cpu_init();
+        has = __builtin_cpu_supports("ssse3") ? 1 : 0;
+    }
+    return has;
+}
+#endif
+
+/**
+ * @brief Gathers length, class counts, digit sum, the first repeated pair and
+ * palindrome status in a single forward pass over the password.
+ * Dispatches to the fastest kernel the CPU supports; the choice is made once.
+ * @param password The bytes to scan (need not be NUL-terminated).
+ * @param len Number of bytes to scan.
+ * @param scan Output summary.
+ */
+void scan_password(const char *password, size_t len, PasswordFeatures *scan) {
+    static scan_kernel_fn kernel = NULL;
+    if (kernel == NULL) {
+        kernel = select_scan_kernel(NULL);
     }
+    kernel((const unsigned char *)password, len, scan);
+}
+
+/**
+ * @brief Picks the full scan kernel (all fields tracked) for this CPU.
+ * @param name If not NULL, receives a short name of the chosen kernel.
+ * @return The kernel function.
+ */
+scan_kernel_fn select_scan_kernel(const char **name) {
+    static const char *const names[] = { "scalar", "sse2", "avx2" };
+    int isa = detect_scan_isa();
+    if (name) *name = names[isa];
+    return select_scan_kernel_for(RULESET_NO_REPEAT | RULESET_PALINDROME);
+}
+
+/**
+ * @brief Resets a feature summary before a kernel fills it in.
+ */
+static void scan_begin(PasswordFeatures *scan, size_t len) {
+    memset(scan, 0, sizeof(PasswordFeatures));
+    scan->length = len;
+    scan->first_repeat = -1;
+    scan->encoding_error = -1;
+    scan->max_run = len ? 1 : 0;
+    scan->is_palindrome = 1;
+}
 
+/**
+ * @brief Records the classes of the first and last byte once a kernel is done.
+ * Kept out of scan_begin(): stores through scan before the main loop cost the
+ * vector kernels several times their throughput.
+ */
+static void scan_end(const unsigned char *p, size_t len, PasswordFeatures *scan) {
+    if (len) {
+        scan->first_class = char_table[p[0]].cls_bits;
+        scan->last_class = char_table[p[len - 1]].cls_bits;
+    }
+}
 
-    // --- All checks passed! ---
+/**
+ * @brief Checks p[k] == p[len - 1 - k] for every k in [from, len / 2), one byte pair at a time.
+ * @return 1 if all pairs match, 0 otherwise.
+ */
+static int palindrome_from_scalar(const unsigned char *p, size_t len, size_t from) {
+    for (size_t i = from; i < len / 2; i++) {
+        if (p[i] != p[len - 1 - i]) return 0;
+    }
     return 1;
 }
+
+/**
+ * @brief Finds the first i in [from, len - 1) with p[i] == p[i + 1], one pair at a time.
+ * @return The index, or -1 if there is none.
+ */
+static long first_repeat_from_scalar(const unsigned char *p, size_t len, size_t from) {
+    for (size_t i = from; i + 1 < len; i++) {
+        if (p[i] == p[i + 1]) return (long)i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Portable one-byte-at-a-time scan kernel.
+ */
+PW_ALWAYS_INLINE void scan_scalar_body(const unsigned char *p, size_t len, PasswordFeatures *scan,
+                                       const int track_repeat, const int track_palindrome) {
+    size_t half = len / 2;
+    long run = 0;
+
+    scan_begin(scan, len);
+    for (size_t i = 0; i < len; i++) {
+        // Branch-free: each class bit adds 0 or 1 to its counter
+        CharInfo ci = char_table[p[i]];
+        scan->counts.upper += ci.cls_bits & CC_UPPER;
+        scan->counts.lower += (ci.cls_bits & CC_LOWER) >> 1;
+        scan->counts.digits += (ci.cls_bits & CC_DIGIT) >> 2;
+        scan->counts.symbols += (ci.cls_bits & CC_SYMBOL) >> 3;
+        scan->counts.digit_sum += ci.digit_value;
+        if (track_repeat) {
+            if (i > 0 && p[i] == p[i - 1]) {
+                if (scan->first_repeat < 0) scan->first_repeat = (long)(i - 1);
+                if (++run > scan->max_run) scan->max_run = run;
+            } else {
+                run = 1;
+            }
+        }
+        if (track_palindrome && i < half && scan->is_palindrome && p[i] != p[len - 1 - i]) {
+            scan->is_palindrome = 0;
+        }
+    }
+    scan_end(p, len, scan);
+}
+
+/**
+ * @brief Folds one vector block's repeat bitmask into the run tracking.
+ * Bit j of m is set when byte base+j equals the byte before it, so a run of
+ * k set bits is a run of k+1 identical bytes. Only called when m != 0.
+ * @param m Repeat bitmask of the block.
+ * @param width Block width in bytes (16 or 32).
+ * @param base Offset of the block in the password.
+ * @param scan Receives first_repeat and max_run.
+ * @param ones Set bits ending at the previous block's top bit; updated for this block.
+ */
+static inline void track_runs(uint32_t m, int width, size_t base, PasswordFeatures *scan, long *ones) {
+    uint32_t full = width == 32 ? 0xFFFFFFFFu : (1u << width) - 1;
+    long best;
+
+    if (scan->first_repeat < 0) {
+        scan->first_repeat = (long)(base + __builtin_ctz(m)) - 1;
+    }
+    if (m == full) {
+        *ones += width;
+        best = *ones;
+    } else {
+        best = *ones + __builtin_ctz(~m); // The previous block's run continues here
+        int inner = 0;
+        for (uint32_t x = m; x; x &= x >> 1) inner++; // Longest run of set bits
+        if (inner > best) best = inner;
+        *ones = __builtin_clz(~(m << (32 - width))); // Set bits reaching the top carry on
+    }
+    if (best + 1 > scan->max_run) scan->max_run = best + 1;
+}
+
+#ifdef PW_HAVE_X86_SIMD
+/*
+ * The vector kernels classify exactly like char_table:
+ * A-Z, a-z, 0-9, and every other graphic byte 0x21-0x7E counts as a symbol.
+ * A byte is in [lo, lo+n) when (byte - lo) viewed as unsigned is below n;
+ * SSE2/AVX2 only have signed byte compares, so both sides are biased by 0x80.
+ * Class masks are 0xFF per matching lane, so subtracting them counts in byte
+ * lanes. The digit sum is fused into the same pass: digit lanes are masked,
+ * '0' is subtracted and the values (0-9) are added into byte lanes too. Every
+ * 28 blocks (28 * 9 = 252 < 256) the byte lanes are folded into 64-bit totals
+ * with psadbw against zero before they can overflow.
+ *
+ * The last, partial block goes through the same code with its dead lanes
+ * zeroed (a zero byte is in no class and adds nothing to the digit sum), so
+ * passwords shorter than one block, which is most of a wordlist, never drop
+ * to the byte-at-a-time loop.
+ *
+ * Repeated pairs are found by comparing each block with itself shifted one
+ * byte towards the end, the gap filled from the previous block, so no byte is
+ * loaded twice. Before the first block the "previous" byte is ~p[0], which can
+ * never match p[0]. The compare's movemask is almost always zero; when it is
+ * not, track_runs() turns it into the first repeat and the longest run.
+ */
+#define COUNT_FLUSH_BLOCKS 28
+
+/*
+ * Palindromes are checked a block at a time: the front block at i is compared
+ * with the block ending at len - i, byte-reversed in register, so a whole
+ * block of mirror pairs costs one compare and one movemask. The fused kernels
+ * OR the differences together and look at them once; the standalone routines
+ * stop at the first mismatching block. A leftover partial block is redone as
+ * a full block overlapping the previous one (any k < len is a valid mirror
+ * pair), so only strings shorter than one block need a masked load. Neither
+ * SSE2 nor AVX2 has a byte-granular masked load, so those go through a
+ * zero-padded copy: the padding lanes compare zero with zero and never fail.
+ */
+
+#define SSE2_IN_RANGE(v, lo, n) \
+    _mm_cmplt_epi8(_mm_add_epi8((v), _mm_set1_epi8((char)(0x80 - (lo)))), \
+                   _mm_set1_epi8((char)(-128 + (n))))
+
+// 32 live lanes then 32 dead ones: a load at (32 - r) keeps only the first r lanes.
+static const unsigned char tail_lane_mask[64] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+// A width-byte load from p cannot fault if it stays inside p's page.
+#define TAIL_LOAD_IN_PAGE(p, width) (((uintptr_t)(p) & 4095) <= 4096 - (width))
+
+/**
+ * @brief Loads the last r (< 16) bytes of a password with the other lanes
+ * zeroed: a masked full-block load when that stays inside the page, else a
+ * copy into a zeroed buffer.
+ */
+__attribute__((no_sanitize_address))
+static inline __m128i sse2_load_tail(const unsigned char *p, size_t r) {
+    if (TAIL_LOAD_IN_PAGE(p, 16)) {
+        return _mm_and_si128(_mm_loadu_si128((const __m128i *)p),
+                             _mm_loadu_si128((const __m128i *)(tail_lane_mask + 32 - r)));
+    }
+    unsigned char buf[16] = {0};
+    memcpy(buf, p, r);
+    return _mm_loadu_si128((const __m128i *)buf);
+}
+
+static inline int64_t sse2_hsum_epi64(__m128i v) {
+    return _mm_cvtsi128_si64(v) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v));
+}
+
+static inline __m128i sse2_reverse_bytes(__m128i v) {
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)); // Swap the bytes of each word
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+// Mirror-pair compare of the 16-byte block at i: bit k set when p[i + k] == p[len - 1 - i - k].
+static inline unsigned sse2_mirror_mask(const unsigned char *p, size_t len, size_t i) {
+    __m128i front = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i back = _mm_loadu_si128((const __m128i *)(p + len - i - 16));
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(front, sse2_reverse_bytes(back)));
+}
+
+/**
+ * @brief SSE2 version of palindrome_from_scalar().
+ */
+static int palindrome_from_sse2(const unsigned char *p, size_t len, size_t from) {
+    size_t half = len / 2;
+    size_t i = from;
+
+    if (i >= half) return 1;
+    if (len < 16) {
+        unsigned char front[16] = {0}, back[16] = {0};
+        memcpy(front, p, len);
+        memcpy(back + 16 - len, p, len); // Reversed, back[15 - k] lines up with p[len - 1 - k]
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)front),
+                                    sse2_reverse_bytes(_mm_loadu_si128((const __m128i *)back)));
+        return _mm_movemask_epi8(eq) == 0xFFFF;
+    }
+    for (; i + 16 <= half; i += 16) {
+        if (sse2_mirror_mask(p, len, i) != 0xFFFF) return 0;
+    }
+    return i == half || sse2_mirror_mask(p, len, half >= 16 ? half - 16 : 0) == 0xFFFF;
+}
+
+/**
+ * @brief SSE2 version of first_repeat_from_scalar(). Unlike the fused kernels,
+ * which shift a block in register to avoid reloading bytes, this loads the
+ * block at i and the block at i + 1: bit k of the compare mask is set when
+ * p[i + k] == p[i + k + 1], so ctz of the first non-zero mask is the answer.
+ */
+static long first_repeat_from_sse2(const unsigned char *p, size_t len, size_t from) {
+    size_t i = from;
+    for (; i + 17 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + i + 1));
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+        if (m) return (long)(i + __builtin_ctz(m));
+    }
+    return first_repeat_from_scalar(p, len, i);
+}
+
+PW_ALWAYS_INLINE void scan_sse2_body(const unsigned char *p, size_t len, PasswordFeatures *scan,
+                                     const int track_repeat, const int track_palindrome) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ascii_zero = _mm_set1_epi8('0');
+    __m128i tot_upper = zero, tot_lower = zero, tot_digit = zero;
+    __m128i tot_graph = zero, tot_sum = zero;
+    long ones = 0;
+    __m128i prev = _mm_set1_epi8(len ? (char)~p[0] : 0);
+    __m128i mirror_diff = zero;
+    size_t half = len / 2;
+    size_t i = 0;
+
+    scan_begin(scan, len);
+    while (i < len) {
+        __m128i acc_upper = zero, acc_lower = zero, acc_digit = zero;
+        __m128i acc_graph = zero, acc_sum = zero;
+        for (int b = 0; b < COUNT_FLUSH_BLOCKS && i < len; b++, i += 16) {
+            size_t live = len - i;
+            __m128i v = live >= 16 ? _mm_loadu_si128((const __m128i *)(p + i)) : sse2_load_tail(p + i, live);
+            __m128i is_digit = SSE2_IN_RANGE(v, '0', 10);
+            acc_upper = _mm_sub_epi8(acc_upper, SSE2_IN_RANGE(v, 'A', 26));
+            acc_lower = _mm_sub_epi8(acc_lower, SSE2_IN_RANGE(v, 'a', 26));
+            acc_digit = _mm_sub_epi8(acc_digit, is_digit);
+            acc_graph = _mm_sub_epi8(acc_graph, SSE2_IN_RANGE(v, 0x21, 94));
+            acc_sum = _mm_add_epi8(acc_sum, _mm_and_si128(_mm_sub_epi8(v, ascii_zero), is_digit));
+
+            if (track_repeat) {
+                __m128i shifted = _mm_or_si128(_mm_slli_si128(v, 1), _mm_srli_si128(prev, 15));
+                uint32_t m = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, shifted));
+                if (live < 16) m &= (1u << live) - 1; // Zeroed lanes match each other
+                if (m) track_runs(m, 16, i, scan, &ones);
+                else ones = 0;
+                prev = v;
+            }
+            if (track_palindrome && i + 16 <= half) {
+                __m128i back = _mm_loadu_si128((const __m128i *)(p + len - i - 16));
+                mirror_diff = _mm_or_si128(mirror_diff, _mm_xor_si128(v, sse2_reverse_bytes(back)));
+            }
+        }
+        tot_upper = _mm_add_epi64(tot_upper, _mm_sad_epu8(acc_upper, zero));
+        tot_lower = _mm_add_epi64(tot_lower, _mm_sad_epu8(acc_lower, zero));
+        tot_digit = _mm_add_epi64(tot_digit, _mm_sad_epu8(acc_digit, zero));
+        tot_graph = _mm_add_epi64(tot_graph, _mm_sad_epu8(acc_graph, zero));
+        tot_sum = _mm_add_epi64(tot_sum, _mm_sad_epu8(acc_sum, zero));
+    }
+
+    scan_end(p, len, scan);
+    if (track_palindrome) {
+        // The loop covered every full block of pairs below half; finish from there
+        size_t done = half / 16 * 16;
+        scan->is_palindrome = _mm_movemask_epi8(_mm_cmpeq_epi8(mirror_diff, zero)) == 0xFFFF &&
+                              palindrome_from_sse2(p, len, done);
+    }
+
+    int upper = (int)sse2_hsum_epi64(tot_upper);
+    int lower = (int)sse2_hsum_epi64(tot_lower);
+    int digits = (int)sse2_hsum_epi64(tot_digit);
+    scan->counts.upper += upper;
+    scan->counts.lower += lower;
+    scan->counts.digits += digits;
+    scan->counts.symbols += (int)sse2_hsum_epi64(tot_graph) - upper - lower - digits;
+    scan->counts.digit_sum += (int)sse2_hsum_epi64(tot_sum);
+}
+
+#define AVX2_IN_RANGE(v, lo, n) \
+    _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + (n))), \
+                      _mm256_add_epi8((v), _mm256_set1_epi8((char)(0x80 - (lo)))))
+
+__attribute__((target("avx2"), no_sanitize_address))
+static inline __m256i avx2_load_tail(const unsigned char *p, size_t r) {
+    if (TAIL_LOAD_IN_PAGE(p, 32)) {
+        return _mm256_and_si256(_mm256_loadu_si256((const __m256i *)p),
+                                _mm256_loadu_si256((const __m256i *)(tail_lane_mask + 32 - r)));
+    }
+    unsigned char buf[32] = {0};
+    memcpy(buf, p, r);
+    return _mm256_loadu_si256((const __m256i *)buf);
+}
+
+__attribute__((target("avx2")))
+static inline int64_t avx2_hsum_epi64(__m256i v) {
+    __m128i folded = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return _mm_cvtsi128_si64(folded) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(folded, folded));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_reverse_bytes(__m256i v) {
+    const __m256i reverse_in_lane = _mm256_setr_epi8(
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, reverse_in_lane), _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t avx2_mirror_mask(const unsigned char *p, size_t len, size_t i) {
+    __m256i front = _mm256_loadu_si256((const __m256i *)(p + i));
+    __m256i back = _mm256_loadu_si256((const __m256i *)(p + len - i - 32));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(front, avx2_reverse_bytes(back)));
+}
+
+/**
+ * @brief AVX2 version of palindrome_from_scalar(). Strings shorter than one
+ * 32-byte block are left to the SSE2 routine.
+ */
+__attribute__((target("avx2")))
+static int palindrome_from_avx2(const unsigned char *p, size_t len, size_t from) {
+    size_t half = len / 2;
+    size_t i = from;
+
+    if (i >= half) return 1;
+    if (len < 32) return palindrome_from_sse2(p, len, from);
+    for (; i + 32 <= half; i += 32) {
+        if (avx2_mirror_mask(p, len, i) != 0xFFFFFFFFu) return 0;
+    }
+    return i == half || avx2_mirror_mask(p, len, half >= 32 ? half - 32 : 0) == 0xFFFFFFFFu;
+}
+
+/**
+ * @brief AVX2 version of first_repeat_from_sse2(); the SSE2 routine finishes the tail.
+ */
+__attribute__((target("avx2")))
+static long first_repeat_from_avx2(const unsigned char *p, size_t len, size_t from) {
+    size_t i = from;
+    for (; i + 33 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + i + 1));
+        uint32_t m = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+        if (m) return (long)(i + __builtin_ctz(m));
+    }
+    return first_repeat_from_sse2(p, len, i);
+}
+
+__attribute__((target("avx2")))
+PW_ALWAYS_INLINE void scan_avx2_body(const unsigned char *p, size_t len, PasswordFeatures *scan,
+                                     const int track_repeat, const int track_palindrome) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ascii_zero = _mm256_set1_epi8('0');
+    __m256i tot_upper = zero, tot_lower = zero, tot_digit = zero;
+    __m256i tot_graph = zero, tot_sum = zero;
+    long ones = 0;
+    __m256i prev = _mm256_set1_epi8(len ? (char)~p[0] : 0);
+    __m256i mirror_diff = zero;
+    size_t half = len / 2;
+    size_t i = 0;
+
+    scan_begin(scan, len);
+    while (i < len) {
+        __m256i acc_upper = zero, acc_lower = zero, acc_digit = zero;
+        __m256i acc_graph = zero, acc_sum = zero;
+        for (int b = 0; b < COUNT_FLUSH_BLOCKS && i < len; b++, i += 32) {
+            size_t live = len - i;
+            __m256i v = live >= 32 ? _mm256_loadu_si256((const __m256i *)(p + i)) : avx2_load_tail(p + i, live);
+            __m256i is_digit = AVX2_IN_RANGE(v, '0', 10);
+            acc_upper = _mm256_sub_epi8(acc_upper, AVX2_IN_RANGE(v, 'A', 26));
+            acc_lower = _mm256_sub_epi8(acc_lower, AVX2_IN_RANGE(v, 'a', 26));
+            acc_digit = _mm256_sub_epi8(acc_digit, is_digit);
+            acc_graph = _mm256_sub_epi8(acc_graph, AVX2_IN_RANGE(v, 0x21, 94));
+            acc_sum = _mm256_add_epi8(acc_sum, _mm256_and_si256(_mm256_sub_epi8(v, ascii_zero), is_digit));
+
+            if (track_repeat) {
+                // [prev.hi | v.lo] feeds the byte that crosses each 128-bit lane boundary
+                __m256i carry = _mm256_permute2x128_si256(prev, v, 0x21);
+                __m256i shifted = _mm256_alignr_epi8(v, carry, 15);
+                uint32_t m = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, shifted));
+                if (live < 32) m &= (1u << live) - 1;
+                if (m) track_runs(m, 32, i, scan, &ones);
+                else ones = 0;
+                prev = v;
+            }
+            if (track_palindrome && i + 32 <= half) {
+                __m256i back = _mm256_loadu_si256((const __m256i *)(p + len - i - 32));
+                mirror_diff = _mm256_or_si256(mirror_diff, _mm256_xor_si256(v, avx2_reverse_bytes(back)));
+            }
+        }
+        tot_upper = _mm256_add_epi64(tot_upper, _mm256_sad_epu8(acc_upper, zero));
+        tot_lower = _mm256_add_epi64(tot_lower, _mm256_sad_epu8(acc_lower, zero));
+        tot_digit = _mm256_add_epi64(tot_digit, _mm256_sad_epu8(acc_digit, zero));
+        tot_graph = _mm256_add_epi64(tot_graph, _mm256_sad_epu8(acc_graph, zero));
+        tot_sum = _mm256_add_epi64(tot_sum, _mm256_sad_epu8(acc_sum, zero));
+    }
+
+    scan_end(p, len, scan);
+    if (track_palindrome) {
+        size_t done = half / 32 * 32;
+        scan->is_palindrome = _mm256_testz_si256(mirror_diff, mirror_diff) &&
+                              palindrome_from_avx2(p, len, done);
+    }
+
+    int upper = (int)avx2_hsum_epi64(tot_upper);
+    int lower = (int)avx2_hsum_epi64(tot_lower);
+    int digits = (int)avx2_hsum_epi64(tot_digit);
+    scan->counts.upper += upper;
+    scan->counts.lower += lower;
+    scan->counts.digits += digits;
+    scan->counts.symbols += (int)avx2_hsum_epi64(tot_graph) - upper - lower - digits;
+    scan->counts.digit_sum += (int)avx2_hsum_epi64(tot_sum);
+}
+#endif // PW_HAVE_X86_SIMD
+
+// Instantiates the four tracking variants of one kernel body.
+#define SCAN_KERNEL_VARIANTS(isa, attr) \
+    attr void scan_password_##isa(const unsigned char *p, size_t len, PasswordFeatures *scan) { \
+        scan_##isa##_body(p, len, scan, 1, 1); \
+    } \
+    attr static void scan_##isa##_counts_only(const unsigned char *p, size_t len, PasswordFeatures *scan) { \
+        scan_##isa##_body(p, len, scan, 0, 0); \
+    } \
+    attr static void scan_##isa##_repeat(const unsigned char *p, size_t len, PasswordFeatures *scan) { \
+        scan_##isa##_body(p, len, scan, 1, 0); \
+    } \
+    attr static void scan_##isa##_palindrome(const unsigned char *p, size_t len, PasswordFeatures *scan) { \
+        scan_##isa##_body(p, len, scan, 0, 1); \
+    }
+
+SCAN_KERNEL_VARIANTS(scalar, )
+#ifdef PW_HAVE_X86_SIMD
+SCAN_KERNEL_VARIANTS(sse2, )
+SCAN_KERNEL_VARIANTS(avx2, __attribute__((target("avx2"))))
+#endif
+
+// Indexed by SCAN_ISA_*, then by (track_repeat | track_palindrome << 1).
+static const scan_kernel_fn scan_kernel_table[][4] = {
+    { scan_scalar_counts_only, scan_scalar_repeat, scan_scalar_palindrome, scan_password_scalar },
+#ifdef PW_HAVE_X86_SIMD
+    { scan_sse2_counts_only, scan_sse2_repeat, scan_sse2_palindrome, scan_password_sse2 },
+    { scan_avx2_counts_only, scan_avx2_repeat, scan_avx2_palindrome, scan_password_avx2 },
+#endif
+};
+
+/**
+ * @brief Picks the scan kernel for this CPU that tracks only what a rule set needs.
+ * @param rule_set RULESET_* bits; only NO_REPEAT and PALINDROME affect the scan.
+ * @return The kernel function.
+ */
+scan_kernel_fn select_scan_kernel_for(unsigned rule_set) {
+    int variant = ((rule_set & RULESET_NO_REPEAT) ? 1 : 0) | ((rule_set & RULESET_PALINDROME) ? 2 : 0);
+    return scan_kernel_table[detect_scan_isa()][variant];
+}
+
+/**
+ * @brief Reports whether a password reads the same backwards, comparing whole
+ * vector registers of mirrored bytes where the CPU allows.
+ * @param password The bytes to check (need not be NUL-terminated).
+ * @param len Number of bytes.
+ * @return 1 if it is a palindrome, 0 otherwise.
+ */
+int is_palindrome_n(const char *password, size_t len) {
+    const unsigned char *p = (const unsigned char *)password;
+    switch (detect_scan_isa()) {
+#ifdef PW_HAVE_X86_SIMD
+    case SCAN_ISA_AVX2: return palindrome_from_avx2(p, len, 0);
+    case SCAN_ISA_SSE2: return palindrome_from_sse2(p, len, 0);
+#endif
+    default:            return palindrome_from_scalar(p, len, 0);
+    }
+}
+
+/**
+ * @brief Finds the first pair of identical adjacent bytes, stopping as soon as
+ * a vector block contains one. This is the position the "at position %d"
+ * diagnostic reports, i.e. PasswordFeatures.first_repeat.
+ * @param password The bytes to search (need not be NUL-terminated).
+ * @param len Number of bytes.
+ * @return Index i with password[i] == password[i + 1], or -1 if there is none.
+ */
+long find_first_repeat_n(const char *password, size_t len) {
+    const unsigned char *p = (const unsigned char *)password;
+    switch (detect_scan_isa()) {
+#ifdef PW_HAVE_X86_SIMD
+    case SCAN_ISA_AVX2: return first_repeat_from_avx2(p, len, 0);
+    case SCAN_ISA_SSE2: return first_repeat_from_sse2(p, len, 0);
+#endif
+    default:            return first_repeat_from_scalar(p, len, 0);
+    }
+}
+
+// --- UTF-8 ---
+
+/*
+ * In UTF-8 mode (PasswordRequirements.utf8) a password is a sequence of code
+ * points: min_length counts code points, repeats and palindromes compare code
+ * points, and non-ASCII characters are classified through unicode_ranges.
+ * The input is validated first; if it is all ASCII, which the validator sees
+ * for free, the byte kernels run unchanged.
+ */
+
+#define UTF8_INVALID 0
+#define UTF8_VALID   1 // Valid and contains non-ASCII
+#define UTF8_ASCII   2
+
+#define UC_U  CC_UPPER
+#define UC_L  CC_LOWER
+#define UC_D  CC_DIGIT
+#define UC_S  CC_SYMBOL
+#define UC_ALTERNATING 0x80 // Case pairs: upper and lower alternate, starting with the class given
+#define UC_AU (CC_UPPER | UC_ALTERNATING)
+#define UC_AL (CC_LOWER | UC_ALTERNATING)
+
+// Non-ASCII code points in Unicode 14.0 categories Lu, Ll, Nd and P*/S*
+// (symbols), as sorted ranges. Nd ranges start at a digit zero, so the digit
+// value is (cp - first) % 10. Everything else counts towards the length only.
+static const UnicodeRange unicode_ranges[] = {
+    {0x00A1,9,UC_S}, {0x00AB,2,UC_S}, {0x00AE,4,UC_S}, {0x00B4,1,UC_S}, {0x00B5,1,UC_L},
+    {0x00B6,3,UC_S}, {0x00BB,1,UC_S}, {0x00BF,1,UC_S}, {0x00C0,23,UC_U}, {0x00D7,1,UC_S},
+    {0x00D8,7,UC_U}, {0x00DF,24,UC_L}, {0x00F7,1,UC_S}, {0x00F8,8,UC_L}, {0x0100,55,UC_AU},
+    {0x0137,2,UC_L}, {0x0139,15,UC_AU}, {0x0148,2,UC_L}, {0x014A,46,UC_AU}, {0x0178,2,UC_U},
+    {0x017A,4,UC_AL}, {0x017E,3,UC_L}, {0x0181,2,UC_U}, {0x0183,3,UC_AL}, {0x0186,2,UC_U},
+    {0x0188,1,UC_L}, {0x0189,3,UC_U}, {0x018C,2,UC_L}, {0x018E,4,UC_U}, {0x0192,1,UC_L},
+    {0x0193,2,UC_U}, {0x0195,1,UC_L}, {0x0196,3,UC_U}, {0x0199,3,UC_L}, {0x019C,2,UC_U},
+    {0x019E,1,UC_L}, {0x019F,2,UC_U}, {0x01A1,5,UC_AL}, {0x01A6,2,UC_U}, {0x01A8,1,UC_L},
+    {0x01A9,1,UC_U}, {0x01AA,2,UC_L}, {0x01AC,1,UC_U}, {0x01AD,1,UC_L}, {0x01AE,2,UC_U},
+    {0x01B0,1,UC_L}, {0x01B1,3,UC_U}, {0x01B4,3,UC_AL}, {0x01B7,2,UC_U}, {0x01B9,2,UC_L},
+    {0x01BC,1,UC_U}, {0x01BD,3,UC_L}, {0x01C4,1,UC_U}, {0x01C6,1,UC_L}, {0x01C7,1,UC_U},
+    {0x01C9,1,UC_L}, {0x01CA,1,UC_U}, {0x01CC,16,UC_AL}, {0x01DC,2,UC_L}, {0x01DE,17,UC_AU},
+    {0x01EF,2,UC_L}, {0x01F1,1,UC_U}, {0x01F3,3,UC_AL}, {0x01F6,3,UC_U}, {0x01F9,58,UC_AL},
+    {0x0233,7,UC_L}, {0x023A,2,UC_U}, {0x023C,1,UC_L}, {0x023D,2,UC_U}, {0x023F,2,UC_L},
+    {0x0241,1,UC_U}, {0x0242,1,UC_L}, {0x0243,4,UC_U}, {0x0247,8,UC_AL}, {0x024F,69,UC_L},
+    {0x0295,27,UC_L}, {0x02C2,4,UC_S}, {0x02D2,14,UC_S}, {0x02E5,7,UC_S}, {0x02ED,1,UC_S},
+    {0x02EF,17,UC_S}, {0x0370,4,UC_AU}, {0x0375,1,UC_S}, {0x0376,1,UC_U}, {0x0377,1,UC_L},
+    {0x037B,3,UC_L}, {0x037E,1,UC_S}, {0x037F,1,UC_U}, {0x0384,2,UC_S}, {0x0386,1,UC_U},
+    {0x0387,1,UC_S}, {0x0388,3,UC_U}, {0x038C,1,UC_U}, {0x038E,2,UC_U}, {0x0390,1,UC_L},
+    {0x0391,17,UC_U}, {0x03A3,9,UC_U}, {0x03AC,35,UC_L}, {0x03CF,1,UC_U}, {0x03D0,2,UC_L},
+    {0x03D2,3,UC_U}, {0x03D5,3,UC_L}, {0x03D8,23,UC_AU}, {0x03EF,5,UC_L}, {0x03F4,1,UC_U},
+    {0x03F5,1,UC_L}, {0x03F6,1,UC_S}, {0x03F7,1,UC_U}, {0x03F8,1,UC_L}, {0x03F9,2,UC_U},
+    {0x03FB,2,UC_L}, {0x03FD,51,UC_U}, {0x0430,48,UC_L}, {0x0460,34,UC_AU}, {0x0482,1,UC_S},
+    {0x048A,54,UC_AU}, {0x04C0,2,UC_U}, {0x04C2,12,UC_AL}, {0x04CE,2,UC_L}, {0x04D0,96,UC_AU},
+    {0x0531,38,UC_U}, {0x055A,6,UC_S}, {0x0560,41,UC_L}, {0x0589,2,UC_S}, {0x058D,3,UC_S},
+    {0x05BE,1,UC_S}, {0x05C0,1,UC_S}, {0x05C3,1,UC_S}, {0x05C6,1,UC_S}, {0x05F3,2,UC_S},
+    {0x0606,10,UC_S}, {0x061B,1,UC_S}, {0x061D,3,UC_S}, {0x0660,10,UC_D}, {0x066A,4,UC_S},
+    {0x06D4,1,UC_S}, {0x06DE,1,UC_S}, {0x06E9,1,UC_S}, {0x06F0,10,UC_D}, {0x06FD,2,UC_S},
+    {0x0700,14,UC_S}, {0x07C0,10,UC_D}, {0x07F6,4,UC_S}, {0x07FE,2,UC_S}, {0x0830,15,UC_S},
+    {0x085E,1,UC_S}, {0x0888,1,UC_S}, {0x0964,2,UC_S}, {0x0966,10,UC_D}, {0x0970,1,UC_S},
+    {0x09E6,10,UC_D}, {0x09F2,2,UC_S}, {0x09FA,2,UC_S}, {0x09FD,1,UC_S}, {0x0A66,10,UC_D},
+    {0x0A76,1,UC_S}, {0x0AE6,10,UC_D}, {0x0AF0,2,UC_S}, {0x0B66,10,UC_D}, {0x0B70,1,UC_S},
+    {0x0BE6,10,UC_D}, {0x0BF3,8,UC_S}, {0x0C66,10,UC_D}, {0x0C77,1,UC_S}, {0x0C7F,1,UC_S},
+    {0x0C84,1,UC_S}, {0x0CE6,10,UC_D}, {0x0D4F,1,UC_S}, {0x0D66,10,UC_D}, {0x0D79,1,UC_S},
+    {0x0DE6,10,UC_D}, {0x0DF4,1,UC_S}, {0x0E3F,1,UC_S}, {0x0E4F,1,UC_S}, {0x0E50,10,UC_D},
+    {0x0E5A,2,UC_S}, {0x0ED0,10,UC_D}, {0x0F01,23,UC_S}, {0x0F1A,6,UC_S}, {0x0F20,10,UC_D},
+    {0x0F34,1,UC_S}, {0x0F36,1,UC_S}, {0x0F38,1,UC_S}, {0x0F3A,4,UC_S}, {0x0F85,1,UC_S},
+    {0x0FBE,8,UC_S}, {0x0FC7,6,UC_S}, {0x0FCE,13,UC_S}, {0x1040,10,UC_D}, {0x104A,6,UC_S},
+    {0x1090,10,UC_D}, {0x109E,2,UC_S}, {0x10A0,38,UC_U}, {0x10C7,1,UC_U}, {0x10CD,1,UC_U},
+    {0x10D0,43,UC_L}, {0x10FB,1,UC_S}, {0x10FD,3,UC_L}, {0x1360,9,UC_S}, {0x1390,10,UC_S},
+    {0x13A0,86,UC_U}, {0x13F8,6,UC_L}, {0x1400,1,UC_S}, {0x166D,2,UC_S}, {0x169B,2,UC_S},
+    {0x16EB,3,UC_S}, {0x1735,2,UC_S}, {0x17D4,3,UC_S}, {0x17D8,4,UC_S}, {0x17E0,10,UC_D},
+    {0x1800,11,UC_S}, {0x1810,10,UC_D}, {0x1940,1,UC_S}, {0x1944,2,UC_S}, {0x1946,10,UC_D},
+    {0x19D0,10,UC_D}, {0x19DE,34,UC_S}, {0x1A1E,2,UC_S}, {0x1A80,10,UC_D}, {0x1A90,10,UC_D},
+    {0x1AA0,7,UC_S}, {0x1AA8,6,UC_S}, {0x1B50,10,UC_D}, {0x1B5A,17,UC_S}, {0x1B74,11,UC_S},
+    {0x1BB0,10,UC_D}, {0x1BFC,4,UC_S}, {0x1C3B,5,UC_S}, {0x1C40,10,UC_D}, {0x1C50,10,UC_D},
+    {0x1C7E,2,UC_S}, {0x1C80,9,UC_L}, {0x1C90,43,UC_U}, {0x1CBD,3,UC_U}, {0x1CC0,8,UC_S},
+    {0x1CD3,1,UC_S}, {0x1D00,44,UC_L}, {0x1D6B,13,UC_L}, {0x1D79,34,UC_L}, {0x1E00,149,UC_AU},
+    {0x1E95,9,UC_L}, {0x1E9E,97,UC_AU}, {0x1EFF,9,UC_L}, {0x1F08,8,UC_U}, {0x1F10,6,UC_L},
+    {0x1F18,6,UC_U}, {0x1F20,8,UC_L}, {0x1F28,8,UC_U}, {0x1F30,8,UC_L}, {0x1F38,8,UC_U},
+    {0x1F40,6,UC_L}, {0x1F48,6,UC_U}, {0x1F50,8,UC_L}, {0x1F59,1,UC_U}, {0x1F5B,1,UC_U},
+    {0x1F5D,1,UC_U}, {0x1F5F,1,UC_U}, {0x1F60,8,UC_L}, {0x1F68,8,UC_U}, {0x1F70,14,UC_L},
+    {0x1F80,8,UC_L}, {0x1F90,8,UC_L}, {0x1FA0,8,UC_L}, {0x1FB0,5,UC_L}, {0x1FB6,2,UC_L},
+    {0x1FB8,4,UC_U}, {0x1FBD,1,UC_S}, {0x1FBE,1,UC_L}, {0x1FBF,3,UC_S}, {0x1FC2,3,UC_L},
+    {0x1FC6,2,UC_L}, {0x1FC8,4,UC_U}, {0x1FCD,3,UC_S}, {0x1FD0,4,UC_L}, {0x1FD6,2,UC_L},
+    {0x1FD8,4,UC_U}, {0x1FDD,3,UC_S}, {0x1FE0,8,UC_L}, {0x1FE8,5,UC_U}, {0x1FED,3,UC_S},
+    {0x1FF2,3,UC_L}, {0x1FF6,2,UC_L}, {0x1FF8,4,UC_U}, {0x1FFD,2,UC_S}, {0x2010,24,UC_S},
+    {0x2030,47,UC_S}, {0x207A,5,UC_S}, {0x208A,5,UC_S}, {0x20A0,33,UC_S}, {0x2100,2,UC_S},
+    {0x2102,1,UC_U}, {0x2103,4,UC_S}, {0x2107,1,UC_U}, {0x2108,2,UC_S}, {0x210A,1,UC_L},
+    {0x210B,3,UC_U}, {0x210E,2,UC_L}, {0x2110,3,UC_U}, {0x2113,1,UC_L}, {0x2114,1,UC_S},
+    {0x2115,1,UC_U}, {0x2116,3,UC_S}, {0x2119,5,UC_U}, {0x211E,6,UC_S}, {0x2124,1,UC_U},
+    {0x2125,1,UC_S}, {0x2126,1,UC_U}, {0x2127,1,UC_S}, {0x2128,1,UC_U}, {0x2129,1,UC_S},
+    {0x212A,4,UC_U}, {0x212E,1,UC_S}, {0x212F,1,UC_L}, {0x2130,4,UC_U}, {0x2134,1,UC_L},
+    {0x2139,1,UC_L}, {0x213A,2,UC_S}, {0x213C,2,UC_L}, {0x213E,2,UC_U}, {0x2140,5,UC_S},
+    {0x2145,1,UC_U}, {0x2146,4,UC_L}, {0x214A,4,UC_S}, {0x214E,1,UC_L}, {0x214F,1,UC_S},
+    {0x2183,1,UC_U}, {0x2184,1,UC_L}, {0x218A,2,UC_S}, {0x2190,663,UC_S}, {0x2440,11,UC_S},
+    {0x249C,78,UC_S}, {0x2500,630,UC_S}, {0x2794,992,UC_S}, {0x2B76,32,UC_S}, {0x2B97,105,UC_S},
+    {0x2C00,48,UC_U}, {0x2C30,48,UC_L}, {0x2C60,1,UC_U}, {0x2C61,1,UC_L}, {0x2C62,3,UC_U},
+    {0x2C65,2,UC_L}, {0x2C67,6,UC_AU}, {0x2C6D,4,UC_U}, {0x2C71,1,UC_L}, {0x2C72,1,UC_U},
+    {0x2C73,2,UC_L}, {0x2C75,1,UC_U}, {0x2C76,6,UC_L}, {0x2C7E,3,UC_U}, {0x2C81,98,UC_AL},
+    {0x2CE3,2,UC_L}, {0x2CE5,6,UC_S}, {0x2CEB,4,UC_AU}, {0x2CF2,1,UC_U}, {0x2CF3,1,UC_L},
+    {0x2CF9,4,UC_S}, {0x2CFE,2,UC_S}, {0x2D00,38,UC_L}, {0x2D27,1,UC_L}, {0x2D2D,1,UC_L},
+    {0x2D70,1,UC_S}, {0x2E00,47,UC_S}, {0x2E30,46,UC_S}, {0x2E80,26,UC_S}, {0x2E9B,89,UC_S},
+    {0x2F00,214,UC_S}, {0x2FF0,12,UC_S}, {0x3001,4,UC_S}, {0x3008,25,UC_S}, {0x3030,1,UC_S},
+    {0x3036,2,UC_S}, {0x303D,3,UC_S}, {0x309B,2,UC_S}, {0x30A0,1,UC_S}, {0x30FB,1,UC_S},
+    {0x3190,2,UC_S}, {0x3196,10,UC_S}, {0x31C0,36,UC_S}, {0x3200,31,UC_S}, {0x322A,30,UC_S},
+    {0x3250,1,UC_S}, {0x3260,32,UC_S}, {0x328A,39,UC_S}, {0x32C0,320,UC_S}, {0x4DC0,64,UC_S},
+    {0xA490,55,UC_S}, {0xA4FE,2,UC_S}, {0xA60D,3,UC_S}, {0xA620,10,UC_D}, {0xA640,46,UC_AU},
+    {0xA673,1,UC_S}, {0xA67E,1,UC_S}, {0xA680,28,UC_AU}, {0xA6F2,6,UC_S}, {0xA700,23,UC_S},
+    {0xA720,2,UC_S}, {0xA722,13,UC_AU}, {0xA72F,3,UC_L}, {0xA732,62,UC_AU}, {0xA771,8,UC_L},
+    {0xA779,4,UC_AU}, {0xA77D,2,UC_U}, {0xA77F,9,UC_AL}, {0xA789,2,UC_S}, {0xA78B,4,UC_AU},
+    {0xA790,3,UC_AU}, {0xA793,3,UC_L}, {0xA796,20,UC_AU}, {0xA7AA,5,UC_U}, {0xA7AF,1,UC_L},
+    {0xA7B0,5,UC_U}, {0xA7B5,15,UC_AL}, {0xA7C4,4,UC_U}, {0xA7C8,3,UC_AL}, {0xA7D0,1,UC_U},
+    {0xA7D1,1,UC_L}, {0xA7D3,1,UC_L}, {0xA7D5,5,UC_AL}, {0xA7F5,1,UC_U}, {0xA7F6,1,UC_L},
+    {0xA7FA,1,UC_L}, {0xA828,4,UC_S}, {0xA836,4,UC_S}, {0xA874,4,UC_S}, {0xA8CE,2,UC_S},
+    {0xA8D0,10,UC_D}, {0xA8F8,3,UC_S}, {0xA8FC,1,UC_S}, {0xA900,10,UC_D}, {0xA92E,2,UC_S},
+    {0xA95F,1,UC_S}, {0xA9C1,13,UC_S}, {0xA9D0,10,UC_D}, {0xA9DE,2,UC_S}, {0xA9F0,10,UC_D},
+    {0xAA50,10,UC_D}, {0xAA5C,4,UC_S}, {0xAA77,3,UC_S}, {0xAADE,2,UC_S}, {0xAAF0,2,UC_S},
+    {0xAB30,43,UC_L}, {0xAB5B,1,UC_S}, {0xAB60,9,UC_L}, {0xAB6A,2,UC_S}, {0xAB70,80,UC_L},
+    {0xABEB,1,UC_S}, {0xABF0,10,UC_D}, {0xFB00,7,UC_L}, {0xFB13,5,UC_L}, {0xFB29,1,UC_S},
+    {0xFBB2,17,UC_S}, {0xFD3E,18,UC_S}, {0xFDCF,1,UC_S}, {0xFDFC,4,UC_S}, {0xFE10,10,UC_S},
+    {0xFE30,35,UC_S}, {0xFE54,19,UC_S}, {0xFE68,4,UC_S}, {0xFF01,15,UC_S}, {0xFF10,10,UC_D},
+    {0xFF1A,7,UC_S}, {0xFF21,26,UC_U}, {0xFF3B,6,UC_S}, {0xFF41,26,UC_L}, {0xFF5B,11,UC_S},
+    {0xFFE0,7,UC_S}, {0xFFE8,7,UC_S}, {0xFFFC,2,UC_S}, {0x10100,3,UC_S}, {0x10137,9,UC_S},
+    {0x10179,17,UC_S}, {0x1018C,3,UC_S}, {0x10190,13,UC_S}, {0x101A0,1,UC_S}, {0x101D0,45,UC_S},
+    {0x1039F,1,UC_S}, {0x103D0,1,UC_S}, {0x10400,40,UC_U}, {0x10428,40,UC_L}, {0x104A0,10,UC_D},
+    {0x104B0,36,UC_U}, {0x104D8,36,UC_L}, {0x1056F,1,UC_S}, {0x10570,11,UC_U}, {0x1057C,15,UC_U},
+    {0x1058C,7,UC_U}, {0x10594,2,UC_U}, {0x10597,11,UC_L}, {0x105A3,15,UC_L}, {0x105B3,7,UC_L},
+    {0x105BB,2,UC_L}, {0x10857,1,UC_S}, {0x10877,2,UC_S}, {0x1091F,1,UC_S}, {0x1093F,1,UC_S},
+    {0x10A50,9,UC_S}, {0x10A7F,1,UC_S}, {0x10AC8,1,UC_S}, {0x10AF0,7,UC_S}, {0x10B39,7,UC_S},
+    {0x10B99,4,UC_S}, {0x10C80,51,UC_U}, {0x10CC0,51,UC_L}, {0x10D30,10,UC_D}, {0x10EAD,1,UC_S},
+    {0x10F55,5,UC_S}, {0x10F86,4,UC_S}, {0x11047,7,UC_S}, {0x11066,10,UC_D}, {0x110BB,2,UC_S},
+    {0x110BE,4,UC_S}, {0x110F0,10,UC_D}, {0x11136,10,UC_D}, {0x11140,4,UC_S}, {0x11174,2,UC_S},
+    {0x111C5,4,UC_S}, {0x111CD,1,UC_S}, {0x111D0,10,UC_D}, {0x111DB,1,UC_S}, {0x111DD,3,UC_S},
+    {0x11238,6,UC_S}, {0x112A9,1,UC_S}, {0x112F0,10,UC_D}, {0x1144B,5,UC_S}, {0x11450,10,UC_D},
+    {0x1145A,2,UC_S}, {0x1145D,1,UC_S}, {0x114C6,1,UC_S}, {0x114D0,10,UC_D}, {0x115C1,23,UC_S},
+    {0x11641,3,UC_S}, {0x11650,10,UC_D}, {0x11660,13,UC_S}, {0x116B9,1,UC_S}, {0x116C0,10,UC_D},
+    {0x11730,10,UC_D}, {0x1173C,4,UC_S}, {0x1183B,1,UC_S}, {0x118A0,32,UC_U}, {0x118C0,32,UC_L},
+    {0x118E0,10,UC_D}, {0x11944,3,UC_S}, {0x11950,10,UC_D}, {0x119E2,1,UC_S}, {0x11A3F,8,UC_S},
+    {0x11A9A,3,UC_S}, {0x11A9E,5,UC_S}, {0x11C41,5,UC_S}, {0x11C50,10,UC_D}, {0x11C70,2,UC_S},
+    {0x11D50,10,UC_D}, {0x11DA0,10,UC_D}, {0x11EF7,2,UC_S}, {0x11FD5,29,UC_S}, {0x11FFF,1,UC_S},
+    {0x12470,5,UC_S}, {0x12FF1,2,UC_S}, {0x16A60,10,UC_D}, {0x16A6E,2,UC_S}, {0x16AC0,10,UC_D},
+    {0x16AF5,1,UC_S}, {0x16B37,9,UC_S}, {0x16B44,2,UC_S}, {0x16B50,10,UC_D}, {0x16E40,32,UC_U},
+    {0x16E60,32,UC_L}, {0x16E97,4,UC_S}, {0x16FE2,1,UC_S}, {0x1BC9C,1,UC_S}, {0x1BC9F,1,UC_S},
+    {0x1CF50,116,UC_S}, {0x1D000,246,UC_S}, {0x1D100,39,UC_S}, {0x1D129,60,UC_S}, {0x1D16A,3,UC_S},
+    {0x1D183,2,UC_S}, {0x1D18C,30,UC_S}, {0x1D1AE,61,UC_S}, {0x1D200,66,UC_S}, {0x1D245,1,UC_S},
+    {0x1D300,87,UC_S}, {0x1D400,26,UC_U}, {0x1D41A,26,UC_L}, {0x1D434,26,UC_U}, {0x1D44E,7,UC_L},
+    {0x1D456,18,UC_L}, {0x1D468,26,UC_U}, {0x1D482,26,UC_L}, {0x1D49C,1,UC_U}, {0x1D49E,2,UC_U},
+    {0x1D4A2,1,UC_U}, {0x1D4A5,2,UC_U}, {0x1D4A9,4,UC_U}, {0x1D4AE,8,UC_U}, {0x1D4B6,4,UC_L},
+    {0x1D4BB,1,UC_L}, {0x1D4BD,7,UC_L}, {0x1D4C5,11,UC_L}, {0x1D4D0,26,UC_U}, {0x1D4EA,26,UC_L},
+    {0x1D504,2,UC_U}, {0x1D507,4,UC_U}, {0x1D50D,8,UC_U}, {0x1D516,7,UC_U}, {0x1D51E,26,UC_L},
+    {0x1D538,2,UC_U}, {0x1D53B,4,UC_U}, {0x1D540,5,UC_U}, {0x1D546,1,UC_U}, {0x1D54A,7,UC_U},
+    {0x1D552,26,UC_L}, {0x1D56C,26,UC_U}, {0x1D586,26,UC_L}, {0x1D5A0,26,UC_U}, {0x1D5BA,26,UC_L},
+    {0x1D5D4,26,UC_U}, {0x1D5EE,26,UC_L}, {0x1D608,26,UC_U}, {0x1D622,26,UC_L}, {0x1D63C,26,UC_U},
+    {0x1D656,26,UC_L}, {0x1D670,26,UC_U}, {0x1D68A,28,UC_L}, {0x1D6A8,25,UC_U}, {0x1D6C1,1,UC_S},
+    {0x1D6C2,25,UC_L}, {0x1D6DB,1,UC_S}, {0x1D6DC,6,UC_L}, {0x1D6E2,25,UC_U}, {0x1D6FB,1,UC_S},
+    {0x1D6FC,25,UC_L}, {0x1D715,1,UC_S}, {0x1D716,6,UC_L}, {0x1D71C,25,UC_U}, {0x1D735,1,UC_S},
+    {0x1D736,25,UC_L}, {0x1D74F,1,UC_S}, {0x1D750,6,UC_L}, {0x1D756,25,UC_U}, {0x1D76F,1,UC_S},
+    {0x1D770,25,UC_L}, {0x1D789,1,UC_S}, {0x1D78A,6,UC_L}, {0x1D790,25,UC_U}, {0x1D7A9,1,UC_S},
+    {0x1D7AA,25,UC_L}, {0x1D7C3,1,UC_S}, {0x1D7C4,6,UC_L}, {0x1D7CA,1,UC_U}, {0x1D7CB,1,UC_L},
+    {0x1D7CE,50,UC_D}, {0x1D800,512,UC_S}, {0x1DA37,4,UC_S}, {0x1DA6D,8,UC_S}, {0x1DA76,14,UC_S},
+    {0x1DA85,7,UC_S}, {0x1DF00,10,UC_L}, {0x1DF0B,20,UC_L}, {0x1E140,10,UC_D}, {0x1E14F,1,UC_S},
+    {0x1E2F0,10,UC_D}, {0x1E2FF,1,UC_S}, {0x1E900,34,UC_U}, {0x1E922,34,UC_L}, {0x1E950,10,UC_D},
+    {0x1E95E,2,UC_S}, {0x1ECAC,1,UC_S}, {0x1ECB0,1,UC_S}, {0x1ED2E,1,UC_S}, {0x1EEF0,2,UC_S},
+    {0x1F000,44,UC_S}, {0x1F030,100,UC_S}, {0x1F0A0,15,UC_S}, {0x1F0B1,15,UC_S}, {0x1F0C1,15,UC_S},
+    {0x1F0D1,37,UC_S}, {0x1F10D,161,UC_S}, {0x1F1E6,29,UC_S}, {0x1F210,44,UC_S}, {0x1F240,9,UC_S},
+    {0x1F250,2,UC_S}, {0x1F260,6,UC_S}, {0x1F300,984,UC_S}, {0x1F6DD,16,UC_S}, {0x1F6F0,13,UC_S},
+    {0x1F700,116,UC_S}, {0x1F780,89,UC_S}, {0x1F7E0,12,UC_S}, {0x1F7F0,1,UC_S}, {0x1F800,12,UC_S},
+    {0x1F810,56,UC_S}, {0x1F850,10,UC_S}, {0x1F860,40,UC_S}, {0x1F890,30,UC_S}, {0x1F8B0,2,UC_S},
+    {0x1F900,340,UC_S}, {0x1FA60,14,UC_S}, {0x1FA70,5,UC_S}, {0x1FA78,5,UC_S}, {0x1FA80,7,UC_S},
+    {0x1FA90,29,UC_S}, {0x1FAB0,11,UC_S}, {0x1FAC0,6,UC_S}, {0x1FAD0,10,UC_S}, {0x1FAE0,8,UC_S},
+    {0x1FAF0,7,UC_S}, {0x1FB00,147,UC_S}, {0x1FB94,55,UC_S}, {0x1FBF0,10,UC_D},
+};
+
+/**
+ * @brief Classifies a non-ASCII code point by binary search over unicode_ranges.
+ * @return CC_* bits (CC_PRINT for everything but C1 controls) and digit value.
+ */
+static CharInfo unicode_class(uint32_t cp) {
+    size_t lo = 0, hi = sizeof(unicode_ranges) / sizeof(unicode_ranges[0]);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const UnicodeRange *r = &unicode_ranges[mid];
+        if (cp < r->first) {
+            hi = mid;
+        } else if (cp - r->first >= r->count) {
+            lo = mid + 1;
+        } else {
+            unsigned char cls = r->cls;
+            if (cls & UC_ALTERNATING) {
+                cls &= ~UC_ALTERNATING;
+                if ((cp - r->first) & 1) cls ^= CC_UPPER | CC_LOWER;
+            }
+            return (CharInfo){ cls | CC_PRINT, cls == CC_DIGIT ? (cp - r->first) % 10 : 0 };
+        }
+    }
+    return (CharInfo){ cp >= 0xA0 ? CC_PRINT : 0, 0 };
+}
+
+// Lookup caches in front of unicode_class(), built on first use: every
+// two-byte code point directly, and for each 256-code-point page of the BMP
+// the class shared by all of it (most CJK and Hangul pages), or 0 if mixed.
+#define UC_UNIFORM 0x80
+static CharInfo unicode_two_byte[0x800];
+static unsigned char unicode_page[256];
+static pthread_once_t unicode_cache_once = PTHREAD_ONCE_INIT;
+
+static void unicode_cache_build(void) {
+    for (uint32_t cp = 0x80; cp < 0x800; cp++) unicode_two_byte[cp] = unicode_class(cp);
+    for (uint32_t page = 0x08; page < 0x100; page++) {
+        CharInfo first = unicode_class(page << 8);
+        uint32_t k = 1;
+        while (k < 0x100 && unicode_class(page << 8 | k).cls_bits == first.cls_bits) k++;
+        if (k == 0x100 && !(first.cls_bits & CC_DIGIT)) unicode_page[page] = first.cls_bits | UC_UNIFORM;
+    }
+}
+
+/**
+ * @brief unicode_class() through the caches. unicode_cache_build() must have run.
+ */
+static inline CharInfo unicode_class_cached(uint32_t cp) {
+    if (cp < 0x800) return unicode_two_byte[cp];
+    if (cp < 0x10000 && unicode_page[cp >> 8]) {
+        return (CharInfo){ (unsigned char)(unicode_page[cp >> 8] & ~UC_UNIFORM), 0 };
+    }
+    return unicode_class(cp);
+}
+
+#ifdef PW_HAVE_X86_SIMD
+// For the vector scans, every BMP code point's class as counters that add up
+// in one 32-bit lane: upper, lower, digit and symbol flags in 6-bit fields and
+// the digit value in the top byte. 256 KB, built on first use. The AVX-512
+// scan looks code points below 0x800 up in three bit planes instead (bit
+// cp & 7 of byte cp >> 3: upper or symbol, lower or symbol, digit), and
+// gathers only the three-byte characters whose 64-code-point range
+// unicode_busy marks as having any class.
+#define UREC_FIELD_BITS 6
+#define UREC_FIELD_MASK 0x3F
+#define UREC_VALUE_SHIFT 24
+static uint32_t unicode_records[0x10000];
+static unsigned char unicode_planes[3][256] __attribute__((aligned(64)));
+static unsigned char unicode_busy[128] __attribute__((aligned(64)));
+static pthread_once_t unicode_records_once = PTHREAD_ONCE_INIT;
+
+static void unicode_records_build(void) {
+    pthread_once(&unicode_cache_once, unicode_cache_build);
+    for (uint32_t cp = 0; cp < 0x10000; cp++) {
+        CharInfo ci = cp < 0x80 ? char_table[cp] : unicode_class(cp);
+        unicode_records[cp] = (uint32_t)(ci.cls_bits & CC_UPPER) |
+                              (uint32_t)((ci.cls_bits & CC_LOWER) >> 1) << UREC_FIELD_BITS |
+                              (uint32_t)((ci.cls_bits & CC_DIGIT) >> 2) << 2 * UREC_FIELD_BITS |
+                              (uint32_t)((ci.cls_bits & CC_SYMBOL) >> 3) << 3 * UREC_FIELD_BITS |
+                              (uint32_t)ci.digit_value << UREC_VALUE_SHIFT;
+        if (cp < 0x800) {
+            if (ci.cls_bits & (CC_UPPER | CC_SYMBOL)) unicode_planes[0][cp >> 3] |= (unsigned char)(1u << (cp & 7));
+            if (ci.cls_bits & (CC_LOWER | CC_SYMBOL)) unicode_planes[1][cp >> 3] |= (unsigned char)(1u << (cp & 7));
+            if (ci.cls_bits & CC_DIGIT) unicode_planes[2][cp >> 3] |= (unsigned char)(1u << (cp & 7));
+        } else if (unicode_records[cp]) {
+            unicode_busy[cp >> 9 & 0x7F] |= (unsigned char)(1u << (cp >> 6 & 7));
+        }
+    }
+}
+#endif
+
+/**
+ * @brief Decodes and validates one UTF-8 sequence: no overlongs, no
+ * surrogates, nothing above U+10FFFF.
+ * @param p First byte of the sequence (must be >= 0x80).
+ * @param avail Bytes available from p.
+ * @param cp Receives the code point.
+ * @return The sequence length, or 0 if it is invalid or truncated.
+ */
+static size_t utf8_sequence(const unsigned char *p, size_t avail, uint32_t *cp) {
+    size_t n;
+    uint32_t v, min;
+    if (p[0] >= 0xC2 && p[0] <= 0xDF)      { n = 2; v = p[0] & 0x1F; min = 0x80; }
+    else if (p[0] >= 0xE0 && p[0] <= 0xEF) { n = 3; v = p[0] & 0x0F; min = 0x800; }
+    else if (p[0] >= 0xF0 && p[0] <= 0xF4) { n = 4; v = p[0] & 0x07; min = 0x10000; }
+    else return 0;
+    if (avail < n) return 0;
+    for (size_t k = 1; k < n; k++) {
+        if ((p[k] & 0xC0) != 0x80) return 0;
+        v = (v << 6) | (p[k] & 0x3F);
+    }
+    if (v < min || v > 0x10FFFF || (v >= 0xD800 && v <= 0xDFFF)) return 0;
+    *cp = v;
+    return n;
+}
+
+/**
+ * @brief Decodes one sequence already known to be valid.
+ * @return The sequence length.
+ */
+static inline size_t utf8_decode_valid(const unsigned char *p, uint32_t *cp) {
+    if (p[0] < 0x80) { *cp = p[0]; return 1; }
+    if (p[0] < 0xE0) { *cp = (uint32_t)(p[0] & 0x1F) << 6 | (p[1] & 0x3F); return 2; }
+    if (p[0] < 0xF0) { *cp = (uint32_t)(p[0] & 0x0F) << 12 | (uint32_t)(p[1] & 0x3F) << 6 | (p[2] & 0x3F); return 3; }
+    *cp = (uint32_t)(p[0] & 0x07) << 18 | (uint32_t)(p[1] & 0x3F) << 12 | (uint32_t)(p[2] & 0x3F) << 6 | (p[3] & 0x3F);
+    return 4;
+}
+
+/**
+ * @brief Returns the byte offset of the first invalid UTF-8 sequence, or len if there is none.
+ */
+static size_t utf8_error_offset(const unsigned char *p, size_t len) {
+    size_t i = 0;
+    uint32_t cp;
+    while (i < len) {
+        if (p[i] < 0x80) {
+            i++;
+        } else {
+            size_t n = utf8_sequence(p + i, len - i, &cp);
+            if (n == 0) return i;
+            i += n;
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief Portable UTF-8 check, skipping 8-byte ASCII words at a time.
+ * @return UTF8_ASCII, UTF8_VALID or UTF8_INVALID.
+ */
+static int utf8_check_scalar(const unsigned char *p, size_t len) {
+    size_t i = 0;
+    int result = UTF8_ASCII;
+    uint32_t cp;
+    while (i < len) {
+        uint64_t word;
+        if (len - i >= 8 && (memcpy(&word, p + i, 8), (word & 0x8080808080808080ull) == 0)) {
+            i += 8;
+        } else if (p[i] < 0x80) {
+            i++;
+        } else {
+            size_t n = utf8_sequence(p + i, len - i, &cp);
+            if (n == 0) return UTF8_INVALID;
+            result = UTF8_VALID;
+            i += n;
+        }
+    }
+    return result;
+}
+
+#ifdef PW_HAVE_X86_SIMD
+/*
+ * UTF-8 validation after Keiser and Lemire, "Validating UTF-8 in less than
+ * one instruction per byte" (2021). Each error class is a bit; three
+ * 16-entry pshufb lookups keyed on the high nibble of the previous byte, its
+ * low nibble and the high nibble of the current byte are ANDed, so a bit
+ * survives only where all three nibbles agree on that error. Whether a byte
+ * must be the 2nd/3rd continuation of a 3- or 4-byte sequence comes from the
+ * bytes two and three back. An all-ASCII block costs one movemask. The SSSE3
+ * and AVX2 validators share the tables; AVX2 repeats them in both lanes.
+ */
+#define UTF8_TOO_SHORT  (1 << 0) // Lead byte not followed by a continuation
+#define UTF8_TOO_LONG   (1 << 1) // ASCII followed by a continuation
+#define UTF8_OVERLONG_3 (1 << 2)
+#define UTF8_TOO_LARGE  (1 << 3)
+#define UTF8_SURROGATE  (1 << 4)
+#define UTF8_OVERLONG_2 (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4 (1 << 6)
+#define UTF8_TWO_CONTS  (1 << 7) // Continuation following a continuation (checked separately)
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+static const unsigned char utf8_byte_1_high[16] = {
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+};
+
+static const unsigned char utf8_byte_1_low[16] = {
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_OVERLONG_2,
+    UTF8_CARRY,
+    UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+};
+
+static const unsigned char utf8_byte_2_high[16] = {
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+};
+
+// A block ending in the first bytes of a sequence is only fine if the next
+// block completes it. SSSE3 blocks use the last 16 entries.
+static const unsigned char utf8_max_last[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xF0 - 1, 0xE0 - 1, 0xC0 - 1,
+};
+
+/**
+ * @brief Error bits of one SSSE3 block that is not all ASCII.
+ * @param prev1 The block shifted one byte towards the end, the gap filled from
+ * the previous block; prev2 and prev3 likewise by two and three bytes.
+ */
+__attribute__((target("ssse3")))
+static inline __m128i ssse3_utf8_errors(__m128i input, __m128i prev1, __m128i prev2, __m128i prev3) {
+    const __m128i low_nibble = _mm_set1_epi8(0x0F);
+    __m128i special = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)utf8_byte_1_high),
+                                       _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble)),
+                      _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)utf8_byte_1_low),
+                                       _mm_and_si128(prev1, low_nibble))),
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)utf8_byte_2_high),
+                         _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble)));
+    __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+    __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+    __m128i must_continue = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8((char)0x80));
+    return _mm_xor_si128(must_continue, special);
+}
+
+/**
+ * @brief SSSE3 UTF-8 check, 16 bytes at a time.
+ * @return UTF8_ASCII, UTF8_VALID or UTF8_INVALID.
+ */
+__attribute__((target("ssse3")))
+static int utf8_check_ssse3(const unsigned char *p, size_t len) {
+    const __m128i max_last = _mm_loadu_si128((const __m128i *)(utf8_max_last + 16));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i error = zero, prev_input = zero, prev_incomplete = zero;
+    int any_non_ascii = 0;
+
+    for (size_t i = 0; i < len; i += 16) {
+        size_t live = len - i;
+        __m128i input = live >= 16 ? _mm_loadu_si128((const __m128i *)(p + i)) : sse2_load_tail(p + i, live);
+        if (_mm_movemask_epi8(input) == 0) {
+            error = _mm_or_si128(error, prev_incomplete);
+        } else {
+            error = _mm_or_si128(error, ssse3_utf8_errors(input, _mm_alignr_epi8(input, prev_input, 15),
+                                                          _mm_alignr_epi8(input, prev_input, 14),
+                                                          _mm_alignr_epi8(input, prev_input, 13)));
+            prev_incomplete = _mm_subs_epu8(input, max_last);
+            any_non_ascii = 1;
+        }
+        prev_input = input;
+    }
+    error = _mm_or_si128(error, prev_incomplete);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xFFFF) return UTF8_INVALID;
+    return any_non_ascii ? UTF8_VALID : UTF8_ASCII;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_high_nibbles(__m256i v) {
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_broadcast_lut(const unsigned char *lut) {
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lut));
+}
+
+/**
+ * @brief AVX2 version of ssse3_utf8_errors().
+ */
+__attribute__((target("avx2")))
+static inline __m256i avx2_utf8_errors(__m256i input, __m256i prev1, __m256i prev2, __m256i prev3) {
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(_mm256_shuffle_epi8(avx2_broadcast_lut(utf8_byte_1_high), avx2_high_nibbles(prev1)),
+                         _mm256_shuffle_epi8(avx2_broadcast_lut(utf8_byte_1_low),
+                                             _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))),
+        _mm256_shuffle_epi8(avx2_broadcast_lut(utf8_byte_2_high), avx2_high_nibbles(input)));
+    __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_continue, special);
+}
+
+__attribute__((target("avx2")))
+static int utf8_check_avx2(const unsigned char *p, size_t len) {
+    const __m256i max_last = _mm256_loadu_si256((const __m256i *)utf8_max_last);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i error = zero, prev_input = zero, prev_incomplete = zero;
+    int any_non_ascii = 0;
+
+    for (size_t i = 0; i < len; i += 32) {
+        size_t live = len - i;
+        __m256i input = live >= 32 ? _mm256_loadu_si256((const __m256i *)(p + i)) : avx2_load_tail(p + i, live);
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+        } else {
+            __m256i carry = _mm256_permute2x128_si256(prev_input, input, 0x21);
+            error = _mm256_or_si256(error, avx2_utf8_errors(input, _mm256_alignr_epi8(input, carry, 15),
+                                                            _mm256_alignr_epi8(input, carry, 14),
+                                                            _mm256_alignr_epi8(input, carry, 13)));
+            prev_incomplete = _mm256_subs_epu8(input, max_last);
+            any_non_ascii = 1;
+        }
+        prev_input = input;
+    }
+    error = _mm256_or_si256(error, prev_incomplete);
+    if (!_mm256_testz_si256(error, error)) return UTF8_INVALID;
+    return any_non_ascii ? UTF8_VALID : UTF8_ASCII;
+}
+#endif // PW_HAVE_X86_SIMD
+
+/**
+ * @brief Checks that a buffer is valid UTF-8 using the best validator for this CPU.
+ * @param password The bytes to check.
+ * @param len Number of bytes.
+ * @return UTF8_ASCII if every byte is ASCII, UTF8_VALID if valid with
+ * non-ASCII characters, UTF8_INVALID otherwise.
+ */
+int utf8_check(const char *password, size_t len) {
+    const unsigned char *p = (const unsigned char *)password;
+    switch (detect_scan_isa()) {
+#ifdef PW_HAVE_X86_SIMD
+    case SCAN_ISA_AVX2: return utf8_check_avx2(p, len);
+    case SCAN_ISA_SSE2: return cpu_has_ssse3() ? utf8_check_ssse3(p, len) : utf8_check_scalar(p, len);
+#endif
+    default:            return utf8_check_scalar(p, len);
+    }
+}
+
+/**
+ * @brief Palindrome check by code point on valid UTF-8: the character at the
+ * front must have the same bytes as the character at the back.
+ */
+static int utf8_is_palindrome(const unsigned char *p, size_t len) {
+    size_t front = 0, back = len;
+    while (front < back) {
+        size_t start = back - 1;
+        while (start > front && (p[start] & 0xC0) == 0x80) start--;
+        if (start <= front) break; // Met in the middle
+        uint32_t cp;
+        size_t n = utf8_decode_valid(p + front, &cp);
+        if (n != back - start) return 0;
+        for (size_t k = 0; k < n; k++) {
+            if (p[front + k] != p[start + k]) return 0;
+        }
+        front += n;
+        back = start;
+    }
+    return 1;
+}
+
+/**
+ * @brief Finds the code point at a given character index of valid UTF-8.
+ * @param sequence Receives the character's bytes, NUL-terminated (5 bytes).
+ */
+static void utf8_char_at(const unsigned char *p, size_t len, size_t index, char *sequence) {
+    size_t i = 0, n = 0;
+    uint32_t cp;
+    while (i < len) {
+        size_t k = utf8_decode_valid(p + i, &cp);
+        if (n++ == index) {
+            memcpy(sequence, p + i, k);
+            sequence[k] = '\0';
+            return;
+        }
+        i += k;
+    }
+    sequence[0] = '\0';
+}
+
+#ifdef PW_HAVE_X86_SIMD
+/*
+ * The AVX2 UTF-8 scan leaves all-ASCII input to the byte kernels. Otherwise
+ * the counts-only byte kernel classifies the ASCII characters (it skips
+ * bytes above 0x7F), and one more pass validates and classifies the rest, 32
+ * bytes at a time; all-ASCII blocks only feed validation, character counts
+ * and repeats. A non-ASCII lead byte is always followed by a continuation
+ * byte, so each pair of lanes holds at most one: per pair a pshufb picks the
+ * four bytes starting at whichever lane leads, pmaddubsw and pmaddwd
+ * assemble the code point, and one gather per 8 pairs fetches its
+ * unicode_records entry. The entries add
+ * up in 32-bit lanes, two characters per lane and block, so they are folded
+ * into totals every UTF8_FLUSH_BLOCKS blocks. Four-byte characters, being
+ * rare and outside the table, are decoded and classified one at a time.
+ *
+ * A character of n bytes repeats the one before it when those n bytes equal
+ * the n bytes before them. Comparing the block with itself shifted by one to
+ * four bytes either way gives that for every lead at once; the repeat bits
+ * are then packed down to character positions for track_runs(). Validation
+ * is the Keiser-Lemire check of utf8_check_avx2() on the same shifted
+ * vectors. The next block is loaded one step ahead, so the bytes past the
+ * end of a block come from a register and never from beyond the input.
+ */
+#define UTF8_FLUSH_BLOCKS (COUNT_FLUSH_BLOCKS / 2)
+
+/**
+ * @brief Keeps the bits of m at the set positions of sel, packed towards bit 0.
+ * Loops once per set bit of m, which must lie within sel.
+ */
+static inline uint32_t compress_bits(uint32_t m, uint32_t sel) {
+    uint32_t out = 0;
+    for (; m; m &= m - 1) out |= 1u << __builtin_popcount(sel & ((m & (0u - m)) - 1));
+    return out;
+}
+
+/**
+ * @brief Sets first_class and last_class from the first and last character of valid UTF-8.
+ */
+static void scan_end_utf8(const unsigned char *p, size_t len, PasswordFeatures *scan) {
+    if (len) {
+        size_t last = len - 1;
+        uint32_t cp;
+        while (last > 0 && (p[last] & 0xC0) == 0x80) last--;
+        utf8_decode_valid(p, &cp);
+        scan->first_class = cp < 0x80 ? char_table[cp].cls_bits : unicode_class_cached(cp).cls_bits;
+        utf8_decode_valid(p + last, &cp);
+        scan->last_class = cp < 0x80 ? char_table[cp].cls_bits : unicode_class_cached(cp).cls_bits;
+    }
+}
+
+/**
+ * @brief Looks up the unicode_records entries of the two- and three-byte
+ * characters starting in v, one 32-bit lane per pair of bytes (zero where
+ * neither leads). next1 and next2 are v shifted on by one and two bytes.
+ */
+__attribute__((target("avx2")))
+static inline __m256i avx2_utf8_records(__m256i v, __m256i next1, __m256i next2) {
+    const __m256i payload = _mm256_set1_epi16(0x3F1F);
+    const __m256i weights = _mm256_set1_epi16(0x0140);
+    __m256i from_even = _mm256_maddubs_epi16(_mm256_and_si256(v, payload), weights);
+    __m256i from_odd = _mm256_maddubs_epi16(_mm256_and_si256(next1, payload), weights);
+    __m256i odd_leads = _mm256_srai_epi16(_mm256_and_si256(v, _mm256_slli_epi16(v, 1)), 15);
+    __m256i cp = _mm256_blendv_epi8(from_even, from_odd, odd_leads);
+    __m256i third = _mm256_blendv_epi8(next2, _mm256_srli_epi16(next2, 8), odd_leads);
+    __m256i lead = _mm256_blendv_epi8(_mm256_slli_epi16(v, 8), v, odd_leads);
+    __m256i is_three = _mm256_srai_epi16(_mm256_slli_epi16(lead, 2), 15);
+    cp = _mm256_blendv_epi8(cp, _mm256_or_si256(_mm256_slli_epi16(cp, 6), _mm256_and_si256(third, _mm256_set1_epi16(0x3F))),
+                            is_three);
+    __m256i want = _mm256_andnot_si256(_mm256_and_si256(_mm256_slli_epi16(lead, 2), _mm256_slli_epi16(lead, 3)),
+                                       _mm256_and_si256(lead, _mm256_slli_epi16(lead, 1)));
+    __m256i lo = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)unicode_records,
+                                             _mm256_and_si256(cp, _mm256_set1_epi32(0xFFFF)),
+                                             _mm256_slli_epi32(want, 16), 4);
+    __m256i hi = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)unicode_records,
+                                             _mm256_srli_epi32(cp, 16), want, 4);
+    return _mm256_add_epi32(lo, hi);
+}
+
+/**
+ * @brief Adds the class fields of a record accumulator into 32-bit totals.
+ * @param totals Upper, lower, digit, symbol and digit-sum totals.
+ */
+__attribute__((target("avx2")))
+static inline void avx2_fold_records(__m256i records, __m256i *totals) {
+    const __m256i field = _mm256_set1_epi32(UREC_FIELD_MASK);
+    totals[0] = _mm256_add_epi32(totals[0], _mm256_and_si256(records, field));
+    totals[1] = _mm256_add_epi32(totals[1], _mm256_and_si256(_mm256_srli_epi32(records, UREC_FIELD_BITS), field));
+    totals[2] = _mm256_add_epi32(totals[2], _mm256_and_si256(_mm256_srli_epi32(records, 2 * UREC_FIELD_BITS), field));
+    totals[3] = _mm256_add_epi32(totals[3], _mm256_and_si256(_mm256_srli_epi32(records, 3 * UREC_FIELD_BITS), field));
+    totals[4] = _mm256_add_epi32(totals[4], _mm256_srli_epi32(records, UREC_VALUE_SHIFT));
+}
+
+__attribute__((target("avx2")))
+static inline int avx2_hsum_epi32(__m256i v) {
+    __m128i folded = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    folded = _mm_add_epi32(folded, _mm_unpackhi_epi64(folded, folded));
+    return _mm_cvtsi128_si32(folded) + _mm_cvtsi128_si32(_mm_srli_epi64(folded, 32));
+}
+
+/**
+ * @brief Tells whether every byte is ASCII, stopping at the first block that is not.
+ */
+__attribute__((target("avx2")))
+static int avx2_is_ascii(const unsigned char *p, size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        if (_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(p + i)))) return 0;
+    }
+    return i == len || _mm256_movemask_epi8(avx2_load_tail(p + i, len - i)) == 0;
+}
+
+#define EQ_MASK(a, b) ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8((a), (b))))
+
+/**
+ * @brief AVX2 UTF-8 scan of everything but the palindrome flag, for input
+ * that is not all ASCII. The byte kernel counts the ASCII characters.
+ * @return UTF8_VALID with scan filled in by code point, or UTF8_INVALID with
+ * scan unusable.
+ */
+__attribute__((target("avx2")))
+PW_ALWAYS_INLINE int scan_utf8_avx2_body(const unsigned char *p, size_t len, PasswordFeatures *scan,
+                                         const int track_repeat) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max_last = _mm256_loadu_si256((const __m256i *)utf8_max_last);
+    __m256i tot_records[5] = { zero, zero, zero, zero, zero };
+    __m256i prev = zero, error = zero;
+    __m256i next = len >= 32 ? _mm256_loadu_si256((const __m256i *)p) : len ? avx2_load_tail(p, len) : zero;
+    size_t chars = 0;
+    long ones = 0;
+    size_t i = 0;
+
+    pthread_once(&unicode_records_once, unicode_records_build);
+    pthread_once(&unicode_cache_once, unicode_cache_build);
+    scan_avx2_counts_only(p, len, scan); // The ASCII characters
+    while (i < len) {
+        __m256i acc_records = zero;
+        for (int b = 0; b < UTF8_FLUSH_BLOCKS && i < len; b++, i += 32) {
+            size_t live = len - i;
+            uint32_t live_mask = live >= 32 ? 0xFFFFFFFFu : (1u << live) - 1;
+            __m256i v = next;
+            if (live > 64) {
+                next = _mm256_loadu_si256((const __m256i *)(p + i + 32));
+            } else {
+                next = live > 32 ? avx2_load_tail(p + i + 32, live - 32) : zero;
+            }
+
+
+            __m256i carry = _mm256_permute2x128_si256(prev, v, 0x21);
+            __m256i prev1 = _mm256_alignr_epi8(v, carry, 15);
+            uint32_t non_ascii = (uint32_t)_mm256_movemask_epi8(v);
+            uint32_t leads = live_mask, repeats = 0;
+            if (non_ascii == 0) {
+                error = _mm256_or_si256(error, _mm256_subs_epu8(prev, max_last));
+                if (track_repeat) repeats = EQ_MASK(v, prev1);
+            } else {
+                __m256i prev2 = _mm256_alignr_epi8(v, carry, 14);
+                __m256i prev3 = _mm256_alignr_epi8(v, carry, 13);
+                __m256i ahead = _mm256_permute2x128_si256(v, next, 0x21);
+                error = _mm256_or_si256(error, avx2_utf8_errors(v, prev1, prev2, prev3));
+
+                // Bits 6, 5 and 4 tell continuations and leads of 2, 3 and 4 bytes apart
+                uint32_t bit6 = (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(v, 1));
+                uint32_t bit5 = (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(v, 2));
+                uint32_t bit4 = (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(v, 3));
+                uint32_t multi = non_ascii & bit6 & live_mask;
+                leads = (~non_ascii & live_mask) | multi;
+                uint32_t two = multi & ~bit5, three = multi & bit5 & ~bit4, four = multi & bit5 & bit4;
+
+                __m256i next1 = _mm256_alignr_epi8(ahead, v, 1);
+                __m256i next2 = _mm256_alignr_epi8(ahead, v, 2);
+                if (track_repeat) {
+                    // A character of n bytes repeats when each of its bytes equals the one n bytes back
+                    repeats = (~non_ascii & EQ_MASK(v, prev1)) |
+                              (two & EQ_MASK(v, prev2) & EQ_MASK(next1, prev1)) |
+                              (three & EQ_MASK(v, prev3) & EQ_MASK(next1, prev2) & EQ_MASK(next2, prev1));
+                    if (four) {
+                        repeats |= four & EQ_MASK(v, _mm256_alignr_epi8(v, carry, 12)) & EQ_MASK(next1, prev3) &
+                                   EQ_MASK(next2, prev2) & EQ_MASK(_mm256_alignr_epi8(ahead, v, 3), prev1);
+                    }
+                }
+                acc_records = _mm256_add_epi32(acc_records, avx2_utf8_records(v, next1, next2));
+                for (uint32_t m = four; m; m &= m - 1) {
+                    size_t at = i + (size_t)__builtin_ctz(m);
+                    uint32_t cp;
+                    if (utf8_sequence(p + at, len - at, &cp) == 0) continue; // Flagged by the validator
+                    CharInfo ci = unicode_class(cp);
+                    scan->counts.upper += ci.cls_bits & CC_UPPER;
+                    scan->counts.lower += (ci.cls_bits & CC_LOWER) >> 1;
+                    scan->counts.digits += (ci.cls_bits & CC_DIGIT) >> 2;
+                    scan->counts.symbols += (ci.cls_bits & CC_SYMBOL) >> 3;
+                    scan->counts.digit_sum += ci.digit_value;
+                }
+            }
+            if (track_repeat) {
+                repeats &= live_mask & (i == 0 ? ~1u : ~0u); // Nothing comes before the first character
+                if (repeats) {
+                    uint32_t packed = leads == 0xFFFFFFFFu ? repeats : compress_bits(repeats, leads);
+                    track_runs(packed, __builtin_popcount(leads), chars, scan, &ones);
+                } else {
+                    ones = 0;
+                }
+            }
+            chars += (size_t)__builtin_popcount(leads);
+            prev = v;
+        }
+        avx2_fold_records(acc_records, tot_records);
+    }
+
+    error = _mm256_or_si256(error, _mm256_subs_epu8(prev, max_last));
+    if (!_mm256_testz_si256(error, error)) return UTF8_INVALID;
+    scan->length = chars;
+    scan_end_utf8(p, len, scan);
+
+    scan->counts.upper += avx2_hsum_epi32(tot_records[0]);
+    scan->counts.lower += avx2_hsum_epi32(tot_records[1]);
+    scan->counts.digits += avx2_hsum_epi32(tot_records[2]);
+    scan->counts.symbols += avx2_hsum_epi32(tot_records[3]);
+    scan->counts.digit_sum += avx2_hsum_epi32(tot_records[4]);
+    return UTF8_VALID;
+}
+#undef EQ_MASK
+
+__attribute__((target("avx2")))
+static int scan_utf8_avx2_counts_only(const unsigned char *p, size_t len, PasswordFeatures *scan) {
+    return scan_utf8_avx2_body(p, len, scan, 0);
+}
+
+__attribute__((target("avx2")))
+static int scan_utf8_avx2_repeat(const unsigned char *p, size_t len, PasswordFeatures *scan) {
+    return scan_utf8_avx2_body(p, len, scan, 1);
+}
+
+/*
+ * With AVX-512 the scan above runs 64 bytes at a time and in one pass, the
+ * ASCII classes included. A block of only ASCII skips the continuation
+ * checks. Otherwise the lead and continuation masks are checked against each
+ * other in general registers (every continuation byte must follow a lead),
+ * and the full range check of the AVX2 scan runs only for blocks holding a
+ * lead that can start an overlong, surrogate or four-byte sequence (one
+ * bitshuffle over a 64-bit set of such leads finds them). Every ASCII byte
+ * and two-byte lead indexes the bit planes with 8 bits of its code point
+ * (one VBMI byte permute per 64-byte chunk of the plane that the block
+ * touches), and BITALG's bitshuffle picks the code point's bit out of each
+ * byte into a mask register, so each class count is a popcount. Only
+ * three-byte characters from ranges that have classes are gathered.
+ */
+
+/**
+ * @brief Whether the CPU has the AVX-512 BW, VBMI and BITALG extensions and
+ * BMI2, which the 64-byte UTF-8 scan needs.
+ */
+static int cpu_has_avx512bw(void) {
+    static int has = -1;
+    if (has < 0) {
+        __builtin_cpu_init();
+        has = __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vbmi") &&
+              __builtin_cpu_supports("avx512bitalg") && __builtin_cpu_supports("bmi2") ? 1 : 0;
+    }
+    return has;
+}
+
+// The first n bytes of a 64-byte block, as a load mask.
+#define AVX512_LIVE(n) ((n) >= 64 ? ~0ull : (1ull << (n)) - 1)
+
+/**
+ * @brief Adds the classes of the four-byte characters of valid UTF-8, which
+ * the vector scans leave out of their lookups.
+ */
+static void utf8_count_four_byte(const unsigned char *p, size_t len, PasswordFeatures *scan) {
+    for (size_t i = 0; i < len; i++) {
+        if (p[i] < 0xF0) continue;
+        uint32_t cp;
+        utf8_decode_valid(p + i, &cp);
+        CharInfo ci = unicode_class(cp);
+        scan->counts.upper += ci.cls_bits & CC_UPPER;
+        scan->counts.lower += (ci.cls_bits & CC_LOWER) >> 1;
+        scan->counts.digits += (ci.cls_bits & CC_DIGIT) >> 2;
+        scan->counts.symbols += (ci.cls_bits & CC_SYMBOL) >> 3;
+        scan->counts.digit_sum += ci.digit_value;
+    }
+}
+
+#define EQ_MASK(a, b) _mm512_cmpeq_epi8_mask((a), (b))
+
+/**
+ * @brief AVX-512 UTF-8 scan of everything but the palindrome flag.
+ * @return UTF8_VALID with scan filled in by code point, or UTF8_INVALID with
+ * scan unusable.
+ */
+__attribute__((target("avx512f,avx512bw,avx512vbmi,avx512bitalg,bmi2")))
+PW_ALWAYS_INLINE int scan_utf8_avx512_body(const unsigned char *p, size_t len, PasswordFeatures *scan,
+                                           const int track_repeat) {
+    pthread_once(&unicode_records_once, unicode_records_build);
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i lut1h = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)utf8_byte_1_high));
+    const __m512i lut1l = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)utf8_byte_1_low));
+    const __m512i lut2h = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)utf8_byte_2_high));
+    const __m512i low_nibble = _mm512_set1_epi8(0x0F);
+    const __m512i low3 = _mm512_set1_epi8(7);
+    const __m512i rare_leads = _mm512_set1_epi64((long long)0xFFFF20018A000003ull); // C0 C1 D9 DB DF E0 ED F0-FF
+    const __m512i bit_base = _mm512_set1_epi64(0x3830282018100800); // 8 * (byte index within its qword)
+    const __m512i *planes = (const __m512i *)unicode_planes;
+    const __m512i busy = _mm512_loadu_si512(unicode_busy), busy_hi = _mm512_loadu_si512(unicode_busy + 64);
+    __m512i tot_upper = zero, tot_lower = zero, tot_digit = zero, tot_symbol = zero;
+    __m512i tot_sum = zero, prev = zero, error = zero;
+    __m512i next = _mm512_maskz_loadu_epi8(AVX512_LIVE(len), p);
+    uint64_t four_byte = 0, follow = 0, bad = 0;
+    long upper = 0, lower = 0, digits = 0, symbols = 0;
+    size_t chars = 0;
+    long ones = 0;
+    size_t i = 0;
+
+    scan_begin(scan, len);
+    while (i < len) {
+        __m512i acc_records = zero, acc_sum = zero;
+        for (int b = 0; b < UTF8_FLUSH_BLOCKS && i < len; b++, i += 64) {
+            size_t live = len - i;
+            uint64_t live_mask = AVX512_LIVE(live);
+            __m512i v = next;
+            next = live > 64 ? _mm512_maskz_loadu_epi8(AVX512_LIVE(live - 64), p + i + 64) : zero;
+
+            __m512i carry = _mm512_alignr_epi64(v, prev, 6);
+            __m512i prev1 = _mm512_alignr_epi8(v, carry, 15);
+            uint64_t non_ascii = _mm512_movepi8_mask(v);
+            uint64_t leads = live_mask, lanes = live_mask, repeats = 0;
+            __m512i last = v, index = _mm512_and_si512(_mm512_srli_epi16(v, 3), low_nibble);
+            __m512i upper_or_symbol, lower_or_symbol;
+            uint64_t two_byte_digits = 0;
+            if (non_ascii == 0) {
+                bad |= follow;
+                follow = 0;
+                if (track_repeat) repeats = EQ_MASK(v, prev1);
+                upper_or_symbol = _mm512_permutexvar_epi8(index, _mm512_load_si512(planes));
+                lower_or_symbol = _mm512_permutexvar_epi8(index, _mm512_load_si512(planes + 4));
+            } else {
+                __m512i ahead = _mm512_alignr_epi64(next, v, 2);
+                __m512i next1 = _mm512_alignr_epi8(ahead, v, 1);
+                __m512i next2 = _mm512_alignr_epi8(ahead, v, 2);
+                // Bytes past the end load as zero, so only the ASCII masks need live_mask
+                uint64_t multi = _mm512_mask_test_epi8_mask(non_ascii, v, _mm512_set1_epi8(0x40));
+                uint64_t wide = _mm512_mask_test_epi8_mask(multi, v, _mm512_set1_epi8(0x20));
+                uint64_t four = 0;
+                // Leads that limit their second byte, are never valid or start four
+                // bytes get the full check
+                uint64_t rare = _mm512_mask_bitshuffle_epi64_mask(multi, rare_leads, v);
+                if (rare) {
+                    four = _mm512_cmpge_epu8_mask(v, _mm512_set1_epi8((char)0xF0));
+                    __m512i prev2 = _mm512_alignr_epi8(v, carry, 14), prev3 = _mm512_alignr_epi8(v, carry, 13);
+                    __m512i special = _mm512_ternarylogic_epi32(
+                        _mm512_shuffle_epi8(lut1h, _mm512_and_si512(_mm512_srli_epi16(prev1, 4), low_nibble)),
+                        _mm512_shuffle_epi8(lut1l, _mm512_and_si512(prev1, low_nibble)),
+                        _mm512_shuffle_epi8(lut2h, _mm512_and_si512(_mm512_srli_epi16(v, 4), low_nibble)), 0x80);
+                    __m512i must = _mm512_and_si512(_mm512_or_si512(_mm512_subs_epu8(prev2, _mm512_set1_epi8(0x60)),
+                                                                    _mm512_subs_epu8(prev3, _mm512_set1_epi8(0x70))),
+                                                    _mm512_set1_epi8((char)0x80));
+                    error = _mm512_ternarylogic_epi32(error, must, special, 0xF6);
+                }
+                uint64_t three = wide & ~four, two = multi & ~wide;
+                leads = (~non_ascii & live_mask) | multi;
+                lanes = (~non_ascii & live_mask) | two;
+                // Continuation bytes must be exactly the ones the leads call for
+                bad |= (multi << 1 | wide << 2 | four << 3 | follow) ^ (non_ascii & ~multi);
+                follow = multi >> 63 | wide >> 62 | four >> 61;
+                if (track_repeat) {
+                    // Last bytes first: they rarely match, so the rest is rarely compared
+                    uint64_t two_end = _mm512_mask_cmpeq_epi8_mask(two, next1, prev1);
+                    uint64_t three_end = _mm512_mask_cmpeq_epi8_mask(three, next2, prev1);
+                    repeats = _mm512_mask_cmpeq_epi8_mask(~non_ascii, v, prev1);
+                    if (two_end | three_end) {
+                        __m512i prev2 = _mm512_alignr_epi8(v, carry, 14), prev3 = _mm512_alignr_epi8(v, carry, 13);
+                        repeats |= _mm512_mask_cmpeq_epi8_mask(two_end, v, prev2) |
+                                   _mm512_mask_cmpeq_epi8_mask(_mm512_mask_cmpeq_epi8_mask(three_end, v, prev3), next1, prev2);
+                    }
+                    if (four) {
+                        repeats |= four & EQ_MASK(v, _mm512_alignr_epi8(v, carry, 12)) &
+                                   EQ_MASK(next1, _mm512_alignr_epi8(v, carry, 13)) &
+                                   EQ_MASK(next2, _mm512_alignr_epi8(v, carry, 14)) & EQ_MASK(_mm512_alignr_epi8(ahead, v, 3), prev1);
+                    }
+                }
+
+                // Bits 3-10 of a two-byte character's code point; bits 6-12 for three bytes
+                __m512i pair = _mm512_ternarylogic_epi32(_mm512_set1_epi8((char)0xF8), _mm512_slli_epi16(v, 3),
+                                                         _mm512_srli_epi16(next1, 3), 0xCA);
+                last = _mm512_mask_mov_epi8(v, two, next1);
+                index = _mm512_mask_mov_epi8(index, two, pair);
+                // Each 64 bytes of a plane covers 512 code points; most text needs
+                // the first and one other
+                uint64_t high = _mm512_movepi8_mask(index), odd = _mm512_test_epi8_mask(index, _mm512_set1_epi8(0x40));
+                upper_or_symbol = _mm512_permutexvar_epi8(index, planes[0]);
+                lower_or_symbol = _mm512_permutexvar_epi8(index, planes[4]);
+                if (odd & ~high) {
+                    upper_or_symbol = _mm512_mask_permutexvar_epi8(upper_or_symbol, odd & ~high, index, planes[1]);
+                    lower_or_symbol = _mm512_mask_permutexvar_epi8(lower_or_symbol, odd & ~high, index, planes[5]);
+                }
+                if (high & ~odd) {
+                    upper_or_symbol = _mm512_mask_permutexvar_epi8(upper_or_symbol, high & ~odd, index, planes[2]);
+                    lower_or_symbol = _mm512_mask_permutexvar_epi8(lower_or_symbol, high & ~odd, index, planes[6]);
+                }
+                if (high & odd) {
+                    upper_or_symbol = _mm512_mask_permutexvar_epi8(upper_or_symbol, high & odd, index, planes[3]);
+                    lower_or_symbol = _mm512_mask_permutexvar_epi8(lower_or_symbol, high & odd, index, planes[7]);
+                    // Below 0x800 only ASCII and this last range have digits
+                    if (rare) {
+                        two_byte_digits = _mm512_mask_bitshuffle_epi64_mask(
+                            high & odd, _mm512_permutexvar_epi8(index, planes[11]),
+                            _mm512_ternarylogic_epi32(bit_base, last, low3, 0xF8));
+                    }
+                }
+
+                uint64_t busy_three = _mm512_mask_bitshuffle_epi64_mask(
+                    three, _mm512_permutex2var_epi8(busy, pair, busy_hi),
+                    _mm512_ternarylogic_epi32(bit_base, next1, low3, 0xF8));
+                if (busy_three) {
+                    uint64_t need = busy_three | busy_three >> 1;
+                    __mmask32 odd = (__mmask32)_pext_u64(busy_three, 0xAAAAAAAAAAAAAAAAull);
+                    __m512i cp = _mm512_mask_srli_epi16(v, odd, v, 8);
+                    __m512i c1 = _mm512_mask_blend_epi16(odd, _mm512_srli_epi16(v, 8), next2);
+                    __m512i c2 = _mm512_mask_srli_epi16(next2, odd, next2, 8);
+                    cp = _mm512_or_si512(_mm512_slli_epi16(cp, 12), _mm512_slli_epi16(_mm512_and_si512(c1, _mm512_set1_epi16(0x3F)), 6));
+                    cp = _mm512_ternarylogic_epi32(cp, c2, _mm512_set1_epi16(0x3F), 0xF8);
+                    __m512i even = _mm512_mask_i32gather_epi32(zero, (__mmask16)_pext_u64(need, 0x1111111111111111ull),
+                                                               _mm512_and_si512(cp, _mm512_set1_epi32(0xFFFF)), unicode_records, 4);
+                    __m512i odd_pairs = _mm512_mask_i32gather_epi32(zero, (__mmask16)_pext_u64(need, 0x4444444444444444ull),
+                                                                    _mm512_srli_epi32(cp, 16), unicode_records, 4);
+                    acc_records = _mm512_add_epi32(acc_records, _mm512_add_epi32(even, odd_pairs));
+                }
+                four_byte |= four;
+            }
+            __m512i bits = _mm512_ternarylogic_epi32(bit_base, last, low3, 0xF8);
+            uint64_t us = _mm512_mask_bitshuffle_epi64_mask(lanes, upper_or_symbol, bits);
+            uint64_t ls = _mm512_mask_bitshuffle_epi64_mask(lanes, lower_or_symbol, bits);
+            __mmask64 ds = _mm512_mask_cmplt_epu8_mask(~non_ascii & live_mask, _mm512_sub_epi8(v, _mm512_set1_epi8('0')),
+                                                       _mm512_set1_epi8(10)) | two_byte_digits;
+            int both = __builtin_popcountll(us & ls);
+            upper += __builtin_popcountll(us) - both;
+            lower += __builtin_popcountll(ls) - both;
+            symbols += both;
+            digits += __builtin_popcountll(ds);
+            acc_sum = _mm512_mask_add_epi8(acc_sum, ds, acc_sum, _mm512_and_si512(last, low_nibble));
+
+            int n = __builtin_popcountll(leads);
+            if (track_repeat) {
+                repeats &= live_mask & (i == 0 ? ~1ull : ~0ull);
+                if (repeats) {
+                    uint64_t packed = _pext_u64(repeats, leads);
+                    for (int half = 0; half < n; half += 32, packed >>= 32) {
+                        if ((uint32_t)packed) {
+                            track_runs((uint32_t)packed, n - half < 32 ? n - half : 32, chars + (size_t)half, scan, &ones);
+                        } else {
+                            ones = 0;
+                        }
+                    }
+                } else {
+                    ones = 0;
+                }
+            }
+            chars += (size_t)n;
+            prev = v;
+        }
+        // The digit values join the digit sum in 64-bit lanes
+        __m512i values = _mm512_srli_epi32(acc_records, UREC_VALUE_SHIFT);
+        tot_sum = _mm512_add_epi64(tot_sum, _mm512_add_epi64(_mm512_sad_epu8(acc_sum, zero),
+                                                             _mm512_add_epi64(_mm512_srli_epi64(values, 32),
+                                                                              _mm512_maskz_mov_epi32(0x5555, values))));
+        if (_mm512_test_epi32_mask(acc_records, acc_records)) {
+            const __m512i field = _mm512_set1_epi32(UREC_FIELD_MASK);
+            tot_upper = _mm512_add_epi32(tot_upper, _mm512_and_si512(acc_records, field));
+            tot_lower = _mm512_add_epi32(tot_lower, _mm512_and_si512(_mm512_srli_epi32(acc_records, UREC_FIELD_BITS), field));
+            tot_digit = _mm512_add_epi32(tot_digit, _mm512_and_si512(_mm512_srli_epi32(acc_records, 2 * UREC_FIELD_BITS), field));
+            tot_symbol = _mm512_add_epi32(tot_symbol, _mm512_and_si512(_mm512_srli_epi32(acc_records, 3 * UREC_FIELD_BITS), field));
+        }
+    }
+
+    if ((bad | follow) || _mm512_test_epi8_mask(error, error)) return UTF8_INVALID;
+    scan->length = chars;
+    scan_end_utf8(p, len, scan);
+    if (four_byte) utf8_count_four_byte(p, len, scan);
+    scan->counts.upper += upper;
+    scan->counts.lower += lower;
+    scan->counts.digits += digits;
+    scan->counts.symbols += symbols;
+    __m256i s256 = _mm256_add_epi64(_mm512_castsi512_si256(tot_sum), _mm512_extracti64x4_epi64(tot_sum, 1));
+    __m128i s128 = _mm_add_epi64(_mm256_castsi256_si128(s256), _mm256_extracti128_si256(s256, 1));
+    scan->counts.digit_sum += (int)(_mm_cvtsi128_si64(s128) + _mm_extract_epi64(s128, 1));
+    __m512i any = _mm512_or_si512(_mm512_or_si512(tot_upper, tot_lower), _mm512_or_si512(tot_digit, tot_symbol));
+    if (_mm512_test_epi32_mask(any, any)) {
+        scan->counts.upper += _mm512_reduce_add_epi32(tot_upper);
+        scan->counts.lower += _mm512_reduce_add_epi32(tot_lower);
+        scan->counts.digits += _mm512_reduce_add_epi32(tot_digit);
+        scan->counts.symbols += _mm512_reduce_add_epi32(tot_symbol);
+    }
+    return UTF8_VALID;
+}
+#undef EQ_MASK
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi,avx512bitalg,bmi2")))
+static int scan_utf8_avx512_counts_only(const unsigned char *p, size_t len, PasswordFeatures *scan) {
+    return scan_utf8_avx512_body(p, len, scan, 0);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi,avx512bitalg,bmi2")))
+static int scan_utf8_avx512_repeat(const unsigned char *p, size_t len, PasswordFeatures *scan) {
+    return scan_utf8_avx512_body(p, len, scan, 1);
+}
+#endif // PW_HAVE_X86_SIMD
+
+/**
+ * @brief UTF-8 scan kernel: like the byte kernels, but length, classes,
+ * runs and palindromes are in code points, and invalid input is flagged in
+ * encoding_error (the byte counts of such input are still filled in).
+ */
+PW_ALWAYS_INLINE void scan_utf8_body(const unsigned char *p, size_t len, PasswordFeatures *scan,
+                                     const int track_repeat, const int track_palindrome) {
+    int encoding;
+#ifdef PW_HAVE_X86_SIMD
+    if (detect_scan_isa() == SCAN_ISA_AVX2) {
+        uint64_t head = 0;
+        if (len >= 8) memcpy(&head, p, 8);
+        if (!(head & 0x8080808080808080ull) && avx2_is_ascii(p, len)) {
+            encoding = UTF8_ASCII;
+        } else {
+            if (cpu_has_avx512bw()) {
+                encoding = track_repeat ? scan_utf8_avx512_repeat(p, len, scan) : scan_utf8_avx512_counts_only(p, len, scan);
+            } else {
+                encoding = track_repeat ? scan_utf8_avx2_repeat(p, len, scan) : scan_utf8_avx2_counts_only(p, len, scan);
+            }
+            if (encoding == UTF8_VALID) {
+                if (track_palindrome) scan->is_palindrome = utf8_is_palindrome(p, len);
+                return;
+            }
+        }
+    } else
+#endif
+    {
+        encoding = utf8_check((const char *)p, len);
+    }
+    if (encoding != UTF8_VALID) {
+        // ASCII: one byte per code point, so the byte kernels give the same answer at full speed
+        scan_kernel_table[detect_scan_isa()][track_repeat | track_palindrome << 1](p, len, scan);
+        if (encoding == UTF8_INVALID) scan->encoding_error = (long)utf8_error_offset(p, len);
+        return;
+    }
+
+    uint32_t prev = UINT32_MAX;
+    long run = 0;
+    size_t count = 0;
+    pthread_once(&unicode_cache_once, unicode_cache_build);
+    scan_begin(scan, len);
+    for (size_t i = 0; i < len; count++) {
+        uint32_t cp;
+        CharInfo ci;
+        if (p[i] < 0x80) {
+            cp = p[i++];
+            ci = char_table[cp];
+        } else {
+            i += utf8_decode_valid(p + i, &cp);
+            ci = unicode_class_cached(cp);
+        }
+        scan->counts.upper += ci.cls_bits & CC_UPPER;
+        scan->counts.lower += (ci.cls_bits & CC_LOWER) >> 1;
+        scan->counts.digits += (ci.cls_bits & CC_DIGIT) >> 2;
+        scan->counts.symbols += (ci.cls_bits & CC_SYMBOL) >> 3;
+        scan->counts.digit_sum += ci.digit_value;
+        if (count == 0) scan->first_class = ci.cls_bits;
+        scan->last_class = ci.cls_bits;
+        if (track_repeat) {
+            if (cp == prev) {
+                if (scan->first_repeat < 0) scan->first_repeat = (long)count - 1;
+                if (++run > scan->max_run) scan->max_run = run;
+            } else {
+                run = 1;
+            }
+            prev = cp;
+        }
+    }
+    scan->length = count;
+    if (track_palindrome) scan->is_palindrome = utf8_is_palindrome(p, len);
+}
+
+SCAN_KERNEL_VARIANTS(utf8, )
+
+static const scan_kernel_fn utf8_kernel_table[4] = {
+    scan_utf8_counts_only, scan_utf8_repeat, scan_utf8_palindrome, scan_password_utf8,
+};
+
+/**
+ * @brief Picks the UTF-8 scan kernel that tracks only what a rule set needs.
+ */
+scan_kernel_fn select_scan_kernel_utf8(unsigned rule_set) {
+    int variant = ((rule_set & RULESET_NO_REPEAT) ? 1 : 0) | ((rule_set & RULESET_PALINDROME) ? 2 : 0);
+    return utf8_kernel_table[variant];
+}
+
+/**
+ * @brief Scans a password the way a policy reads it: bytes, or code points in UTF-8 mode.
+ */
+void scan_password_for(const char *password, size_t len, const PasswordRequirements *reqs,
+                       PasswordFeatures *scan) {
+    if (reqs->utf8) {
+        scan_password_utf8((const unsigned char *)password, len, scan);
+    } else {
+        scan_password(password, len, scan);
+    }
+}
+
+/**
+ * @brief Writes the bytes of the character at features->first_repeat, NUL-terminated.
+ */
+static void repeated_char(const char *password, size_t len, const PasswordRequirements *reqs,
+                          const PasswordFeatures *features, char *sequence) {
+    sequence[0] = '\0';
+    if (features->first_repeat < 0) return;
+    if (reqs->utf8 && features->encoding_error < 0) {
+        utf8_char_at((const unsigned char *)password, len, (size_t)features->first_repeat, sequence);
+    } else {
+        sequence[0] = password[features->first_repeat];
+        sequence[1] = '\0';
+    }
+}
+
+// --- Policy Tables ---
+
+/**
+ * @brief Builds a column-wise table from an array of policies.
+ * @param table Output table; release with policy_table_free().
+ * @param policies The policies, e.g. generate_requirements() for rounds 1..N.
+ * @param count Number of policies.
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int policy_table_init(PolicyTable *table, const PasswordRequirements *policies, size_t count) {
+    size_t capacity = (count + POLICY_LANES - 1) / POLICY_LANES * POLICY_LANES;
+    if (capacity == 0) capacity = POLICY_LANES;
+
+    int32_t *cols = aligned_alloc(32, 7 * capacity * sizeof(int32_t));
+    if (cols == NULL) {
+        return -1;
+    }
+    table->count = count;
+    table->capacity = capacity;
+    table->storage = cols;
+    table->min_length       = cols;
+    table->min_uppercase    = cols + capacity;
+    table->min_lowercase    = cols + 2 * capacity;
+    table->min_digits       = cols + 3 * capacity;
+    table->min_symbols      = cols + 4 * capacity;
+    table->rule_set         = cols + 5 * capacity;
+    table->digit_sum_target = cols + 6 * capacity;
+
+    for (size_t i = 0; i < capacity; i++) {
+        if (i >= count) { // Padding: no password is this long
+            table->min_length[i] = INT32_MAX;
+            table->min_uppercase[i] = table->min_lowercase[i] = 0;
+            table->min_digits[i] = table->min_symbols[i] = 0;
+            table->rule_set[i] = 0;
+            table->digit_sum_target[i] = 0;
+            continue;
+        }
+        const PasswordRequirements *r = &policies[i];
+        table->min_length[i] = r->min_length;
+        table->min_uppercase[i] = r->min_uppercase;
+        table->min_lowercase[i] = r->min_lowercase;
+        table->min_digits[i] = r->min_digits;
+        table->min_symbols[i] = r->min_symbols;
+        table->rule_set[i] = (int32_t)policy_rule_set(r);
+        table->digit_sum_target[i] = r->digit_sum_target;
+        // Same belt-and-suspenders rule as evaluate_rules_for(): a target with no digits required
+        if (r->req_digit_sum && r->min_digits == 0 && r->digit_sum_target != 0) {
+            table->digit_sum_target[i] = -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Releases a table built by policy_table_init().
+ */
+void policy_table_free(PolicyTable *table) {
+    free(table->storage);
+    table->storage = NULL;
+    table->count = table->capacity = 0;
+}
+
+/**
+ * @brief Finds every policy in a table that a password satisfies.
+ * Dispatches to the widest compare kernel the CPU supports.
+ * @param table The policies.
+ * @param features Features from scan_password() (full kernel).
+ * @param satisfied Bitmap of (capacity + 63) / 64 words; bit i is set iff policy i is met.
+ * @return Number of satisfied policies.
+ */
+size_t match_policies(const PolicyTable *table, const PasswordFeatures *features, uint64_t *satisfied) {
+    static const policy_match_fn kernels[] = {
+        match_policies_scalar,
+#ifdef PW_HAVE_X86_SIMD
+        match_policies_sse2, match_policies_avx2,
+#endif
+    };
+    if (features->encoding_error >= 0) { // Invalid UTF-8 satisfies nothing
+        memset(satisfied, 0, (table->capacity + 63) / 64 * sizeof(uint64_t));
+        return 0;
+    }
+    return kernels[detect_scan_isa()](table, features, satisfied);
+}
+
+/**
+ * @brief Reduces the pattern rules to the RULESET_* bits this password breaks.
+ * A policy with any of these bits set in its rule_set is not satisfied.
+ */
+static unsigned broken_rule_set(const PasswordFeatures *f) {
+    unsigned broken = 0;
+    if (!(f->first_class & CC_UPPER) || !(f->last_class & CC_SYMBOL)) broken |= RULESET_START_END;
+    if (f->max_run > 1)   broken |= RULESET_NO_REPEAT;
+    if (!f->is_palindrome) broken |= RULESET_PALINDROME;
+    return broken;
+}
+
+static int32_t clamp_feature(size_t v) {
+    return v > INT32_MAX ? INT32_MAX : (int32_t)v;
+}
+
+size_t match_policies_scalar(const PolicyTable *table, const PasswordFeatures *features, uint64_t *satisfied) {
+    const ClassCounts *c = &features->counts;
+    int32_t len = clamp_feature(features->length);
+    unsigned broken = broken_rule_set(features);
+    size_t matched = 0;
+
+    memset(satisfied, 0, (table->capacity + 63) / 64 * sizeof(uint64_t));
+    for (size_t i = 0; i < table->count; i++) {
+        unsigned rules = (unsigned)table->rule_set[i];
+        unsigned bad = broken | (c->digit_sum != table->digit_sum_target[i] ? RULESET_DIGIT_SUM : 0);
+        if (len >= table->min_length[i] &&
+            c->upper >= table->min_uppercase[i] && c->lower >= table->min_lowercase[i] &&
+            c->digits >= table->min_digits[i] && c->symbols >= table->min_symbols[i] &&
+            !(rules & bad)) {
+            satisfied[i / 64] |= (uint64_t)1 << (i % 64);
+            matched++;
+        }
+    }
+    return matched;
+}
+
+#ifdef PW_HAVE_X86_SIMD
+/*
+ * Each lane holds one policy. A lane fails if any minimum exceeds the
+ * broadcast feature (signed compare; thresholds and features are non-negative),
+ * or if its rule_set shares a bit with the rules this password breaks. The
+ * digit-sum bit is added to a lane's broken set only where the sum differs
+ * from that lane's target. movemask of the failure mask gives one bit per policy.
+ */
+size_t match_policies_sse2(const PolicyTable *table, const PasswordFeatures *features, uint64_t *satisfied) {
+    const ClassCounts *c = &features->counts;
+    const __m128i len = _mm_set1_epi32(clamp_feature(features->length));
+    const __m128i upper = _mm_set1_epi32(c->upper), lower = _mm_set1_epi32(c->lower);
+    const __m128i digits = _mm_set1_epi32(c->digits), symbols = _mm_set1_epi32(c->symbols);
+    const __m128i sum = _mm_set1_epi32(c->digit_sum);
+    const __m128i broken = _mm_set1_epi32((int)broken_rule_set(features));
+    const __m128i digit_bit = _mm_set1_epi32(RULESET_DIGIT_SUM);
+    const __m128i zero = _mm_setzero_si128();
+    size_t matched = 0;
+
+    memset(satisfied, 0, (table->capacity + 63) / 64 * sizeof(uint64_t));
+    for (size_t i = 0; i < table->capacity; i += 4) {
+        __m128i bad = _mm_cmpgt_epi32(_mm_load_si128((const __m128i *)(table->min_length + i)), len);
+        bad = _mm_or_si128(bad, _mm_cmpgt_epi32(_mm_load_si128((const __m128i *)(table->min_uppercase + i)), upper));
+        bad = _mm_or_si128(bad, _mm_cmpgt_epi32(_mm_load_si128((const __m128i *)(table->min_lowercase + i)), lower));
+        bad = _mm_or_si128(bad, _mm_cmpgt_epi32(_mm_load_si128((const __m128i *)(table->min_digits + i)), digits));
+        bad = _mm_or_si128(bad, _mm_cmpgt_epi32(_mm_load_si128((const __m128i *)(table->min_symbols + i)), symbols));
+        __m128i sum_ok = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)(table->digit_sum_target + i)), sum);
+        __m128i lane_broken = _mm_or_si128(broken, _mm_andnot_si128(sum_ok, digit_bit));
+        __m128i rules = _mm_and_si128(_mm_load_si128((const __m128i *)(table->rule_set + i)), lane_broken);
+        bad = _mm_or_si128(bad, _mm_cmpgt_epi32(rules, zero));
+
+        uint64_t ok = (uint64_t)(~_mm_movemask_ps(_mm_castsi128_ps(bad)) & 0xF);
+        satisfied[i / 64] |= ok << (i % 64);
+        matched += (size_t)__builtin_popcountll(ok);
+    }
+    return matched;
+}
+
+__attribute__((target("avx2")))
+size_t match_policies_avx2(const PolicyTable *table, const PasswordFeatures *features, uint64_t *satisfied) {
+    const ClassCounts *c = &features->counts;
+    const __m256i len = _mm256_set1_epi32(clamp_feature(features->length));
+    const __m256i upper = _mm256_set1_epi32(c->upper), lower = _mm256_set1_epi32(c->lower);
+    const __m256i digits = _mm256_set1_epi32(c->digits), symbols = _mm256_set1_epi32(c->symbols);
+    const __m256i sum = _mm256_set1_epi32(c->digit_sum);
+    const __m256i broken = _mm256_set1_epi32((int)broken_rule_set(features));
+    const __m256i digit_bit = _mm256_set1_epi32(RULESET_DIGIT_SUM);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t matched = 0;
+
+    memset(satisfied, 0, (table->capacity + 63) / 64 * sizeof(uint64_t));
+    for (size_t i = 0; i < table->capacity; i += 8) {
+        __m256i bad = _mm256_cmpgt_epi32(_mm256_load_si256((const __m256i *)(table->min_length + i)), len);
+        bad = _mm256_or_si256(bad, _mm256_cmpgt_epi32(_mm256_load_si256((const __m256i *)(table->min_uppercase + i)), upper));
+        bad = _mm256_or_si256(bad, _mm256_cmpgt_epi32(_mm256_load_si256((const __m256i *)(table->min_lowercase + i)), lower));
+        bad = _mm256_or_si256(bad, _mm256_cmpgt_epi32(_mm256_load_si256((const __m256i *)(table->min_digits + i)), digits));
+        bad = _mm256_or_si256(bad, _mm256_cmpgt_epi32(_mm256_load_si256((const __m256i *)(table->min_symbols + i)), symbols));
+        __m256i sum_ok = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i *)(table->digit_sum_target + i)), sum);
+        __m256i lane_broken = _mm256_or_si256(broken, _mm256_andnot_si256(sum_ok, digit_bit));
+        __m256i rules = _mm256_and_si256(_mm256_load_si256((const __m256i *)(table->rule_set + i)), lane_broken);
+        bad = _mm256_or_si256(bad, _mm256_cmpgt_epi32(rules, zero));
+
+        uint64_t ok = (uint64_t)(~_mm256_movemask_ps(_mm256_castsi256_ps(bad)) & 0xFF);
+        satisfied[i / 64] |= ok << (i % 64);
+        matched += (size_t)__builtin_popcountll(ok);
+    }
+    return matched;
+}
+#endif // PW_HAVE_X86_SIMD
+
+// --- Wordlist Mode ---
+
+/**
+ * @brief Parses a policy written as comma-separated settings, e.g.
+ * "len=12,upper=2,lower=2,digits=1,symbols=1,start-end,no-repeat,palindrome,digit-sum=20".
+ * Settings not mentioned are off / zero.
+ * @param spec The specification string.
+ * @param reqs Output requirements.
+ * @return 0 on success, -1 on an unknown setting or bad number.
+ */
+int parse_policy_spec(const char *spec, PasswordRequirements *reqs) {
+    static const struct { const char *key; size_t offset; int is_flag; } fields[] = {
+        { "len",        offsetof(PasswordRequirements, min_length), 0 },
+        { "upper",      offsetof(PasswordRequirements, min_uppercase), 0 },
+        { "lower",      offsetof(PasswordRequirements, min_lowercase), 0 },
+        { "digits",     offsetof(PasswordRequirements, min_digits), 0 },
+        { "symbols",    offsetof(PasswordRequirements, min_symbols), 0 },
+        { "start-end",  offsetof(PasswordRequirements, req_start_upper_end_symbol), 1 },
+        { "no-repeat",  offsetof(PasswordRequirements, req_no_consecutive_chars), 1 },
+        { "palindrome", offsetof(PasswordRequirements, req_palindrome), 1 },
+        { "digit-sum",  offsetof(PasswordRequirements, digit_sum_target), 0 },
+        { "utf8",       offsetof(PasswordRequirements, utf8), 1 },
+    };
+    memset(reqs, 0, sizeof(PasswordRequirements));
+
+    while (*spec) {
+        size_t tok_len = strcspn(spec, ",");
+        size_t key_len = strcspn(spec, ",=");
+        const char *value = key_len < tok_len ? spec + key_len + 1 : NULL;
+        size_t f = 0;
+
+        while (f < sizeof(fields) / sizeof(fields[0]) &&
+               !(strlen(fields[f].key) == key_len && strncmp(fields[f].key, spec, key_len) == 0)) {
+            f++;
+        }
+        if (f == sizeof(fields) / sizeof(fields[0]) || fields[f].is_flag != (value == NULL)) {
+            return -1;
+        }
+        int *field = (int *)((char *)reqs + fields[f].offset);
+        if (value) {
+            char *stop;
+            long n = strtol(value, &stop, 10);
+            if (stop != spec + tok_len || stop == value || n < 0 || n > INT32_MAX) {
+                return -1;
+            }
+            *field = (int)n;
+            if (field == &reqs->digit_sum_target) reqs->req_digit_sum = 1;
+        } else {
+            *field = 1;
+        }
+        spec += tok_len;
+        if (*spec == ',') spec++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes a policy in the syntax parse_policy_spec() accepts.
+ * @param reqs The requirements to describe.
+ * @param buf Output buffer.
+ * @param size Size of buf.
+ */
+void format_policy_spec(const PasswordRequirements *reqs, char *buf, size_t size) {
+    int n = snprintf(buf, size, "len=%d,upper=%d,lower=%d,digits=%d,symbols=%d",
+                     reqs->min_length, reqs->min_uppercase, reqs->min_lowercase,
+                     reqs->min_digits, reqs->min_symbols);
+    if (n < 0 || (size_t)n >= size) return;
+    if (reqs->req_start_upper_end_symbol) n += snprintf(buf + n, size - n, ",start-end");
+    if ((size_t)n < size && reqs->req_no_consecutive_chars) n += snprintf(buf + n, size - n, ",no-repeat");
+    if ((size_t)n < size && reqs->req_palindrome) n += snprintf(buf + n, size - n, ",palindrome");
+    if ((size_t)n < size && reqs->req_digit_sum) n += snprintf(buf + n, size - n, ",digit-sum=%d", reqs->digit_sum_target);
+    if ((size_t)n < size && reqs->utf8) snprintf(buf + n, size - n, ",utf8");
+}
+
+/**
+ * @brief Appends bytes to an output buffer, growing it as needed.
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+static int output_append(OutputBuffer *out, const char *data, size_t len) {
+    if (out->len + len > out->cap) {
+        size_t cap = out->cap ? out->cap : 1 << 16;
+        while (cap < out->len + len) cap *= 2;
+        char *grown = realloc(out->data, cap);
+        if (grown == NULL) return -1;
+        out->data = grown;
+        out->cap = cap;
+    }
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+    return 0;
+}
+
+/**
+ * @brief Writes an output buffer to a file descriptor and empties it.
+ * @return 0 on success, -1 on a write error.
+ */
+static int output_flush(OutputBuffer *out, int fd) {
+    size_t done = 0;
+    while (done < out->len) {
+        ssize_t n = write(fd, out->data + done, out->len - done);
+        if (n < 0) return -1;
+        done += (size_t)n;
+    }
+    out->len = 0;
+    return 0;
+}
+
+/**
+ * @brief Validates every newline-terminated line in [begin, end) in place.
+ * A trailing '\r' is stripped; a final line without '\n' is included.
+ * @param policy The compiled policy.
+ * @param begin First byte of the range (start of a line).
+ * @param end One past the last byte of the range.
+ * @param stats Tallies to add to.
+ * @param passing If not NULL, passing lines (with '\n') are appended here.
+ */
+void bulk_validate_range(const CompiledPolicy *policy, const char *begin, const char *end,
+                         BulkStats *stats, OutputBuffer *passing) {
+    policy_validator_fn validate = policy->validate;
+    const char *cur = begin;
+
+    while (cur < end) {
+        const char *nl = memchr(cur, '\n', (size_t)(end - cur));
+        const char *stop = nl ? nl : end;
+        size_t len = (size_t)(stop - cur);
+        if (len > 0 && cur[len - 1] == '\r') len--;
+
+        unsigned v = validate(policy, cur, len);
+        stats->lines++;
+        if (v == 0) {
+            stats->passed++;
+            if (passing && (output_append(passing, cur, len) != 0 || output_append(passing, "\n", 1) != 0)) {
+                passing = NULL; // Out of memory: keep counting, stop collecting
+            }
+        } else {
+            for (unsigned bits = v; bits; bits &= bits - 1) {
+                stats->rule_failures[__builtin_ctz(bits)]++;
+            }
+        }
+        cur = nl ? nl + 1 : end;
+    }
+}
+
+/**
+ * @brief Returns the end of the chunk starting at begin: the first line break
+ * at or after begin + target, or end.
+ */
+static const char *chunk_end(const char *begin, const char *end, size_t target) {
+    if ((size_t)(end - begin) <= target) return end;
+    const char *nl = memchr(begin + target, '\n', (size_t)(end - begin - target));
+    return nl ? nl + 1 : end;
+}
+
+/**
+ * @brief Takes the next chunk from a worker's own deque.
+ * @return 1 with *chunk set, or 0 if the deque is empty.
+ */
+static int chunk_pop(ChunkDeque *dq, size_t *chunk) {
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->next < dq->end) {
+        *chunk = dq->next++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+/**
+ * @brief Steals the back half of another worker's remaining chunks into the
+ * thief's (empty) deque and takes the first of them.
+ * @return 1 with *chunk set, or 0 if every deque is empty.
+ */
+static int chunk_steal(BulkJob *job, int thief, size_t *chunk) {
+    for (int k = 1; k < job->workers; k++) {
+        ChunkDeque *victim = &job->deques[(thief + k) % job->workers];
+        size_t lo = 0, hi = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->next < victim->end) {
+            size_t take = (victim->end - victim->next + 1) / 2;
+            hi = victim->end;
+            lo = hi - take;
+            victim->end = lo;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (lo < hi) {
+            ChunkDeque *own = &job->deques[thief];
+            pthread_mutex_lock(&own->lock);
+            own->next = lo + 1;
+            own->end = hi;
+            pthread_mutex_unlock(&own->lock);
+            *chunk = lo;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Marks a chunk finished and writes out every finished chunk that is
+ * next in file order, so output order matches the input.
+ */
+static void chunk_publish(BulkJob *job, size_t chunk) {
+    pthread_mutex_lock(&job->out_lock);
+    job->done[chunk] = 1;
+    while (job->flushed < job->chunk_count && job->done[job->flushed]) {
+        OutputBuffer *out = &job->outputs[job->flushed];
+        if (!job->out_error && output_flush(out, STDOUT_FILENO) != 0) {
+            job->out_error = 1;
+        }
+        free(out->data);
+        out->data = NULL;
+        job->flushed++;
+    }
+    pthread_mutex_unlock(&job->out_lock);
+}
+
+/**
+ * @brief Worker loop: drains its own deque, then steals until no work is left.
+ */
+static void *bulk_worker_main(void *arg) {
+    BulkWorker *w = arg;
+    BulkJob *job = w->job;
+    size_t chunk;
+
+    while (chunk_pop(&job->deques[w->id], &chunk) || chunk_steal(job, w->id, &chunk)) {
+        bulk_validate_range(job->policy, job->data + job->bounds[chunk], job->data + job->bounds[chunk + 1],
+                            &w->stats, job->outputs ? &job->outputs[chunk] : NULL);
+        if (job->outputs) chunk_publish(job, chunk);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Validates every line of a buffer on a work-stealing thread pool.
+ * The buffer is cut into newline-aligned chunks, dealt out to the workers in
+ * contiguous runs; idle workers steal half of a busy worker's remaining run.
+ * Per-thread counters are summed at the end, and passing lines are written in
+ * input order as soon as all earlier chunks are done.
+ * @param policy The compiled policy.
+ * @param data The buffer (e.g. a mapped file).
+ * @param size Size of the buffer.
+ * @param threads Number of workers (the calling thread is one of them).
+ * @param print_passing If non-zero, passing lines go to stdout.
+ * @param stats Output: merged counters.
+ * @return 0 on success, -1 on an allocation or write failure.
+ */
+int bulk_validate_parallel(const CompiledPolicy *policy, const char *data, size_t size,
+                           int threads, int print_passing, BulkStats *stats) {
+    memset(stats, 0, sizeof(BulkStats));
+    if (size == 0) return 0;
+    if (threads < 1) threads = 1;
+
+    // Chunk size: enough chunks for balancing, but each big enough to amortize the hand-off.
+    size_t target = size / ((size_t)threads * BULK_CHUNKS_PER_THREAD);
+    if (target < BULK_MIN_CHUNK_BYTES) target = BULK_MIN_CHUNK_BYTES;
+    if (target > BULK_CHUNK_BYTES) target = BULK_CHUNK_BYTES;
+
+    size_t max_chunks = size / target + 2;
+    size_t *bounds = malloc((max_chunks + 1) * sizeof(size_t));
+    BulkJob job;
+    BulkWorker *workers = aligned_alloc(64, (size_t)threads * sizeof(BulkWorker));
+    pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+    int status = 0;
+
+    memset(&job, 0, sizeof(job));
+    job.deques = malloc((size_t)threads * sizeof(ChunkDeque));
+    if (bounds == NULL || workers == NULL || tids == NULL || job.deques == NULL) {
+        status = -1;
+        goto done;
+    }
+    bounds[0] = 0;
+    while (bounds[job.chunk_count] < size) {
+        const char *stop = chunk_end(data + bounds[job.chunk_count], data + size, target);
+        bounds[++job.chunk_count] = (size_t)(stop - data);
+    }
+    if (print_passing) {
+        job.outputs = calloc(job.chunk_count, sizeof(OutputBuffer));
+        job.done = calloc(job.chunk_count, 1);
+        if (job.outputs == NULL || job.done == NULL) {
+            status = -1;
+            goto done;
+        }
+    }
+    if ((size_t)threads > job.chunk_count) threads = (int)job.chunk_count;
+
+    job.policy = policy;
+    job.data = data;
+    job.bounds = bounds;
+    job.workers = threads;
+    pthread_mutex_init(&job.out_lock, NULL);
+    for (int t = 0; t < threads; t++) {
+        // Contiguous runs keep each worker streaming through its own part of the file.
+        pthread_mutex_init(&job.deques[t].lock, NULL);
+        job.deques[t].next = job.chunk_count * t / threads;
+        job.deques[t].end = job.chunk_count * (t + 1) / threads;
+        memset(&workers[t], 0, sizeof(BulkWorker));
+        workers[t].job = &job;
+        workers[t].id = t;
+    }
+
+    int started = 1;
+    while (started < threads && pthread_create(&tids[started], NULL, bulk_worker_main, &workers[started]) == 0) {
+        started++;
+    }
+    bulk_worker_main(&workers[0]); // Also steals the shares of threads that failed to start
+    for (int t = 1; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+
+    for (int t = 0; t < threads; t++) {
+        stats->lines += workers[t].stats.lines;
+        stats->passed += workers[t].stats.passed;
+        for (int r = 0; r < RULE_COUNT; r++) {
+            stats->rule_failures[r] += workers[t].stats.rule_failures[r];
+        }
+        pthread_mutex_destroy(&job.deques[t].lock);
+    }
+    pthread_mutex_destroy(&job.out_lock);
+    if (job.out_error) status = -1;
+
+done:
+    free(job.done);
+    free(job.outputs);
+    free(job.deques);
+    free(tids);
+    free(workers);
+    free(bounds);
+    return status;
+}
+
+/**
+ * @brief Resolves the --policy / --round / --seed / --utf8 options shared by the command-line modes.
+ * @param spec The --policy argument, or NULL to use a game round.
+ * @param round The --round argument.
+ * @param seed The --seed argument (0 without it). It picks the round's roll,
+ * seed mod requirement_rolls(round), so a batch from --generate and the
+ * --check of it agree on the digit-sum target.
+ * @param utf8 Non-zero if --utf8 was given (a spec can also say "utf8").
+ * @param reqs Output requirements.
+ * @return 0 on success, -1 (after printing why) if spec is invalid.
+ */
+static int policy_from_args(const char *spec, int round, uint64_t seed, int utf8, PasswordRequirements *reqs) {
+    if (spec) {
+        if (parse_policy_spec(spec, reqs) != 0) {
+            fprintf(stderr, "Invalid policy: %s\n", spec);
+            return -1;
+        }
+    } else {
+        generate_requirements_roll(reqs, round, (int)(seed % (uint64_t)requirement_rolls(round)));
+    }
+    if (utf8) reqs->utf8 = 1;
+    return 0;
+}
+
+/**
+ * @brief One worker per online CPU, at most MAX_THREADS; 1 if sysconf() cannot tell.
+ */
+static long default_thread_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    return cpus < MAX_THREADS ? cpus : MAX_THREADS;
+}
+
+/**
+ * @brief Parses a --threads argument: a positive count, capped at MAX_THREADS.
+ * @param prog argv[0], for the error message.
+ * @return 0 on success, -1 (after printing an error) if arg is not a positive number.
+ */
+static int parse_thread_count(const char *prog, const char *arg, long *threads) {
+    char *end;
+    errno = 0;
+    long n = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || n < 1 || errno == ERANGE) {
+        fprintf(stderr, "%s: --threads needs a positive number, got \"%s\"\n", prog, arg);
+        return -1;
+    }
+    *threads = n < MAX_THREADS ? n : MAX_THREADS;
+    return 0;
+}
+
+/**
+ * @brief Reads fd to end of file into one malloc()ed buffer, for inputs that
+ * cannot be mapped (pipes, terminals, process substitutions).
+ * @param data Receives the buffer (NULL if the input is empty); free() it.
+ * @param size Receives the number of bytes read.
+ * @return 0 on success, -1 on a read or allocation failure (errno is set).
+ */
+static int read_whole_fd(int fd, char **data, size_t *size) {
+    size_t capacity = 0, used = 0;
+    char *buf = NULL;
+    for (;;) {
+        if (used == capacity) {
+            size_t grown = capacity ? capacity * 2 : STREAM_CHUNK_BYTES;
+            char *bigger = realloc(buf, grown);
+            if (bigger == NULL) {
+                free(buf);
+                return -1;
+            }
+            buf = bigger;
+            capacity = grown;
+        }
+        ssize_t n = read(fd, buf + used, capacity - used);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            free(buf);
+            return -1;
+        }
+        if (n == 0) break;
+        used += (size_t)n;
+    }
+    if (used == 0) {
+        free(buf);
+        buf = NULL;
+    }
+    *data = buf;
+    *size = used;
+    return 0;
+}
+
+/**
+ * @brief Implements "pw --check FILE [--round N [--seed S] | --policy SPEC] [--utf8] [--threads N] [--print-passing]".
+ * Memory-maps FILE (pipes and other non-regular files are read into memory
+ * instead), validates every line against the policy without copying it,
+ * using one worker per online CPU unless --threads says otherwise, prints
+ * counts to stderr and, optionally, the passing lines to stdout.
+ * @return Process exit status: 0 on success, 1 on I/O errors, 2 on bad usage.
+ */
+int run_check_mode(int argc, char *argv[]) {
+    const char *path = NULL;
+    const char *spec = NULL;
+    int round = 1;
+    int print_passing = 0;
+    int utf8 = 0;
+    uint64_t seed = 0;
+    long threads = default_thread_count();
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--round") == 0 && i + 1 < argc) {
+            round = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            spec = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            if (parse_thread_count(argv[0], argv[++i], &threads) != 0) return 2;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--print-passing") == 0) {
+            print_passing = 1;
+        } else if (strcmp(argv[i], "--utf8") == 0) {
+            utf8 = 1;
+        } else if (path == NULL && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (path == NULL || round < 1) {
+        fprintf(stderr, "Usage: %s --check FILE [--round N [--seed S] | --policy SPEC] [--utf8] [--threads N] [--print-passing]\n", argv[0]);
+        fprintf(stderr, "  SPEC example: len=12,upper=2,lower=2,digits=1,symbols=1,start-end,no-repeat,palindrome,digit-sum=20,utf8\n");
+        return 2;
+    }
+
+    PasswordRequirements reqs;
+    if (policy_from_args(spec, round, seed, utf8, &reqs) != 0) {
+        return 2;
+    }
+    CompiledPolicy policy;
+    compile_policy(&reqs, &policy);
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    const char *data = NULL;
+    char *copy = NULL; // Pipes and other unmappable inputs are read into memory instead
+    size_t size = (size_t)st.st_size;
+    if (!S_ISREG(st.st_mode)) {
+        if (read_whole_fd(fd, &copy, &size) != 0) {
+            perror(path);
+            close(fd);
+            return 1;
+        }
+        data = copy;
+    } else if (size > 0) {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return 1;
+        }
+        madvise((void *)data, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    BulkStats stats;
+    int status = 0;
+    if (bulk_validate_parallel(&policy, data, size, (int)threads, print_passing, &stats) != 0) {
+        perror("--check");
+        status = 1;
+    }
+    if (copy != NULL) free(copy);
+    else if (size > 0) munmap((void *)data, size);
+
+    char desc[256];
+    format_policy_spec(&reqs, desc, sizeof(desc));
+    fprintf(stderr, "Policy: %s\n", desc);
+    fprintf(stderr, "Lines: %zu  Passed: %zu  Failed: %zu\n", stats.lines, stats.passed, stats.lines - stats.passed);
+    for (int r = 0; r < RULE_COUNT; r++) {
+        if (stats.rule_failures[r]) {
+            fprintf(stderr, "  %-36s %zu\n", rule_names[r], stats.rule_failures[r]);
+        }
+    }
+    return status;
+}
+
+// --- Streaming Validation ---
+
+/**
+ * @brief Starts validating a password that will arrive in pieces.
+ * @param sv The validator; release with stream_validator_free().
+ * @param reqs The requirements (copied).
+ */
+void stream_validator_init(StreamValidator *sv, const PasswordRequirements *reqs) {
+    memset(sv, 0, sizeof(StreamValidator));
+    sv->reqs = *reqs;
+    sv->rule_set = policy_rule_set(reqs);
+    // Palindromes are checked once at the end, never per piece
+    sv->kernel = reqs->utf8 ? select_scan_kernel_utf8(sv->rule_set & RULESET_NO_REPEAT)
+                            : select_scan_kernel_for(sv->rule_set & RULESET_NO_REPEAT);
+    sv->features.first_repeat = -1;
+    sv->features.encoding_error = -1;
+    sv->features.is_palindrome = 1;
+}
+
+/**
+ * @brief Finds a piece's first and last characters and how many times each
+ * repeats at its start and end. Characters are bytes, or code points in
+ * UTF-8 mode (the piece must then be valid UTF-8).
+ */
+static void piece_edges(const StreamValidator *sv, const unsigned char *p, size_t len,
+                        uint32_t *first, size_t *lead, uint32_t *last, size_t *tail) {
+    if (!sv->reqs.utf8) {
+        *first = p[0];
+        *last = p[len - 1];
+        for (*lead = 1; *lead < len && p[*lead] == p[0]; ++*lead) {}
+        for (*tail = 1; *tail < len && p[len - 1 - *tail] == p[len - 1]; ++*tail) {}
+        return;
+    }
+    uint32_t cp;
+    size_t i = utf8_decode_valid(p, first);
+    for (*lead = 1; i < len; ++*lead) {
+        i += utf8_decode_valid(p + i, &cp);
+        if (cp != *first) break;
+    }
+    size_t end = len;
+    for (*tail = 0; end > 0; ++*tail) {
+        size_t start = end - 1;
+        while (start > 0 && (p[start] & 0xC0) == 0x80) start--;
+        utf8_decode_valid(p + start, &cp);
+        if (*tail == 0) *last = cp;
+        else if (cp != *last) break;
+        end = start;
+    }
+}
+
+/**
+ * @brief Adds one piece to the running summary. In UTF-8 mode the piece
+ * holds whole sequences; stream_validator_feed() takes care of that.
+ */
+static int stream_feed_piece(StreamValidator *sv, const unsigned char *p, size_t len) {
+    PasswordFeatures *acc = &sv->features;
+    PasswordFeatures f;
+
+    if (len == 0) return 0;
+    if (sv->rule_set & RULESET_PALINDROME) {
+        if (sv->bytes + len > sv->held_capacity) {
+            size_t cap = sv->held_capacity ? sv->held_capacity : STREAM_CHUNK_BYTES;
+            while (cap < sv->bytes + len) cap *= 2;
+            char *grown = realloc(sv->held, cap);
+            if (grown == NULL) return -1;
+            sv->held = grown;
+            sv->held_capacity = cap;
+        }
+        memcpy(sv->held + sv->bytes, p, len);
+    }
+
+    sv->kernel(p, len, &f);
+    if (f.encoding_error >= 0) {
+        // The verdict is settled; byte counts are kept only so the summary stays filled in
+        if (acc->encoding_error < 0) acc->encoding_error = (long)sv->bytes + f.encoding_error;
+    } else if ((sv->rule_set & RULESET_NO_REPEAT) && acc->encoding_error < 0) {
+        uint32_t first, last;
+        size_t lead, tail;
+        piece_edges(sv, p, len, &first, &lead, &last, &tail);
+        int joined = acc->length > 0 && sv->last == first;
+        long through = joined ? sv->run + (long)lead : (long)lead;
+
+        if (acc->first_repeat < 0) {
+            if (joined) {
+                acc->first_repeat = (long)acc->length - 1;
+                if (sv->reqs.utf8) {
+                    utf8_char_at(p, len, 0, sv->repeated);
+                } else {
+                    sv->repeated[0] = (char)p[0];
+                    sv->repeated[1] = '\0';
+                }
+            } else if (f.first_repeat >= 0) {
+                acc->first_repeat = (long)acc->length + f.first_repeat;
+                repeated_char((const char *)p, len, &sv->reqs, &f, sv->repeated);
+            }
+        }
+        if (f.max_run > acc->max_run) acc->max_run = f.max_run;
+        if (through > acc->max_run) acc->max_run = through;
+        sv->run = lead == f.length ? through : (long)tail;
+        sv->last = last;
+    }
+    if (acc->length == 0) acc->first_class = f.first_class;
+    acc->last_class = f.last_class;
+    acc->counts.upper += f.counts.upper;
+    acc->counts.lower += f.counts.lower;
+    acc->counts.digits += f.counts.digits;
+    acc->counts.symbols += f.counts.symbols;
+    acc->counts.digit_sum += f.counts.digit_sum;
+    acc->length += f.length;
+    sv->bytes += len;
+    return 0;
+}
+
+// Length of the UTF-8 sequence a lead byte (>= 0xC0) starts.
+#define UTF8_LEAD_LENGTH(b) ((b) >= 0xF0 ? 4u : (b) >= 0xE0 ? 3u : 2u)
+
+/**
+ * @brief Feeds the next piece of the password. Pieces may split the password
+ * anywhere, including inside a UTF-8 sequence; counts are summed, and runs of
+ * identical characters are joined across the boundary using the last
+ * character of the previous piece.
+ * @param sv The validator.
+ * @param chunk The next bytes.
+ * @param len Number of bytes.
+ * @return 0 on success, -1 if memory for the palindrome rule could not be allocated.
+ */
+int stream_validator_feed(StreamValidator *sv, const char *chunk, size_t len) {
+    const unsigned char *p = (const unsigned char *)chunk;
+    if (!sv->reqs.utf8) {
+        return stream_feed_piece(sv, p, len);
+    }
+
+    // Finish a sequence the previous piece ended in the middle of
+    if (sv->partial_len > 0) {
+        size_t need = UTF8_LEAD_LENGTH(sv->partial[0]) - sv->partial_len;
+        size_t take = need < len ? need : len;
+        memcpy(sv->partial + sv->partial_len, p, take);
+        sv->partial_len += take;
+        p += take;
+        len -= take;
+        if (take < need) return 0;
+        size_t n = sv->partial_len;
+        sv->partial_len = 0;
+        if (stream_feed_piece(sv, sv->partial, n) != 0) return -1;
+    }
+    // Hold back a sequence this piece ends in the middle of
+    size_t cut = len;
+    for (size_t k = 1; k <= 3 && k <= len; k++) {
+        unsigned char b = p[len - k];
+        if ((b & 0xC0) == 0x80) continue;
+        if (b >= 0xC0 && k < UTF8_LEAD_LENGTH(b)) cut = len - k;
+        break;
+    }
+    if (stream_feed_piece(sv, p, cut) != 0) return -1;
+    memcpy(sv->partial, p + cut, len - cut);
+    sv->partial_len = len - cut;
+    return 0;
+}
+
+/**
+ * @brief Checks everything fed so far against the requirements, like check_password().
+ * More pieces may still be fed afterwards.
+ * @param sv The validator.
+ * @param result Receives the first violated rule, counts and offending position.
+ * @return The RULE_* bit that failed, or 0 if the password is valid.
+ */
+unsigned stream_validator_finish(StreamValidator *sv, ValidationResult *result) {
+    PasswordFeatures f = sv->features;
+    if (sv->partial_len > 0 && f.encoding_error < 0) {
+        f.encoding_error = (long)sv->bytes; // Ends inside a sequence
+    }
+    if ((sv->rule_set & RULESET_PALINDROME) && f.encoding_error < 0) {
+        f.is_palindrome = sv->reqs.utf8 ? utf8_is_palindrome((const unsigned char *)sv->held, sv->bytes)
+                                        : is_palindrome_n(sv->held, sv->bytes);
+    }
+    return describe_first_violation(&f, check_features(&f, &sv->reqs), sv->repeated, result);
+}
+
+/**
+ * @brief Releases a validator's palindrome buffer.
+ */
+void stream_validator_free(StreamValidator *sv) {
+    free(sv->held);
+    sv->held = NULL;
+    sv->held_capacity = 0;
+}
+
+/**
+ * @brief Implements "pw --validate [--round N [--seed S] | --policy SPEC] [--utf8]": validates
+ * all of stdin as one password, of any length, reading it in fixed-size pieces.
+ * One trailing newline ("\n" or "\r\n") is not part of the password.
+ * @return Process exit status: 0 if valid, 1 if not or on a read error, 2 on bad usage.
+ */
+int run_validate_mode(int argc, char *argv[]) {
+    const char *spec = NULL;
+    int round = 1;
+    int utf8 = 0;
+    uint64_t seed = 0;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--round") == 0 && i + 1 < argc) {
+            round = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            spec = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--utf8") == 0) {
+            utf8 = 1;
+        } else {
+            round = 0;
+            break;
+        }
+    }
+    if (round < 1) {
+        fprintf(stderr, "Usage: %s --validate [--round N [--seed S] | --policy SPEC] [--utf8] < SECRET\n", argv[0]);
+        return 2;
+    }
+    PasswordRequirements reqs;
+    if (policy_from_args(spec, round, seed, utf8, &reqs) != 0) {
+        return 2;
+    }
+    char desc[256];
+    format_policy_spec(&reqs, desc, sizeof(desc));
+    fprintf(stderr, "Policy: %s\n", desc);
+
+    // Up to two bytes are held back each time, in case they are the final "\r\n"
+    char *buf = malloc(STREAM_CHUNK_BYTES + 2);
+    StreamValidator sv;
+    size_t pending = 0;
+    int status = 0;
+
+    if (buf == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    stream_validator_init(&sv, &reqs);
+    for (;;) {
+        ssize_t n = read(STDIN_FILENO, buf + pending, STREAM_CHUNK_BYTES);
+        if (n < 0) {
+            perror("read");
+            status = 1;
+            break;
+        }
+        if (n == 0) break;
+        pending += (size_t)n;
+        size_t keep = pending < 2 ? pending : 2;
+        if (stream_validator_feed(&sv, buf, pending - keep) != 0) {
+            perror("realloc");
+            status = 1;
+            break;
+        }
+        memmove(buf, buf + pending - keep, keep);
+        pending = keep;
+    }
+    if (status == 0) {
+        if (pending > 0 && buf[pending - 1] == '\n') {
+            pending--;
+            if (pending > 0 && buf[pending - 1] == '\r') pending--;
+        }
+        if (stream_validator_feed(&sv, buf, pending) != 0) {
+            perror("realloc");
+            status = 1;
+        }
+    }
+    if (status == 0) {
+        ValidationResult result;
+        if (stream_validator_finish(&sv, &result) == 0) {
+            printf("Valid (%zu %s).\n", result.length, reqs.utf8 ? "characters" : "bytes");
+        } else {
+            report_validation(stdout, &reqs, &result);
+            status = 1;
+        }
+    }
+    stream_validator_free(&sv);
+    free(buf);
+    return status;
+}
+
+// --- Incremental Validation ---
+
+#define LIVE_INVALID    UINT32_MAX
+
+/**
+ * @brief Sets a character's code point and class from its bytes.
+ */
+static void live_classify(LiveChar *c, int utf8) {
+    unsigned char lead = c->seq[0];
+    uint32_t cp;
+    if (!utf8 || (lead < 0x80 && c->nbytes == 1)) {
+        c->cp = lead;
+        c->info = char_table[lead];
+    } else if (lead >= 0xC0 && c->nbytes == UTF8_LEAD_LENGTH(lead) &&
+               utf8_sequence(c->seq, c->nbytes, &cp) == c->nbytes) {
+        c->cp = cp;
+        c->info = unicode_class_cached(cp);
+    } else {
+        c->cp = LIVE_INVALID; // Malformed, or still being typed
+        c->info = (CharInfo){ 0, 0 };
+    }
+}
+
+/**
+ * @brief Byte offset where a decoder first fails inside a malformed character:
+ * after a well-formed prefix (ASCII or a complete sequence) followed by stray
+ * continuation bytes, otherwise at its lead byte.
+ */
+static size_t live_error_offset(const LiveChar *c) {
+    unsigned char lead = c->seq[0];
+    uint32_t cp;
+    if (lead < 0x80) return c->offset + 1;
+    size_t n = UTF8_LEAD_LENGTH(lead);
+    if (lead >= 0xC0 && c->nbytes > n && utf8_sequence(c->seq, n, &cp) == n) return c->offset + n;
+    return c->offset;
+}
+
+/*
+ * The palindromic tree has one node per distinct palindrome in the input, so
+ * at most one more per character: appending c turns the longest palindrome
+ * ending at the old last character that is preceded by c into the longest
+ * one ending at c. Walking suffix links to find it is amortized O(1), which
+ * backspace breaks (type "aaaa...a", then "b" and backspace over and over), so
+ * quick links skip every link preceded by the same character as the first,
+ * for O(log n) per character. Backspace removes the node its character added,
+ * always the newest one. Suffix palindromes' lengths form O(log n) arithmetic
+ * progressions; series links jump from one to the next.
+ */
+
+/**
+ * @brief Hashes a tree edge: the child of parent that adds cp at both ends.
+ */
+static size_t live_pal_hash(const IncrementalValidator *iv, int parent, uint32_t cp) {
+    uint64_t key = ((uint64_t)(uint32_t)parent << 32 | cp) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(key >> 32) & (iv->pal_slot_count - 1);
+}
+
+/**
+ * @brief The slot holding edge (parent, cp), or the free slot where it would go.
+ */
+static size_t live_pal_slot(const IncrementalValidator *iv, int parent, uint32_t cp) {
+    size_t i = live_pal_hash(iv, parent, cp);
+    for (;;) {
+        int node = iv->pal_slots[i];
+        if (node == 0 || (iv->pals[node].parent == parent && iv->pals[node].cp == cp)) return i;
+        i = (i + 1) & (iv->pal_slot_count - 1);
+    }
+}
+
+/**
+ * @brief Makes room for one more node (creating the two roots first).
+ * Nodes are re-inserted in creation order, so the newest one can always be
+ * deleted by emptying its slot: nothing inserted before it probed past it.
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+static int live_pal_reserve(IncrementalValidator *iv) {
+    if (iv->pal_count + 2 > iv->pal_capacity) {
+        size_t capacity = iv->pal_capacity ? iv->pal_capacity * 2 : INPUT_INITIAL_CAPACITY;
+        LivePalindrome *grown = realloc(iv->pals, capacity * sizeof(LivePalindrome));
+        if (grown == NULL) return -1;
+        iv->pals = grown;
+        iv->pal_capacity = capacity;
+    }
+    if (iv->pal_count == 0) {
+        iv->pals[0] = (LivePalindrome){ .len = -1, .parent = -1, .link = 0, .quick = 0, .series = 0 };
+        iv->pals[1] = (LivePalindrome){ .len = 0, .parent = -1, .link = 0, .quick = 0, .series = 0 };
+        iv->pal_count = 2;
+    }
+    if (2 * (iv->pal_count + 1) > iv->pal_slot_count) {
+        size_t count = iv->pal_slot_count ? iv->pal_slot_count * 2 : 2 * INPUT_INITIAL_CAPACITY;
+        int *slots = calloc(count, sizeof(int));
+        if (slots == NULL) return -1;
+        free(iv->pal_slots);
+        iv->pal_slots = slots;
+        iv->pal_slot_count = count;
+        for (size_t node = 2; node < iv->pal_count; node++) {
+            iv->pal_slots[live_pal_slot(iv, iv->pals[node].parent, iv->pals[node].cp)] = (int)node;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Whether suffix palindrome w of the first i characters is preceded by cp
+ * (always true for the length -1 root).
+ */
+static inline int live_pal_preceded(const IncrementalValidator *iv, int w, size_t i, uint32_t cp) {
+    int len = iv->pals[w].len;
+    return len < 0 || ((size_t)len < i && iv->chars[i - 1 - (size_t)len].cp == cp);
+}
+
+/**
+ * @brief The longest palindrome on w's suffix-link chain that is preceded by
+ * cp in the first i characters (w is a suffix palindrome of them).
+ */
+static int live_pal_match(const IncrementalValidator *iv, int w, size_t i, uint32_t cp) {
+    for (;;) {
+        if (live_pal_preceded(iv, w, i, cp)) return w;
+        if (live_pal_preceded(iv, iv->pals[w].link, i, cp)) return iv->pals[w].link;
+        w = iv->pals[w].quick; // Everything in between is preceded by link's character, not cp
+    }
+}
+
+/**
+ * @brief Records the longest palindrome ending at character k, adding it to
+ * the tree if it is new. live_pal_reserve() must have been called.
+ */
+static void live_pal_push(IncrementalValidator *iv, size_t k) {
+    LiveChar *c = &iv->chars[k];
+    int x = live_pal_match(iv, k > 0 ? iv->chars[k - 1].suffix_pal : 1, k, c->cp);
+    size_t slot = live_pal_slot(iv, x, c->cp);
+    int y = iv->pal_slots[slot];
+
+    c->new_pal = y == 0;
+    if (y == 0) {
+        y = (int)iv->pal_count++;
+        LivePalindrome *node = &iv->pals[y];
+        node->len = iv->pals[x].len + 2;
+        node->parent = x;
+        node->cp = c->cp;
+        node->link = node->len == 1 ? 1
+                   : iv->pal_slots[live_pal_slot(iv, live_pal_match(iv, iv->pals[x].link, k, c->cp), c->cp)];
+        const LivePalindrome *link = &iv->pals[node->link];
+        if (link->len <= 0) {
+            node->quick = 0;
+        } else {
+            // Below link, "preceded by" means the same inside this palindrome as inside link
+            int below = link->link;
+            node->quick = iv->chars[k - (size_t)iv->pals[below].len].cp != iv->chars[k - (size_t)link->len].cp
+                        ? below : link->quick;
+        }
+        node->diff = node->len - link->len;
+        node->series = node->diff == link->diff ? link->series : node->link;
+        iv->pal_slots[slot] = y;
+    }
+    c->suffix_pal = y;
+}
+
+/**
+ * @brief Removes the newest node; the inverse of the addition in live_pal_push().
+ */
+static void live_pal_drop(IncrementalValidator *iv) {
+    const LivePalindrome *node = &iv->pals[--iv->pal_count];
+    iv->pal_slots[live_pal_slot(iv, node->parent, node->cp)] = 0;
+}
+
+/**
+ * @brief Whether the input ends in a palindrome of lo to hi characters (lo >= 1),
+ * checking one arithmetic progression of suffix palindromes per series link.
+ */
+static int live_pal_suffix_between(const IncrementalValidator *iv, size_t lo, size_t hi) {
+    if (iv->count == 0) return 0;
+    for (int v = iv->chars[iv->count - 1].suffix_pal; iv->pals[v].len > 0; v = iv->pals[v].series) {
+        size_t top = (size_t)iv->pals[v].len, d = (size_t)iv->pals[v].diff;
+        size_t bottom = (size_t)iv->pals[iv->pals[v].series].len + d; // Lengths bottom, bottom + d, ..., top
+        size_t first = lo <= bottom ? bottom : bottom + (lo - bottom + d - 1) / d * d;
+        if (first <= top && first <= hi) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Adds the contribution of the character at index iv->count.
+ */
+static void live_add_top(IncrementalValidator *iv) {
+    size_t k = iv->count;
+    LiveChar *c = &iv->chars[k];
+
+    c->before = iv->counts;
+    iv->counts.upper += c->info.cls_bits & CC_UPPER;
+    iv->counts.lower += (c->info.cls_bits & CC_LOWER) >> 1;
+    iv->counts.digits += (c->info.cls_bits & CC_DIGIT) >> 2;
+    iv->counts.symbols += (c->info.cls_bits & CC_SYMBOL) >> 3;
+    iv->counts.digit_sum += c->info.digit_value;
+    if (c->cp == LIVE_INVALID) {
+        iv->invalid++;
+        if (iv->first_invalid < 0) iv->first_invalid = (long)k;
+    } else if (k > 0 && iv->chars[k - 1].cp == c->cp) {
+        iv->repeat_pairs++;
+        if (iv->first_repeat < 0) iv->first_repeat = (long)k - 1;
+    }
+    if (iv->reqs.req_palindrome) live_pal_push(iv, k);
+    iv->count++;
+}
+
+/**
+ * @brief Removes the contribution of the last character; the inverse of live_add_top().
+ */
+static void live_remove_top(IncrementalValidator *iv) {
+    size_t k = --iv->count;
+    const LiveChar *c = &iv->chars[k];
+
+    if (iv->reqs.req_palindrome && c->new_pal) live_pal_drop(iv);
+    if (c->cp == LIVE_INVALID) {
+        iv->invalid--;
+        if (iv->first_invalid == (long)k) iv->first_invalid = -1;
+    } else if (k > 0 && iv->chars[k - 1].cp == c->cp) {
+        iv->repeat_pairs--;
+        if (iv->first_repeat == (long)k - 1) iv->first_repeat = -1; // It was the only pair
+    }
+    iv->counts.upper -= c->info.cls_bits & CC_UPPER;
+    iv->counts.lower -= (c->info.cls_bits & CC_LOWER) >> 1;
+    iv->counts.digits -= (c->info.cls_bits & CC_DIGIT) >> 2;
+    iv->counts.symbols -= (c->info.cls_bits & CC_SYMBOL) >> 3;
+    iv->counts.digit_sum -= c->info.digit_value;
+}
+
+/**
+ * @brief Starts an empty incremental validator.
+ * @param iv The validator to initialize.
+ * @param reqs The requirements; copied, and reqs->utf8 selects character handling.
+ */
+void incremental_validator_init(IncrementalValidator *iv, const PasswordRequirements *reqs) {
+    memset(iv, 0, sizeof(*iv));
+    iv->reqs = *reqs;
+    iv->first_repeat = -1;
+    iv->first_invalid = -1;
+    if (reqs->utf8) pthread_once(&unicode_cache_once, unicode_cache_build);
+}
+
+/**
+ * @brief Appends one typed byte in O(1) (O(log n) under the palindrome rule).
+ * In UTF-8 mode a continuation byte extends the last character instead of
+ * starting a new one.
+ * @param iv The validator.
+ * @param byte The byte appended to the password.
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int incremental_validator_push(IncrementalValidator *iv, unsigned char byte) {
+    if (iv->reqs.req_palindrome && live_pal_reserve(iv) != 0) return -1;
+    if (iv->reqs.utf8 && iv->count > 0 && (byte & 0xC0) == 0x80) {
+        live_remove_top(iv);
+        LiveChar *c = &iv->chars[iv->count];
+        if (c->nbytes < sizeof(c->seq)) c->seq[c->nbytes] = byte;
+        c->nbytes++;
+        live_classify(c, 1);
+        live_add_top(iv);
+        iv->bytes++;
+        return 0;
+    }
+    if (iv->count == iv->capacity) {
+        size_t capacity = iv->capacity ? iv->capacity * 2 : INPUT_INITIAL_CAPACITY;
+        LiveChar *grown = realloc(iv->chars, capacity * sizeof(LiveChar));
+        if (grown == NULL) return -1;
+        iv->chars = grown;
+        iv->capacity = capacity;
+    }
+    LiveChar *c = &iv->chars[iv->count];
+    c->seq[0] = byte;
+    c->nbytes = 1;
+    c->offset = iv->bytes;
+    live_classify(c, iv->reqs.utf8);
+    live_add_top(iv);
+    iv->bytes++;
+    return 0;
+}
+
+/**
+ * @brief Deletes the last character in O(1), as backspace does in get_hidden_input().
+ */
+void incremental_validator_pop(IncrementalValidator *iv) {
+    if (iv->count == 0) return;
+    live_remove_top(iv);
+    iv->bytes -= iv->chars[iv->count].nbytes;
+}
+
+/**
+ * @brief Palindrome test in O(1): the longest palindrome ending at the last
+ * character is the whole input. Palindrome rule only.
+ */
+static int live_is_palindrome(const IncrementalValidator *iv) {
+    return iv->count == 0 || (size_t)iv->pals[iv->chars[iv->count - 1].suffix_pal].len == iv->count;
+}
+
+/**
+ * @brief Summarizes the password typed so far for check_features(). Lengths
+ * are in characters; max_run only tells whether a repeated pair exists (0, 1 or 2).
+ */
+void incremental_validator_features(const IncrementalValidator *iv, PasswordFeatures *features) {
+    features->length = iv->count;
+    features->counts = iv->counts;
+    features->first_repeat = iv->first_repeat;
+    features->max_run = iv->repeat_pairs > 0 ? 2 : iv->count > 0;
+    features->is_palindrome = iv->reqs.req_palindrome ? live_is_palindrome(iv) : 0;
+    features->first_class = iv->count > 0 ? iv->chars[0].info.cls_bits : 0;
+    features->last_class = iv->count > 0 ? iv->chars[iv->count - 1].info.cls_bits : 0;
+    features->encoding_error = iv->first_invalid >= 0 ? (long)live_error_offset(&iv->chars[iv->first_invalid]) : -1;
+}
+
+/**
+ * @brief Returns every rule the password typed so far violates.
+ */
+unsigned incremental_validator_violations(const IncrementalValidator *iv) {
+    PasswordFeatures features;
+    incremental_validator_features(iv, &features);
+    return check_features(&features, &iv->reqs);
+}
+
+/**
+ * @brief Checks the password typed so far, like check_password().
+ * @param iv The validator.
+ * @param result Receives the first violated rule, counts and offending position.
+ * @return The RULE_* bit that failed, or 0 if the password is valid.
+ */
+unsigned incremental_validator_check(const IncrementalValidator *iv, ValidationResult *result) {
+    PasswordFeatures features;
+    char repeated[5] = "";
+    incremental_validator_features(iv, &features);
+    if (iv->first_repeat >= 0) {
+        const LiveChar *c = &iv->chars[iv->first_repeat];
+        memcpy(repeated, c->seq, c->nbytes);
+        repeated[c->nbytes] = '\0';
+    }
+    return describe_first_violation(&features, check_features(&features, &iv->reqs), repeated, result);
+}
+
+/**
+ * @brief Releases a validator's character stack and palindromic tree.
+ */
+void incremental_validator_free(IncrementalValidator *iv) {
+    free(iv->chars);
+    free(iv->pals);
+    free(iv->pal_slots);
+    iv->chars = NULL;
+    iv->pals = NULL;
+    iv->pal_slots = NULL;
+    iv->count = iv->capacity = 0;
+    iv->pal_count = iv->pal_capacity = iv->pal_slot_count = 0;
+}
+
+/**
+ * @brief The first s in [lo, hi) whose tallies before character s reach need
+ * in every field, or hi. Every field only grows with s.
+ */
+static size_t live_first_reaching(const IncrementalValidator *iv, size_t lo, size_t hi, const ClassCounts *need) {
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const ClassCounts *b = &iv->chars[mid].before;
+        if (b->upper >= need->upper && b->lower >= need->lower && b->digits >= need->digits &&
+            b->symbols >= need->symbols && b->digit_sum >= need->digit_sum) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief folded_completion_fits() for the password typed so far, in O(log n).
+ * The s whose completions meet the minimums, the digit sum and the length
+ * bounds form one range, found by binary search; the tree then tells whether
+ * the last p - s characters are a palindrome for one of them. (Under
+ * no-repeat the prefix has no repeated pair here, so the fold never makes one.)
+ */
+static int live_folded_fits(const IncrementalValidator *iv, const PasswordRequirements *reqs,
+                            size_t n_lo, size_t n_hi) {
+    size_t p = iv->count;
+    const ClassCounts *c = &iv->counts;
+    size_t lo = n_lo - p;                      // The caller guarantees p <= n_lo <= n_hi
+    size_t end = n_hi - p < p ? n_hi - p + 1 : p;
+    ClassCounts need = { // Non-positive where the prefix alone suffices
+        reqs->min_uppercase - c->upper, reqs->min_lowercase - c->lower, reqs->min_digits - c->digits,
+        reqs->min_symbols - c->symbols, reqs->req_digit_sum ? reqs->digit_sum_target - c->digit_sum : 0,
+    };
+    if (reqs->req_digit_sum && need.digit_sum < 0) return 0;
+    lo = live_first_reaching(iv, lo, end, &need);
+    if (reqs->req_digit_sum) {
+        ClassCounts past = { 0, 0, 0, 0, reqs->digit_sum_target - c->digit_sum + 1 };
+        end = live_first_reaching(iv, lo, end, &past);
+    }
+    return lo < end && live_pal_suffix_between(iv, p - (end - 1), p - lo);
+}
+
+/**
+ * @brief Runs check_prefix() on the password typed so far. O(1), or O(log n)
+ * under the palindrome rule.
+ * @param iv The validator.
+ * @param max_length Length budget in characters, or SIZE_MAX for none.
+ * @return 0 if the input can still be completed, otherwise the RULE_* bit that rules it out.
+ */
+unsigned incremental_validator_prefix_check(const IncrementalValidator *iv, size_t max_length) {
+    PasswordFeatures features;
+    incremental_validator_features(iv, &features);
+    return prefix_dead_rule(&features, iv->count > 0 ? iv->chars[iv->count - 1].cp : 0, NULL, iv,
+                            &iv->reqs, max_length);
+}
+
+// --- Prefix Feasibility ---
+
+/*
+ * check_prefix() decides whether a partial password can still be completed,
+ * within a length budget and using printable ASCII, so that every rule holds.
+ *
+ * Without the palindrome rule, a longer completion is never worse (a fresh
+ * letter can always be slipped in before the last character), so only the
+ * longest one the budget allows is examined. With it, the password is either
+ * the prefix folded onto one of its own palindromic suffixes (found with
+ * Manacher's algorithm), or prefix + a middle palindrome + the reversed
+ * prefix, where again the longest middle of each parity is the one to try.
+ *
+ * Digits are the only characters a rule pins down: a sum of 27 in three
+ * digits means "999". Under no-repeat, each digit value is therefore capped
+ * at the number of pairwise non-adjacent free slots it could occupy.
+ */
+
+#define PREFIX_ROOM_LIMIT ((size_t)1 << 40) // More free slots than any int-sized requirement can use
+
+/**
+ * @brief Sum of the k largest (or smallest) digits when value v may be used at most cap[v] times.
+ */
+static uint64_t digit_extreme_sum(size_t k, const size_t cap[10], int largest) {
+    uint64_t sum = 0;
+    for (int i = 0; i < 10 && k > 0; i++) {
+        int v = largest ? 9 - i : i;
+        size_t take = cap[v] < k ? cap[v] : k;
+        sum += (uint64_t)v * take;
+        k -= take;
+    }
+    return sum;
+}
+
+/**
+ * @brief Decides whether some k in [k_lo, k_hi] digits, value v used at most
+ * cap[v] times, add up to exactly sum. The smallest and largest reachable sums
+ * both grow with k, so only the smallest k whose largest sum reaches the
+ * target needs testing.
+ */
+static int digit_sum_fits(size_t k_lo, size_t k_hi, long sum, const size_t cap[10]) {
+    size_t total = 0;
+    for (int v = 0; v < 10; v++) total += cap[v];
+    if (k_hi > total) k_hi = total;
+    if (sum < 0 || k_lo > k_hi) return 0;
+    if (k_hi <= 2) {
+        // Runs this short can forbid a value outright, leaving gaps between the extremes
+        for (size_t k = k_lo; k <= k_hi; k++) {
+            if (k == 0 && sum == 0) return 1;
+            if (k == 1 && sum <= 9 && cap[sum] >= 1) return 1;
+            for (long a = 0; k == 2 && a <= sum / 2; a++) {
+                long b = sum - a;
+                if (b <= 9 && (a == b ? cap[a] >= 2 : cap[a] >= 1 && cap[b] >= 1)) return 1;
+            }
+        }
+        return 0;
+    }
+    if (digit_extreme_sum(k_hi, cap, 1) < (uint64_t)sum) return 0;
+    while (k_lo < k_hi) {
+        size_t mid = k_lo + (k_hi - k_lo) / 2;
+        if (digit_extreme_sum(mid, cap, 1) >= (uint64_t)sum) {
+            k_hi = mid;
+        } else {
+            k_lo = mid + 1;
+        }
+    }
+    return digit_extreme_sum(k_lo, cap, 0) <= (uint64_t)sum;
+}
+
+/**
+ * @brief Caps each digit value for a run of free slots. Under no-repeat a value
+ * fits in every other slot, and may be barred from the first slot (it equals
+ * the character before the run) or the last (it equals the one after).
+ * @param before, after Digit values next to the run, or -1.
+ */
+static void digit_caps(size_t cap[10], size_t slots, int no_repeat, int before, int after) {
+    for (int v = 0; v < 10; v++) {
+        size_t barred = no_repeat ? (size_t)(v == before) + (size_t)(v == after) : 0;
+        if (!no_repeat) {
+            cap[v] = slots;
+        } else {
+            cap[v] = slots > barred ? (slots - barred + 1) / 2 : 0;
+        }
+    }
+}
+
+static inline size_t need_of(int required, int have) {
+    return required > have ? (size_t)(required - have) : 0;
+}
+
+/**
+ * @brief Completion check without the palindrome rule: s >= 1 characters appended.
+ * @param last_digit Value of the prefix's last character if it is an ASCII digit, else -1.
+ */
+static unsigned completion_dead_rule(const PasswordFeatures *f, int last_digit,
+                                     const PasswordRequirements *reqs, size_t s) {
+    const ClassCounts *c = &f->counts;
+    size_t opens = reqs->req_start_upper_end_symbol && f->length == 0; // Completion supplies the uppercase start
+    size_t closes = reqs->req_start_upper_end_symbol;                  // ...and the symbol at the end
+    size_t upper = need_of(reqs->min_uppercase, c->upper);
+    size_t lower = need_of(reqs->min_lowercase, c->lower);
+    size_t digits = need_of(reqs->min_digits, c->digits);
+    size_t symbols = need_of(reqs->min_symbols, c->symbols);
+    if (upper < opens) upper = opens;
+    if (symbols < closes) symbols = closes;
+
+    if (upper + lower + digits + symbols > s) return RULE_MIN_LENGTH;
+    if (!reqs->req_digit_sum) return 0;
+
+    size_t slots = s - opens - closes;
+    size_t k_hi = slots - (upper - opens) - lower - (symbols - closes);
+    long sum = (long)reqs->digit_sum_target - c->digit_sum;
+    size_t cap[10];
+    digit_caps(cap, slots, reqs->req_no_consecutive_chars, opens ? -1 : last_digit, -1);
+    if (digit_sum_fits(digits, k_hi, sum, cap)) return 0;
+    digit_caps(cap, slots, 0, -1, -1);
+    return digit_sum_fits(digits, k_hi, sum, cap) ? RULE_NO_CONSECUTIVE : RULE_DIGIT_SUM;
+}
+
+/**
+ * @brief Palindrome check for passwords prefix + M + reversed prefix, where
+ * the middle palindrome M has m characters, m in [m_lo, m_hi]. Characters
+ * outside M's centre count twice.
+ */
+static int mirrored_completion_fits(const PasswordFeatures *f, int last_digit,
+                                    const PasswordRequirements *reqs, size_t m_lo, size_t m_hi) {
+    const ClassCounts *c = &f->counts;
+    int no_repeat = reqs->req_no_consecutive_chars;
+    long sum = (long)reqs->digit_sum_target - 2L * c->digit_sum;
+    int before = f->length > 0 ? last_digit : -1;
+
+    if (m_hi > PREFIX_ROOM_LIMIT) m_hi = PREFIX_ROOM_LIMIT;
+    for (size_t centre = 0; centre <= 1; centre++) {
+        if (m_hi < centre) continue;
+        size_t m = (m_hi % 2 == centre) ? m_hi : m_hi - 1;
+        if (m < m_lo) continue;
+        if (no_repeat && !centre && (f->length > 0 || m > 0)) continue; // The two middle characters would match
+        size_t pairs = m / 2;
+
+        // Centre options: 0-2 count towards upper/lower/symbols, 3-12 are the digits 0-9
+        for (int option = centre ? 0 : -1; option < (centre ? 13 : 0); option++) {
+            long need[4] = {
+                (long)reqs->min_uppercase - 2L * c->upper, (long)reqs->min_lowercase - 2L * c->lower,
+                (long)reqs->min_symbols - 2L * c->symbols, (long)reqs->min_digits - 2L * c->digits,
+            };
+            int centre_digit = option >= 3 ? option - 3 : -1;
+            long rest = sum;
+            if (option >= 0) need[option < 3 ? option : 3]--;
+            if (centre_digit >= 0) {
+                rest -= centre_digit;
+                if (no_repeat && pairs == 0 && centre_digit == before) continue;
+            }
+            size_t used = 0;
+            for (int k = 0; k < 3; k++) used += need[k] > 0 ? (size_t)(need[k] + 1) / 2 : 0;
+            size_t digit_pairs = need[3] > 0 ? (size_t)(need[3] + 1) / 2 : 0;
+            if (used + digit_pairs > pairs) continue;
+            if (!reqs->req_digit_sum) return 1;
+            if (rest < 0 || rest % 2 != 0) continue;
+
+            size_t cap[10];
+            digit_caps(cap, pairs, no_repeat, before, centre_digit);
+            if (digit_sum_fits(digit_pairs, pairs - used, rest / 2, cap)) return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Palindrome check for passwords that end inside the prefix's own
+ * mirror image: the prefix plus the reverse of its first s characters, which
+ * is a palindrome exactly when the prefix's last p - s characters are one.
+ * @param chars The prefix's characters (code points, or bytes).
+ * @return 1 if some s gives a valid password of length in [n_lo, n_hi], 0 if
+ * none does, -1 if memory could not be allocated.
+ */
+static int folded_completion_fits(const uint32_t *chars, const PasswordFeatures *f,
+                                  const PasswordRequirements *reqs, size_t n_lo, size_t n_hi) {
+    size_t p = f->length, width = 2 * p + 1;
+    size_t *reach = malloc(width * sizeof(size_t));
+    if (reach == NULL) return -1;
+
+    // Manacher over the prefix with separators between characters: the
+    // palindrome centred at i spans [i - reach[i], i + reach[i]]
+    for (size_t i = 0, l = 0, r = 0; i < width; i++) {
+        size_t k = 0;
+        if (i < r) {
+            k = reach[l + r - i] < r - i ? reach[l + r - i] : r - i;
+        }
+        while (k < i && i + k + 1 < width &&
+               ((i - k - 1) % 2 == 0 || chars[(i - k - 1) / 2] == chars[(i + k + 1) / 2])) {
+            k++;
+        }
+        reach[i] = k;
+        if (i + k > r) {
+            l = i - k;
+            r = i + k;
+        }
+    }
+
+    ClassCounts total = f->counts;
+    int fits = 0;
+    for (size_t s = 0; s < p && p + s <= n_hi && !fits; s++) {
+        if (s > 0) {
+            uint32_t ch = chars[s - 1];
+            CharInfo ci = reqs->utf8 && ch >= 0x80 ? unicode_class_cached(ch) : char_table[ch & 0xFF];
+            total.upper += ci.cls_bits & CC_UPPER;
+            total.lower += (ci.cls_bits & CC_LOWER) >> 1;
+            total.digits += (ci.cls_bits & CC_DIGIT) >> 2;
+            total.symbols += (ci.cls_bits & CC_SYMBOL) >> 3;
+            total.digit_sum += ci.digit_value;
+        }
+        // Characters s..p-1 centre on separator index p + s
+        fits = p + s >= n_lo && reach[p + s] >= p - s &&
+               !(reqs->req_no_consecutive_chars && s > 0 && chars[p - 1] == chars[s - 1]) &&
+               total.upper >= reqs->min_uppercase && total.lower >= reqs->min_lowercase &&
+               total.digits >= reqs->min_digits && total.symbols >= reqs->min_symbols &&
+               (!reqs->req_digit_sum || total.digit_sum == reqs->digit_sum_target);
+    }
+    free(reach);
+    return fits;
+}
+
+/**
+ * @brief Shared body of check_prefix() and incremental_validator_prefix_check().
+ * @param f Features of the prefix (full kernel).
+ * @param last The prefix's last character (unused if it is empty).
+ * @param chars Every character of the prefix; only read under the palindrome
+ * rule, and may be NULL if it could not be allocated.
+ * @param live If not NULL, the incremental validator holding the prefix,
+ * whose palindromic tree replaces chars.
+ */
+static unsigned prefix_dead_rule(const PasswordFeatures *f, uint32_t last, const uint32_t *chars,
+                                 const IncrementalValidator *live, const PasswordRequirements *reqs,
+                                 size_t max_length) {
+    size_t p = f->length;
+    size_t n_lo = reqs->min_length > 0 && (size_t)reqs->min_length > p ? (size_t)reqs->min_length : p;
+    size_t n_hi = max_length;
+    int last_digit = p > 0 && last >= '0' && last <= '9' ? (int)(last - '0') : -1;
+
+    if (f->encoding_error >= 0) return RULE_ENCODING;
+    if (n_lo > n_hi) return RULE_MIN_LENGTH;
+    if (reqs->req_digit_sum && reqs->min_digits == 0 && reqs->digit_sum_target != 0) return RULE_DIGIT_SUM;
+    if (reqs->req_no_consecutive_chars && f->first_repeat >= 0) return RULE_NO_CONSECUTIVE;
+    if (reqs->req_start_upper_end_symbol && p > 0 && !(f->first_class & CC_UPPER)) return RULE_START_UPPER;
+    if (reqs->req_start_upper_end_symbol && reqs->req_palindrome) {
+        return RULE_PALINDROME; // The first character is also the last: it would be an uppercase symbol
+    }
+    if (p == n_lo && check_features(f, reqs) == 0) return 0; // Already a valid password
+
+    if (!reqs->req_palindrome) {
+        if (reqs->req_digit_sum && f->counts.digit_sum > reqs->digit_sum_target) return RULE_DIGIT_SUM;
+        if (n_hi == p) {
+            unsigned violations = check_features(f, reqs);
+            return violations & -violations;
+        }
+        size_t s = n_hi - p < PREFIX_ROOM_LIMIT ? n_hi - p : PREFIX_ROOM_LIMIT;
+        return completion_dead_rule(f, last_digit, reqs, s);
+    }
+
+    if (n_hi / 2 >= p) {
+        size_t m_lo = n_lo > 2 * p ? n_lo - 2 * p : 0;
+        if (mirrored_completion_fits(f, last_digit, reqs, m_lo, n_hi - 2 * p)) return 0;
+    }
+    if (p > 0 && live != NULL) {
+        if (live_folded_fits(live, reqs, n_lo, n_hi)) return 0;
+    } else if (p > 0) {
+        if (chars == NULL) return 0; // Out of memory: cannot rule the prefix out
+        if (folded_completion_fits(chars, f, reqs, n_lo, n_hi) != 0) return 0;
+    }
+    return RULE_PALINDROME;
+}
+
+/**
+ * @brief Prefix-feasibility oracle: can some completion of a partial password,
+ * at most max_length characters in all, still satisfy every rule? Costs one
+ * scan of the prefix; O(1) after it unless the palindrome rule is active.
+ * @param prefix The characters typed so far (UTF-8 in UTF-8 mode, ending on a
+ * character boundary).
+ * @param len Number of bytes in prefix.
+ * @param reqs The requirements.
+ * @param max_length Length budget in characters, or SIZE_MAX for none.
+ * @return 0 if the prefix can still be completed, otherwise the RULE_* bit of
+ * a rule no completion can meet (RULE_MIN_LENGTH if the budget is too small).
+ */
+unsigned check_prefix(const char *prefix, size_t len, const PasswordRequirements *reqs, size_t max_length) {
+    const unsigned char *p = (const unsigned char *)prefix;
+    PasswordFeatures features;
+    uint32_t last = 0, *chars = NULL;
+
+    scan_password_for(prefix, len, reqs, &features);
+    if (features.encoding_error >= 0) return RULE_ENCODING;
+    if (reqs->utf8) pthread_once(&unicode_cache_once, unicode_cache_build);
+    if (len > 0) {
+        size_t start = len - 1;
+        while (reqs->utf8 && start > 0 && (p[start] & 0xC0) == 0x80) start--;
+        if (reqs->utf8) {
+            utf8_decode_valid(p + start, &last);
+        } else {
+            last = p[start];
+        }
+    }
+    if (reqs->req_palindrome && features.length > 0 &&
+        (chars = malloc(features.length * sizeof(uint32_t))) != NULL) {
+        for (size_t i = 0, n = 0; i < len; n++) {
+            if (reqs->utf8) {
+                i += utf8_decode_valid(p + i, &chars[n]);
+            } else {
+                chars[n] = p[i++];
+            }
+        }
+    }
+    unsigned rule = prefix_dead_rule(&features, last, chars, NULL, reqs, max_length);
+    free(chars);
+    return rule;
+}
+
+// --- Feasibility Analysis ---
+
+/**
+ * @brief Decides in constant time whether any password satisfies a policy,
+ * and if not, why. The contradictions a policy can hold on its own are named;
+ * what is left depends on the length budget and is settled by the prefix
+ * oracle on an empty prefix, which does not depend on the password length.
+ * @param reqs The requirements.
+ * @param max_length Length budget in characters, or SIZE_MAX for none (as in the game).
+ * @param verdict Receives the rules in conflict and an explanation.
+ * @return verdict->rules: 0 if the policy is satisfiable.
+ */
+unsigned analyze_policy(const PasswordRequirements *reqs, size_t max_length, PolicyVerdict *verdict) {
+    size_t min_length = reqs->min_length > 0 ? (size_t)reqs->min_length : 0;
+    verdict->rules = 0;
+    verdict->reason = NULL;
+
+    if (reqs->req_start_upper_end_symbol && reqs->req_palindrome) {
+        verdict->rules = RULE_START_UPPER | RULE_END_SYMBOL | RULE_PALINDROME;
+        verdict->reason = "a palindrome starts and ends with the same character, "
+                          "which cannot be both uppercase and a symbol";
+    } else if (reqs->req_digit_sum && reqs->digit_sum_target < 0) {
+        verdict->rules = RULE_DIGIT_SUM;
+        verdict->reason = "the digit sum target is negative";
+    } else if (reqs->req_digit_sum && reqs->min_digits == 0 && reqs->digit_sum_target != 0) {
+        verdict->rules = RULE_DIGIT_SUM | RULE_MIN_DIGITS;
+        verdict->reason = "a digit sum is required but no digits are";
+    } else if (min_length > max_length) {
+        verdict->rules = RULE_MIN_LENGTH;
+        verdict->reason = "the minimum length exceeds the length budget";
+    } else if (reqs->req_palindrome && reqs->req_no_consecutive_chars &&
+               min_length == max_length && max_length % 2 == 0 && max_length > 0) {
+        verdict->rules = RULE_PALINDROME | RULE_NO_CONSECUTIVE;
+        verdict->reason = "a palindrome with no repeated neighbours has odd length, "
+                          "and the budget allows only an even one";
+    } else {
+        PasswordFeatures empty;
+        scan_begin(&empty, 0);
+        verdict->rules = prefix_dead_rule(&empty, 0, NULL, NULL, reqs, max_length);
+        switch (verdict->rules) {
+        case 0:
+            break;
+        case RULE_DIGIT_SUM:
+            verdict->reason = "the digit sum cannot be reached within the length budget";
+            break;
+        case RULE_NO_CONSECUTIVE:
+            verdict->rules |= RULE_DIGIT_SUM;
+            verdict->reason = "the digits the sum needs cannot be kept apart within the length budget";
+            break;
+        case RULE_PALINDROME:
+            verdict->reason = "no palindrome within the length budget meets the counts and digit sum";
+            break;
+        default:
+            verdict->reason = "the required characters do not fit in the length budget";
+            break;
+        }
+    }
+    return verdict->rules;
+}
+
+/**
+ * @brief Implements "pw --sweep [--rounds N] [--max-length L] [--utf8]": analyzes
+ * every policy generate_requirements() can produce for rounds 1 to N (every
+ * random outcome of each), prints one line per round and one per reason a
+ * round's policies are infeasible.
+ * @return Process exit status: 0 if every policy is satisfiable, 1 if some
+ * is not, 2 on bad usage.
+ */
+int run_sweep_mode(int argc, char *argv[]) {
+    int rounds = SWEEP_DEFAULT_ROUNDS;
+    size_t max_length = SIZE_MAX;
+    int utf8 = 0;
+    int status = 0;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-length") == 0 && i + 1 < argc) {
+            long max = atol(argv[++i]);
+            max_length = max >= 0 ? (size_t)max : 0;
+        } else if (strcmp(argv[i], "--utf8") == 0) {
+            utf8 = 1;
+        } else {
+            rounds = 0;
+            break;
+        }
+    }
+    if (rounds < 1) {
+        fprintf(stderr, "Usage: %s --sweep [--rounds N] [--max-length L] [--utf8]\n", argv[0]);
+        return 2;
+    }
+
+    printf("%5s %6s %10s  %s\n", "round", "rolls", "infeasible", "policy");
+    for (int round = 1; round <= rounds; round++) {
+        int rolls = requirement_rolls(round);
+        int infeasible = 0;
+        const char *reasons[8];
+        int reason_counts[8], distinct = 0;
+        PasswordRequirements reqs;
+        char spec[256];
+
+        for (int roll = 0; roll < rolls; roll++) {
+            PolicyVerdict verdict;
+            generate_requirements_roll(&reqs, round, roll);
+            reqs.utf8 = utf8;
+            if (analyze_policy(&reqs, max_length, &verdict) == 0) continue;
+            infeasible++;
+            int r = 0;
+            while (r < distinct && reasons[r] != verdict.reason) r++;
+            if (r == distinct && distinct < 8) {
+                reasons[distinct] = verdict.reason;
+                reason_counts[distinct++] = 0;
+            }
+            if (r < distinct) reason_counts[r]++;
+        }
+        generate_requirements_roll(&reqs, round, 0);
+        reqs.utf8 = utf8;
+        format_policy_spec(&reqs, spec, sizeof(spec));
+        printf("%5d %6d %10d  %s", round, rolls, infeasible, spec);
+        if (rolls > 1) printf(" (digit-sum up to %d)", reqs.digit_sum_target + rolls - 1);
+        printf("\n");
+        for (int r = 0; r < distinct; r++) {
+            printf("%23d  %s\n", reason_counts[r], reasons[r]);
+        }
+        if (infeasible > 0) status = 1;
+    }
+    return status;
+}
+
+// --- Password Synthesis ---
+
+/*
+ * A satisfiable policy is turned into a SynthesisPlan once: how many
+ * characters of each class the password (or, for palindromes, its first half)
+ * holds, what the digits must add up to, and the final length. Emitting a
+ * password from a plan is then a single pass with a small per-caller RNG.
+ * Digits go first, each followed by a non-digit, so under no-repeat they
+ * never touch; neighbouring characters of one class are drawn to differ.
+ */
+
+static const char synth_upper[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static const char synth_lower[] = "abcdefghijklmnopqrstuvwxyz";
+static const char synth_symbols[] = "!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+
+/**
+ * @brief xorshift64* step; the state must be non-zero.
+ */
+static inline uint64_t rng_next(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+/**
+ * @brief Uniform value in [0, n), n > 0: multiply-shift of the RNG's top 32
+ * bits, redrawing the few values that would bias it (Lemire's method).
+ */
+static inline uint32_t rng_below(uint64_t *state, uint32_t n) {
+    uint64_t m = (rng_next(state) >> 32) * n;
+    if ((uint32_t)m < n) {
+        uint32_t floor = -n % n;
+        while ((uint32_t)m < floor) m = (rng_next(state) >> 32) * n;
+    }
+    return (uint32_t)(m >> 32);
+}
+
+/**
+ * @brief Random character from a pool, other than avoid.
+ */
+static inline char synth_pick(const char *pool, uint32_t size, uint64_t *rng, char avoid) {
+    uint32_t i = rng_below(rng, size);
+    return pool[i] != avoid ? pool[i] : pool[i + 1 < size ? i + 1 : 0];
+}
+
+/**
+ * @brief Works out the shape of the passwords synthesize_password() builds.
+ * Lengths come out at min_length unless the classes (or, under no-repeat,
+ * the letters keeping digits apart) need more.
+ * @param reqs The requirements.
+ * @param plan Receives the plan.
+ * @return 0 on success, -1 if no password satisfies reqs (see analyze_policy()).
+ */
+int synthesis_plan(const PasswordRequirements *reqs, SynthesisPlan *plan) {
+    PolicyVerdict verdict;
+    size_t min_length = reqs->min_length > 0 ? (size_t)reqs->min_length : 0;
+    long sum = reqs->req_digit_sum ? reqs->digit_sum_target : -1;
+    size_t need[4] = { need_of(reqs->min_uppercase, 0), need_of(reqs->min_lowercase, 0),
+                       need_of(reqs->min_symbols, 0), need_of(reqs->min_digits, 0) };
+
+    if (analyze_policy(reqs, SIZE_MAX, &verdict) != 0) return -1;
+    memset(plan, 0, sizeof(*plan));
+    plan->palindrome = reqs->req_palindrome;
+    plan->no_repeat = reqs->req_no_consecutive_chars;
+    plan->centre = -1;
+
+    if (!plan->palindrome) {
+        plan->framed = reqs->req_start_upper_end_symbol;
+        if (plan->framed) {
+            need[0] = need[0] > 0 ? need[0] - 1 : 0; // The opening uppercase letter
+            need[2] = need[2] > 0 ? need[2] - 1 : 0; // The closing symbol
+        }
+        plan->digits = need[3];
+        if (sum >= 0 && plan->digits < (size_t)(sum + 8) / 9) plan->digits = (size_t)(sum + 8) / 9;
+        plan->digit_sum = sum;
+    } else {
+        // The centre covers a parity the mirrored halves cannot: an odd digit sum first, then an odd count
+        long centre_digit = -1;
+        if (sum >= 0 && sum % 2 == 1) {
+            centre_digit = sum >= 9 ? 9 : sum;
+        } else if (need[3] % 2 == 1) {
+            centre_digit = sum >= 0 ? (sum >= 8 ? 8 : sum) : 0;
+        }
+        if (centre_digit >= 0) {
+            plan->centre = CC_DIGIT;
+            plan->centre_digit = (int)centre_digit;
+            need[3] = need[3] > 0 ? need[3] - 1 : 0;
+        } else {
+            static const int centre_class[3] = { CC_UPPER, CC_LOWER, CC_SYMBOL };
+            for (int c = 0; c < 3 && plan->centre < 0; c++) {
+                if (need[c] % 2 == 1) {
+                    plan->centre = centre_class[c];
+                    need[c]--;
+                }
+            }
+            if (plan->centre < 0 && (plan->no_repeat || min_length % 2 == 1)) {
+                plan->centre = CC_LOWER; // Odd length without repeated middle characters
+            }
+        }
+        for (int c = 0; c < 4; c++) need[c] = (need[c] + 1) / 2; // Each character of the half counts twice
+        plan->digit_sum = sum >= 0 ? (sum - (centre_digit >= 0 ? centre_digit : 0)) / 2 : -1;
+        plan->digits = need[3];
+        if (sum >= 0 && plan->digits < (size_t)(plan->digit_sum + 8) / 9) {
+            plan->digits = (size_t)(plan->digit_sum + 8) / 9;
+        }
+    }
+    plan->upper = need[0];
+    plan->lower = need[1];
+    plan->symbols = need[2];
+
+    // Under no-repeat every digit is followed by a non-digit, except the very last
+    // of a plain password, whose neighbour may be the closing symbol or nothing
+    size_t others = plan->upper + plan->lower + plan->symbols;
+    size_t separators = plan->digits - (plan->digits > 0 && !plan->palindrome ? 1 : 0);
+    if (plan->no_repeat && others < separators) plan->lower += separators - others;
+
+    size_t body = plan->upper + plan->lower + plan->symbols + plan->digits;
+    if (plan->palindrome) {
+        size_t centre = plan->centre >= 0;
+        if (2 * body + centre < min_length) {
+            plan->lower += (min_length - 2 * body - centre + 1) / 2;
+            body = plan->upper + plan->lower + plan->symbols + plan->digits;
+        }
+        plan->length = 2 * body + centre;
+    } else {
+        size_t frame = plan->framed ? 2 : 0;
+        if (body + frame < min_length) {
+            plan->lower += min_length - body - frame;
+            body = min_length - frame;
+        }
+        plan->length = body + frame;
+    }
+    return 0;
+}
+
+/**
+ * @brief Emits the free part of a password (all of it between the frame, or a
+ * palindrome's first half): digits splitting the plan's digit sum, each
+ * followed by a non-digit while any remain, then the remaining non-digits.
+ * @return One past the last character written.
+ */
+static char *synth_body(char *out, const SynthesisPlan *plan, char prev, uint64_t *rng) {
+    size_t digits = plan->digits;
+    size_t left[3] = { plan->upper, plan->lower, plan->symbols };
+    long sum = plan->digit_sum;
+    int cls = 0;
+
+    while (digits > 0 || left[0] + left[1] + left[2] > 0) {
+        char c;
+        if (digits > 0 && (prev < '0' || prev > '9' || left[0] + left[1] + left[2] == 0)) {
+            if (sum >= 0) {
+                // Keep what is left reachable by the digits after this one
+                long rest = (long)(digits - 1) * 9;
+                long lo = sum > rest ? sum - rest : 0, hi = sum < 9 ? sum : 9;
+                long v = lo + (long)rng_below(rng, (uint32_t)(hi - lo + 1));
+                sum -= v;
+                c = (char)('0' + v);
+            } else {
+                c = synth_pick("0123456789", 10, rng, prev);
+            }
+            digits--;
+        } else {
+            while (left[cls] == 0) cls++;
+            left[cls]--;
+            c = cls == 0 ? synth_pick(synth_upper, 26, rng, prev)
+              : cls == 1 ? synth_pick(synth_lower, 26, rng, prev)
+              : synth_pick(synth_symbols, sizeof(synth_symbols) - 1, rng, prev);
+        }
+        *out++ = c;
+        prev = c;
+    }
+    return out;
+}
+
+/**
+ * @brief Builds one password conforming to the policy a plan was made for.
+ * O(length); characters are drawn at random within each class.
+ * @param plan From synthesis_plan().
+ * @param rng RNG state (non-zero), advanced.
+ * @param out Receives plan->length bytes; not NUL-terminated.
+ * @return plan->length.
+ */
+size_t synthesize_password(const SynthesisPlan *plan, uint64_t *rng, char *out) {
+    char *p = out;
+    if (!plan->palindrome) {
+        if (plan->framed) *p++ = synth_pick(synth_upper, 26, rng, 0);
+        p = synth_body(p, plan, p > out ? p[-1] : 0, rng);
+        if (plan->framed) {
+            *p = synth_pick(synth_symbols, sizeof(synth_symbols) - 1, rng, p > out ? p[-1] : 0);
+            p++;
+        }
+        return (size_t)(p - out);
+    }
+
+    char *half_end = synth_body(p, plan, 0, rng);
+    size_t half = (size_t)(half_end - out);
+    p = half_end;
+    if (plan->centre >= 0) {
+        char prev = half > 0 ? p[-1] : 0;
+        *p++ = plan->centre == CC_DIGIT ? (char)('0' + plan->centre_digit)
+             : plan->centre == CC_UPPER ? synth_pick(synth_upper, 26, rng, prev)
+             : plan->centre == CC_SYMBOL ? synth_pick(synth_symbols, sizeof(synth_symbols) - 1, rng, prev)
+             : synth_pick(synth_lower, 26, rng, prev);
+    }
+    for (size_t i = half; i > 0; i--) *p++ = out[i - 1];
+    return (size_t)(p - out);
+}
+
+// --- Password Generation ---
+
+/**
+ * @brief --generate worker: claims a batch of passwords, builds them into its
+ * own buffer with its own RNG, and writes the batch out in one call.
+ */
+static void *generate_worker_main(void *arg) {
+    GenerateWorker *w = arg;
+    GenerateJob *job = w->job;
+    size_t per_batch = w->batch.cap / (job->length + 1);
+
+    for (;;) {
+        size_t n = per_batch;
+        pthread_mutex_lock(&job->lock);
+        if (job->stop) {
+            n = 0;
+        } else if (!job->unbounded) {
+            if (n > job->remaining) n = job->remaining;
+            job->remaining -= n;
+        }
+        pthread_mutex_unlock(&job->lock);
+        if (n == 0) break;
+
+        char *p = w->batch.data;
+        for (size_t i = 0; i < n; i++) {
+            if (job->counter) {
+                password_counter_sample(job->counter, &w->rng, p);
+                p += job->length;
+            } else {
+                p += synthesize_password(job->plan, &w->rng, p);
+            }
+            *p++ = '\n';
+        }
+        w->batch.len = (size_t)(p - w->batch.data);
+
+        pthread_mutex_lock(&job->out_lock);
+        int failed = job->out_error == 0 && output_flush(&w->batch, job->fd) != 0;
+        if (failed) job->out_error = errno;
+        pthread_mutex_unlock(&job->out_lock);
+        if (failed) {
+            pthread_mutex_lock(&job->lock);
+            job->stop = 1;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Writes count passwords (or an endless stream) built from a plan,
+ * or drawn uniformly from a counter's tables, one per line, using one worker
+ * thread per requested CPU. Each worker has its own RNG, seeded from seed
+ * and its index, so lines are independent but their order across workers
+ * is not reproducible.
+ * @param plan From synthesis_plan(); used when counter is NULL.
+ * @param counter Tables from password_counter_init() with keep_tables and a
+ * non-zero count, or NULL to synthesize.
+ * @param count Passwords to write; ignored if unbounded.
+ * @param unbounded Non-zero to write until the output fails.
+ * @param threads Worker count (at least 1).
+ * @param seed Base RNG seed.
+ * @param fd Output file descriptor.
+ * @return 0 on success, -1 with errno set on allocation or write failure.
+ */
+int generate_parallel(const SynthesisPlan *plan, const PasswordCounter *counter, size_t count,
+                      int unbounded, int threads, uint64_t seed, int fd) {
+    if (threads < 1) threads = 1;
+    size_t length = counter ? counter->length : plan->length;
+    size_t batch_bytes = GENERATE_BATCH_BYTES;
+    if (batch_bytes < length + 1) batch_bytes = length + 1;
+
+    GenerateJob job;
+    GenerateWorker *workers = aligned_alloc(64, (size_t)threads * sizeof(GenerateWorker));
+    pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+    int status = 0;
+
+    memset(&job, 0, sizeof(job));
+    if (workers == NULL || tids == NULL) {
+        free(workers);
+        free(tids);
+        return -1;
+    }
+    job.plan = plan;
+    job.counter = counter;
+    job.length = length;
+    job.unbounded = unbounded;
+    job.remaining = count;
+    job.fd = fd;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_mutex_init(&job.out_lock, NULL);
+
+    int ready = 0;
+    for (; ready < threads; ready++) {
+        GenerateWorker *w = &workers[ready];
+        memset(w, 0, sizeof(GenerateWorker));
+        w->job = &job;
+        // splitmix64 of (seed, index) gives each worker an unrelated xorshift state
+        uint64_t z = seed + 0x9E3779B97F4A7C15ull * (uint64_t)(ready + 1);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        w->rng = z ? z : 0x2545F4914F6CDD1Dull;
+        w->batch.data = malloc(batch_bytes);
+        w->batch.cap = batch_bytes;
+        if (w->batch.data == NULL) break;
+    }
+    if (ready == 0) {
+        status = -1;
+    } else {
+        int started = 1;
+        while (started < ready &&
+               pthread_create(&tids[started], NULL, generate_worker_main, &workers[started]) == 0) {
+            started++;
+        }
+        generate_worker_main(&workers[0]); // Claims batches the same way, so failed starts only cost speed
+        for (int t = 1; t < started; t++) {
+            pthread_join(tids[t], NULL);
+        }
+        if (job.out_error) {
+            errno = job.out_error;
+            status = -1;
+        }
+    }
+
+    for (int t = 0; t < ready; t++) free(workers[t].batch.data);
+    pthread_mutex_destroy(&job.lock);
+    pthread_mutex_destroy(&job.out_lock);
+    free(tids);
+    free(workers);
+    return status;
+}
+
+/**
+ * @brief Implements "pw --generate [--count N] [--round N | --policy SPEC] [--utf8] [--threads N] [--seed S]
+ * [--uniform [--length L]]".
+ * Writes N passwords satisfying the policy to stdout, one per line, or an
+ * endless stream without --count (ending quietly when the reader goes away).
+ * With --uniform, every password of length L (the policy's minimum by
+ * default) is equally likely; the counting tables are built once and shared.
+ * --seed also picks a round's roll, as for the other modes; without it the
+ * round's first roll is used.
+ * @return Process exit status: 0 on success, 1 if the policy is unsatisfiable
+ * (at that length), too large to sample, or output fails, 2 on bad usage.
+ */
+int run_generate_mode(int argc, char *argv[]) {
+    const char *spec = NULL;
+    int round = 1;
+    int utf8 = 0;
+    int unbounded = 1;
+    int uniform = 0;
+    int usage_error = 0;
+    long length = -1;
+    size_t count = 0;
+    uint64_t seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+    uint64_t roll_seed = 0; // The round's roll follows --seed only when it is given
+    long threads = default_thread_count();
+
+    for (int i = 2; i < argc && !usage_error; i++) {
+        if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            char *end;
+            count = (size_t)strtoull(argv[++i], &end, 10);
+            unbounded = 0;
+            if (*end != '\0' || argv[i][0] == '-') usage_error = 1;
+        } else if (strcmp(argv[i], "--round") == 0 && i + 1 < argc) {
+            round = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            spec = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            if (parse_thread_count(argv[0], argv[++i], &threads) != 0) return 2;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+            roll_seed = seed;
+        } else if (strcmp(argv[i], "--utf8") == 0) {
+            utf8 = 1;
+        } else if (strcmp(argv[i], "--uniform") == 0) {
+            uniform = 1;
+        } else if (strcmp(argv[i], "--length") == 0 && i + 1 < argc) {
+            length = atol(argv[++i]);
+            if (length < 0) usage_error = 1;
+        } else {
+            usage_error = 1;
+        }
+    }
+    if (usage_error || round < 1 || (length >= 0 && !uniform)) {
+        fprintf(stderr, "Usage: %s --generate [--count N] [--round N | --policy SPEC] [--utf8] [--threads N] [--seed S] [--uniform [--length L]]\n", argv[0]);
+        return 2;
+    }
+
+    PasswordRequirements reqs;
+    if (policy_from_args(spec, round, roll_seed, utf8, &reqs) != 0) {
+        return 2;
+    }
+    char desc[256];
+    format_policy_spec(&reqs, desc, sizeof(desc));
+    fprintf(stderr, "Policy: %s\n", desc);
+
+    SynthesisPlan plan;
+    if (synthesis_plan(&reqs, &plan) != 0) {
+        PolicyVerdict verdict;
+        analyze_policy(&reqs, SIZE_MAX, &verdict);
+        fprintf(stderr, "No password satisfies this policy: %s\n", verdict.reason);
+        return 1;
+    }
+    PasswordCounter counter;
+    if (uniform) {
+        if (length < 0) length = reqs.min_length > 0 ? reqs.min_length : 0;
+        if (password_counter_init(&counter, &reqs, (size_t)length, 1) != 0) {
+            fprintf(stderr, "Too many states to sample length %ld uniformly\n", length);
+            return 1;
+        }
+        if (counter.limbs > COUNT_SAMPLE_LIMBS) {
+            fprintf(stderr, "Length %ld is too long to sample uniformly\n", length);
+            password_counter_free(&counter);
+            return 1;
+        }
+        if (count_is_zero(counter.root, counter.limbs)) {
+            fprintf(stderr, "No password of length %ld satisfies this policy\n", length);
+            password_counter_free(&counter);
+            return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN); // A closed pipe shows up as EPIPE instead of killing us
+    int status = 0;
+    if (generate_parallel(&plan, uniform ? &counter : NULL, count, unbounded, (int)threads, seed,
+                          STDOUT_FILENO) != 0) {
+        if (!unbounded || errno != EPIPE) { // EPIPE: the reader has had enough
+            perror("--generate");
+            status = 1;
+        }
+    }
+    if (uniform) password_counter_free(&counter);
+    return status;
+}
+
+// --- Password Counting ---
+
+/*
+ * Exact counts of the passwords of one length that satisfy a policy, over the
+ * 95 printable ASCII characters. A password is chosen one step at a time: a
+ * character, or for a palindrome one of its first half (counting twice)
+ * followed by the centre. After a step, the state is what the rest must
+ * still provide: the class minimums not yet met (capped, so a small vector),
+ * the digit sum still owed, and under no-repeat the previous character's
+ * class, or its value if it was a digit and digits must add up. A character
+ * may be anything in its class except the previous one, so one class's
+ * choices all share a count and the table never goes below class level.
+ */
+
+// Class sizes in counting order: uppercase, lowercase, symbols, space, digits (95 in all).
+static const int count_class_size[5] = { 26, 26, 32, 1, 10 };
+#define COUNT_SPACE 3
+#define COUNT_DIGIT 4
+
+static inline void count_add(uint64_t *dst, const uint64_t *src, int limbs) {
+    unsigned __int128 carry = 0;
+    for (int j = 0; j < limbs; j++) {
+        carry += (unsigned __int128)dst[j] + src[j];
+        dst[j] = (uint64_t)carry;
+        carry >>= 64;
+    }
+}
+
+static inline void count_addmul(uint64_t *dst, const uint64_t *src, uint64_t k, int limbs) {
+    unsigned __int128 carry = 0;
+    for (int j = 0; j < limbs; j++) {
+        carry += (unsigned __int128)src[j] * k + dst[j];
+        dst[j] = (uint64_t)carry;
+        carry >>= 64;
+    }
+}
+
+static inline int count_is_zero(const uint64_t *n, int limbs) {
+    for (int j = 0; j < limbs; j++) {
+        if (n[j] != 0) return 0;
+    }
+    return 1;
+}
+
+// dst = a - b; dst may be a.
+static inline void count_sub(uint64_t *dst, const uint64_t *a, const uint64_t *b, int limbs) {
+    uint64_t borrow = 0;
+    for (int j = 0; j < limbs; j++) {
+        unsigned __int128 d = (unsigned __int128)a[j] - b[j] - borrow;
+        dst[j] = (uint64_t)d;
+        borrow = (uint64_t)(d >> 64) & 1;
+    }
+}
+
+static inline int count_less(const uint64_t *a, const uint64_t *b, int limbs) {
+    int m = limbs - 1;
+    while (m > 0 && a[m] == b[m]) m--;
+    return a[m] < b[m];
+}
+
+// dst += a * b, for products that fit in limbs words.
+static inline void count_mul_add(uint64_t *dst, const uint64_t *a, const uint64_t *b, int limbs) {
+    for (int j = 0; j < limbs; j++) {
+        if (b[j] != 0) count_addmul(dst + j, a, b[j], limbs - j);
+    }
+}
+
+static inline void count_mul_small(uint64_t *n, uint64_t k, int limbs) {
+    unsigned __int128 carry = 0;
+    for (int j = 0; j < limbs; j++) {
+        carry += (unsigned __int128)n[j] * k;
+        n[j] = (uint64_t)carry;
+        carry >>= 64;
+    }
+}
+
+// n /= d, which must divide it.
+static inline void count_div_small(uint64_t *n, uint64_t d, int limbs) {
+    unsigned __int128 rem = 0;
+    for (int j = limbs - 1; j >= 0; j--) {
+        rem = rem << 64 | n[j];
+        n[j] = (uint64_t)(rem / d);
+        rem %= d;
+    }
+}
+
+/**
+ * @brief n mod p, p below 2^32.
+ */
+static uint32_t count_residue(const uint64_t *n, int limbs, uint32_t p) {
+    uint64_t r = 0;
+    for (int j = limbs - 1; j >= 0; j--) r = (uint64_t)((((unsigned __int128)r << 64) | n[j]) % p);
+    return (uint32_t)r;
+}
+
+/**
+ * @brief Sets rows up for up to max_rows rows of sums counts each, building
+ * none yet. A count is at most the ways to split its sum among that many
+ * unbounded digits, and at most 10^k, which sizes the limbs.
+ */
+static void digit_sum_rows_init(DigitSumRows *rows, int max_rows, int sums) {
+    double a = sums - 1.0, b = max_rows > 1 ? max_rows - 2.0 : 0.0; // C(a + b, a)
+    double bits = (lgamma(a + b + 1.0) - lgamma(a + 1.0) - lgamma(b + 1.0)) / log(2.0);
+    if (bits > (max_rows - 1.0) * log2(10.0)) bits = (max_rows - 1.0) * log2(10.0); // Nor past 10^k
+    memset(rows, 0, sizeof(*rows));
+    rows->max_rows = max_rows;
+    rows->sums = sums;
+    rows->limbs = (int)(bits + 2.0) / 64 + 1;
+}
+
+/**
+ * @brief Builds rows up to k digits, each from the one before as
+ * D_k(s) = D_k(s - 1) + D_(k-1)(s) - D_(k-1)(s - 10), which is
+ * (1 - y) D_k = (1 - y^10) D_(k-1). A row costs sums additions, less than
+ * any transform would take to raise the polynomial to a power, and rows
+ * already built are kept.
+ * @return 0 on success, -1 past max_rows, over COUNT_TABLE_BUDGET, or if
+ * memory runs out.
+ */
+static int digit_sum_rows_reserve(DigitSumRows *rows, int k) {
+    size_t row_words = (size_t)rows->sums * rows->limbs;
+    if (k < rows->rows) return 0;
+    if (k >= rows->max_rows || (size_t)(k + 1) * row_words > COUNT_TABLE_BUDGET) return -1;
+    uint64_t *ways = realloc(rows->ways, (size_t)(k + 1) * row_words * sizeof(uint64_t));
+    if (ways == NULL) return -1;
+    rows->ways = ways;
+    for (; rows->rows <= k; rows->rows++) {
+        uint64_t *row = ways + (size_t)rows->rows * row_words;
+        const uint64_t *prev = row - row_words;
+        memset(row, 0, row_words * sizeof(uint64_t));
+        if (rows->rows == 0) {
+            row[0] = 1;
+            continue;
+        }
+        for (int s = 0; s < rows->sums; s++) {
+            uint64_t *e = row + (size_t)s * rows->limbs;
+            if (s > 0) memcpy(e, e - rows->limbs, (size_t)rows->limbs * sizeof(uint64_t));
+            count_add(e, prev + (size_t)s * rows->limbs, rows->limbs);
+            if (s >= 10) count_sub(e, e, prev + (size_t)(s - 10) * rows->limbs, rows->limbs);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief The ways k digits add up to sum, once digit_sum_rows_reserve() has
+ * built row k.
+ */
+static inline const uint64_t *digit_sum_ways(const DigitSumRows *rows, int k, int sum) {
+    return rows->ways + ((size_t)k * rows->sums + sum) * rows->limbs;
+}
+
+/**
+ * @brief Classes step may draw from, as bits of the counting order.
+ */
+static unsigned count_step_mask(const PasswordCounter *pc, int step) {
+    unsigned mask = 0x1F;
+    if (pc->reqs.req_start_upper_end_symbol) {
+        if (step == 0) mask &= 1u << 0;
+        if (step == pc->steps - 1) mask &= 1u << 2;
+    }
+    return mask;
+}
+
+/**
+ * @brief How many characters of the password one character chosen at step stands for.
+ */
+static inline int count_step_weight(const PasswordCounter *pc, int step) {
+    return pc->reqs.req_palindrome && !(pc->centre && step == pc->steps - 1) ? 2 : 1;
+}
+
+/**
+ * @brief The need vector after w characters of class cls.
+ */
+static inline int count_next_vector(const PasswordCounter *pc, int vector, int cls, int w) {
+    if (cls == COUNT_SPACE) return vector;
+    int axis = cls == COUNT_DIGIT ? 3 : cls;
+    int left = vector / pc->stride[axis] % pc->radix[axis];
+    return vector - (left < w ? left : w) * pc->stride[axis];
+}
+
+/**
+ * @brief The previous-character slot a character of class cls (digit value digit) leaves behind.
+ */
+static inline int count_slot(const PasswordCounter *pc, int cls, int digit) {
+    if (!pc->no_repeat) return 0;
+    if (cls != COUNT_DIGIT) return 1 + cls;
+    return 5 + (pc->digit_lasts == 10 ? digit : 0);
+}
+
+static inline uint64_t *count_entry(const PasswordCounter *pc, int layer, int rank, int last, int sum) {
+    return pc->counts + (pc->layer_offset[layer] + ((size_t)rank * pc->lasts + last) * pc->sums + sum) * pc->limbs;
+}
+
+/*
+ * Per-class counting, for policies whose need vectors outgrow the tables
+ * (they number (min_upper + 1) x (min_lower + 1) x ..., over 9000 by round
+ * 20). A password is read as a sequence of blocks. Under no-repeat a block is
+ * one character taken j times, counted with sign (-1)^(j-1): a run of r equal
+ * characters splits into blocks in ways whose signs add up to [r == 1], so
+ * exactly the passwords without repeats survive; otherwise blocks are single
+ * characters. The password shuffles each class's blocks together, so with t
+ * marking blocks and x steps a class has the exponential generating function
+ * exp(t size g(x)), g(x) = x / (1 + x) (x without no-repeat), and the count
+ * is the sum over K of K! [t^K x^steps] of the classes' product. Each class
+ * is its full series less a low part, the shares short of its minimum, which
+ * is a polynomial of degree below the minimum. Expanding the product over
+ * the classes, every choice of full series and low parts is a polynomial P
+ * times exp(t beta g(x)), beta the sizes of the full classes, and the sum
+ * over K leaves sum_k k! P_k(x) / (1 - beta g(x))^(k+1), whose [x^steps]
+ * takes work in the degree of P rather than in the steps. The first and last
+ * blocks under start-end, and the one ending in a palindrome's centre, stand
+ * outside the shuffle as a plain factor g(x) in their class. Under a digit
+ * sum the zeros are a class of size 1 and the nonzero digits a polynomial E
+ * of the block sequences adding up to the target, which take at most
+ * target / w steps. Without no-repeat E comes straight from the counter's
+ * rows of (1 + y + ... + y^9)^k (DigitSumRows); under no-repeat equal digits
+ * may not meet, which that power does not see, so E is built block by block.
+ * Everything runs modulo 30-bit primes, and the residues are joined by the
+ * Chinese remainder theorem.
+ */
+
+static inline uint32_t mod_add(uint32_t a, uint32_t b, uint32_t p) {
+    uint32_t s = a + b;
+    return s >= p ? s - p : s;
+}
+
+static inline uint32_t mod_sub(uint32_t a, uint32_t b, uint32_t p) {
+    return a >= b ? a - b : a + p - b;
+}
+
+static inline uint32_t mod_mul(uint32_t a, uint32_t b, uint32_t p) {
+    return (uint32_t)((uint64_t)a * b % p);
+}
+
+// Shoup's multiplication by a fixed w: w_shoup = floor(w 2^32 / p), p < 2^31.
+static inline uint32_t mod_shoup(uint32_t w, uint32_t p) {
+    return (uint32_t)(((uint64_t)w << 32) / p);
+}
+
+static inline uint32_t mod_mul_shoup(uint32_t a, uint32_t w, uint32_t w_shoup, uint32_t p) {
+    uint32_t q = (uint32_t)(((uint64_t)a * w_shoup) >> 32);
+    uint32_t r = a * w - q * p; // In [0, 2p), so the wrap-around is harmless
+    return r >= p ? r - p : r;
+}
+
+// x mod p by Barrett's method: inv = floor((2^64 - 1) / p) leaves x - q p below 2p.
+static inline uint32_t mod_reduce(uint64_t x, uint32_t p, uint64_t inv) {
+    uint64_t q = (uint64_t)(((unsigned __int128)x * inv) >> 64);
+    uint64_t r = x - q * p;
+    return (uint32_t)(r >= p ? r - p : r);
+}
+
+static uint32_t mod_pow(uint32_t a, uint32_t e, uint32_t p) {
+    uint32_t r = 1;
+    for (; e; e >>= 1, a = mod_mul(a, a, p)) {
+        if (e & 1) r = mod_mul(r, a, p);
+    }
+    return r;
+}
+
+/**
+ * @brief The largest prime below odd n (Miller-Rabin with bases 2, 7 and 61,
+ * exact below 2^32).
+ */
+static uint32_t count_prime_below(uint32_t n) {
+    static const uint32_t bases[3] = { 2, 7, 61 };
+    for (n -= 2;; n -= 2) {
+        uint32_t odd = n - 1;
+        int twos = 0, prime = 1;
+        while (odd % 2 == 0) {
+            odd /= 2;
+            twos++;
+        }
+        for (int b = 0; b < 3 && prime; b++) {
+            uint32_t x = mod_pow(bases[b], odd, n);
+            if (x == 1 || x == n - 1) continue;
+            prime = 0;
+            for (int i = 1; i < twos && !prime; i++) {
+                x = mod_mul(x, x, n);
+                prime = x == n - 1;
+            }
+        }
+        if (prime) return n;
+    }
+}
+
+// Products of residues below 2^30 summed without reducing each: 8 p^2 < 2^63.
+#define MOD_LAZY(sum, p) ((sum) >= 8 * (uint64_t)(p) * (p) ? (sum) - 8 * (uint64_t)(p) * (p) : (sum))
+
+/**
+ * @brief out = a * b for polynomials in t and x stored as rows [k][n] of
+ * stride coefficients (k <= n <= degree, since every block takes a step),
+ * cut after x^cap; out may not be a or b.
+ * @param acc Scratch, (cap + 1) x stride words.
+ * @return The degree of out.
+ */
+static int count_poly_mul(uint32_t *out, const uint32_t *a, int da, const uint32_t *b, int db, int cap,
+                          int stride, uint64_t *acc, uint32_t p) {
+    int d = da + db < cap ? da + db : cap;
+    memset(acc, 0, (size_t)(d + 1) * stride * sizeof(uint64_t));
+    for (int i = 0; i <= da; i++) {
+        const uint32_t *ra = a + (size_t)i * stride;
+        for (int j = 0; j <= db && i + j <= d; j++) {
+            const uint32_t *rb = b + (size_t)j * stride;
+            uint64_t *row = acc + (size_t)(i + j) * stride;
+            for (int n = i; n <= da && n + j <= d; n++) {
+                uint64_t v = ra[n];
+                int top = d - n < db ? d - n : db;
+                if (v == 0) continue;
+                for (int m = j; m <= top; m++) row[n + m] = MOD_LAZY(row[n + m] + v * rb[m], p);
+            }
+        }
+    }
+    uint64_t inv = UINT64_MAX / p;
+    for (int k = 0; k <= d; k++) {
+        for (int n = k; n <= d; n++) out[(size_t)k * stride + n] = mod_reduce(acc[(size_t)k * stride + n], p, inv);
+    }
+    return d;
+}
+
+/**
+ * @brief Builds how count_by_class() may take class c: the part of its
+ * series below its minimum (low, whose degree lands in *low_deg, -1 if
+ * there is none) and the shares of its full series.
+ * @param outside Non-zero if one of the class's blocks stands outside the
+ * shuffle; cen if that block ends in the centre, which counts once.
+ * @param digits The digit-sum polynomials E (no block outside) and, when
+ * cen, E with a nonzero centre block, or NULL for a plain class.
+ * @return Parts written to part (at most 3), the low part last.
+ */
+static int count_class_parts(ClassCountPart *part, const PasswordCounter *pc, int c, int outside, int cen,
+                             const uint32_t *digits[2], int digits_deg, uint32_t *low, int *low_deg,
+                             const uint32_t *fact, const uint32_t *inv_fact, int stride, uint64_t *acc,
+                             uint32_t *tmp, uint32_t p) {
+    int w = pc->reqs.req_palindrome ? 2 : 1;
+    int mins[5] = { pc->reqs.min_uppercase, pc->reqs.min_lowercase, pc->reqs.min_symbols, 0, pc->reqs.min_digits };
+    int nlow = 0;
+    while (nlow <= pc->steps && w * nlow - cen < mins[c]) nlow++;
+    uint32_t size = digits ? 1 : (uint32_t)count_class_size[c];
+    int parts = 0;
+    if (digits == NULL) {
+        part[parts++] = (ClassCountPart){ NULL, 0, 1, size, outside, outside ? size : 1 };
+    } else if (!cen) {
+        part[parts++] = (ClassCountPart){ digits[0], digits_deg, 1, 1, 0, 1 };
+    } else { // The centre is a zero, a plain block of size 1, or a nonzero digit inside E
+        part[parts++] = (ClassCountPart){ digits[0], digits_deg, 1, 1, 1, 1 };
+        part[parts++] = (ClassCountPart){ digits[1], digits_deg, 1, 1, 0, 1 };
+    }
+
+    // The low part is every share cut to fewer than nlow steps: exp(t size b(x))
+    // is sum_k (t size)^k / k! b(x)^k, and b(x)^j has [x^n] = (-1)^(n-j) C(n-1, j-1)
+    *low_deg = nlow - 1;
+    if (nlow == 0) return parts;
+    memset(low, 0, (size_t)nlow * stride * sizeof(uint32_t));
+    for (int s = 0; s < parts; s++) {
+        uint32_t *base = part[s].poly ? tmp : low;
+        if (part[s].poly) memset(tmp, 0, (size_t)nlow * stride * sizeof(uint32_t));
+        uint32_t power = part[s].scale;
+        for (int k = 0; k < nlow; k++) {
+            int j = k + part[s].e;
+            for (int n = j; n < nlow; n++) {
+                uint32_t g = j == 0 ? n == 0 : !pc->no_repeat ? n == j
+                           : mod_mul(fact[n - 1], mod_mul(inv_fact[j - 1], inv_fact[n - j], p), p);
+                if (pc->no_repeat && (n - j) % 2 == 1) g = p - g;
+                if (g == 0) continue;
+                uint32_t *e = &base[(size_t)k * stride + n];
+                *e = mod_add(*e, mod_mul(mod_mul(power, inv_fact[k], p), g, p), p);
+            }
+            power = mod_mul(power, size, p);
+        }
+        if (part[s].poly) {
+            int d = count_poly_mul(tmp + (size_t)nlow * stride, tmp, nlow - 1, part[s].poly, part[s].deg, nlow - 1,
+                                   stride, acc, p);
+            for (int k = 0; k <= d; k++) {
+                for (int n = k; n <= d; n++) {
+                    uint32_t *e = &low[(size_t)k * stride + n];
+                    *e = mod_add(*e, tmp[(size_t)(nlow + k) * stride + n], p);
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < (size_t)nlow * stride; i++) {
+        if (low[i] != 0) {
+            part[parts++] = (ClassCountPart){ low, nlow - 1, -1, 0, 0, 1 };
+            break;
+        }
+    }
+    return parts;
+}
+
+/**
+ * @brief [x^steps] of g(x)^e sum_k k! P_k(x) / (1 - beta g(x))^(k+1), where
+ * P_k is row k of poly and g(x) = x / (1 + x) (x without no-repeat).
+ * With c = beta - 1, g^e / (1 - beta g)^(k+1) is x^e (1 + x)^(k+1-e) /
+ * (1 - c x)^(k+1), whose coefficients follow from those for k - 1 as
+ * f_k[r] = f_(k-1)[r] + f_(k-1)[r-1] + c f_k[r-1] (without no-repeat, x^e /
+ * (1 - beta x)^(k+1), and the middle term drops). Only the deg + 1
+ * coefficients the rows reach are kept, the one below them taken from the
+ * closed form sum_i C(k+1-e, i) C(r-i+k, k) c^(r-i), so the cost does not
+ * grow with the steps.
+ * @param fact Factorials and their inverses up to steps + deg.
+ * @param f Scratch, deg + 2 words.
+ * @param pw Scratch, deg + 3 words.
+ */
+static uint32_t count_term(const uint32_t *poly, int deg, int stride, uint32_t beta, int e, int steps,
+                           int no_repeat, const uint32_t *fact, const uint32_t *inv_fact, uint32_t *f,
+                           uint32_t *pw, uint32_t p) {
+    uint32_t ratio = no_repeat ? mod_sub(beta, 1, p) : beta, total = 0;
+    uint32_t ratio_shoup = mod_shoup(ratio, p);
+    int lo = steps - e - deg; // f[i] holds coefficient lo - 1 + i
+    int base = lo - 1 - (deg + 1) > 0 ? lo - 1 - (deg + 1) : 0;
+    pw[0] = mod_pow(ratio, (uint32_t)base, p); // pw[i] = ratio^(base + i)
+    for (int i = 1; i <= deg + 2; i++) pw[i] = mod_mul(pw[i - 1], ratio, p);
+    uint32_t now = lo - 1 > 0 ? mod_pow(ratio, (uint32_t)(lo - 1), p) : 1; // c^r from the first r >= 0
+    uint32_t before = lo - 1 > 0 ? mod_pow(ratio, (uint32_t)(lo - 2), p) : 0;
+    uint32_t inv_beta = mod_pow(beta, p - 2, p);
+    for (int i = 0; i <= deg + 1; i++) { // k = 0: (1 + x)^(1-e) / (1 - c x), or 1 / (1 - beta x)
+        int r = lo - 1 + i;
+        if (r < 0) {
+            f[i] = 0;
+            continue;
+        }
+        uint32_t next = mod_mul(now, ratio, p);
+        if (!no_repeat || e == 1) f[i] = now;
+        else if (e == 0) f[i] = mod_add(now, before, p);
+        else f[i] = mod_mul(r % 2 ? mod_sub(next, 1, p) : mod_add(next, 1, p), inv_beta, p); // 1 / ((1 + x)(1 - c x))
+        before = now;
+        now = next;
+    }
+    for (int k = 0; k <= deg; k++) {
+        if (k > 0) {
+            // The coefficient below the window, then the window from the one for k - 1
+            int r = lo - 1, a = no_repeat ? k + 1 - e : 0;
+            uint64_t sum = 0;
+            for (int i = 0; i <= a && i <= r; i++) {
+                uint32_t term = mod_mul(mod_mul(inv_fact[i], inv_fact[a - i], p),
+                                        mod_mul(fact[r - i + k], inv_fact[r - i], p), p);
+                sum += (uint64_t)term * pw[r - i - base];
+                sum = MOD_LAZY(sum, p);
+            }
+            uint32_t below = f[0];
+            f[0] = mod_mul(mod_mul((uint32_t)(sum % p), fact[a], p), inv_fact[k], p);
+            for (int i = 1; i <= deg + 1; i++) {
+                uint32_t old = f[i];
+                uint32_t y = no_repeat ? mod_add(old, below, p) : old;
+                f[i] = mod_add(y, mod_mul_shoup(f[i - 1], ratio, ratio_shoup, p), p);
+                below = old;
+            }
+        }
+        uint64_t sum = 0;
+        for (int n = k; n <= deg; n++) { // [x^(steps-n)] is f at steps - e - n
+            sum += (uint64_t)poly[(size_t)k * stride + n] * f[deg + 1 - n];
+            sum = MOD_LAZY(sum, p);
+        }
+        total = mod_add(total, mod_mul((uint32_t)(sum % p), fact[k], p), p);
+    }
+    return total;
+}
+
+/**
+ * @brief Residue updates count_by_class() spends, to weigh it against the tables.
+ */
+static double count_by_class_work(const PasswordCounter *pc, long target) {
+    const PasswordRequirements *reqs = &pc->reqs;
+    double s = pc->steps + 1.0, w = reqs->req_palindrome ? 2.0 : 1.0;
+    double primes = pc->steps * 657 / 2990 + 1;
+    int mins[4] = { reqs->min_uppercase, reqs->min_lowercase, reqs->min_symbols, reqs->min_digits };
+    double deg = 1.0, terms = pc->centre ? 5.0 : 1.0, digits = 0.0;
+    for (int a = 0; a < 4; a++) {
+        if (mins[a] > 0) {
+            deg += mins[a] / w + 1.0;
+            terms *= 2.0;
+        }
+    }
+    if (reqs->req_digit_sum) {
+        double sums = (double)target + 10.0, x = fmin(s, sums / w + 1.0);
+        deg += x;
+        terms *= pc->centre ? 2.0 : 1.0;
+        digits = pc->no_repeat ? 9.0 * x * x * sums : 10.0 * x * x;
+    }
+    deg = fmin(deg, s);
+    return primes * (digits + terms * deg * (deg * deg / 4.0 + s));
+}
+
+/**
+ * @brief Counts what password_counter_init() counts without its tables: a
+ * series per class instead of a state per need vector (see above).
+ * @param pc A counter past password_counter_init()'s early checks.
+ * @param target Digit sum owed (0 without the rule).
+ * @param rows pc's digit-sum rows, built here as far as they are needed.
+ * @param out Receives the count, pc->limbs words.
+ * @return 0 on success, -1 over COUNT_WORK_BUDGET or COUNT_TABLE_BUDGET, or
+ * if memory runs out.
+ */
+static int count_by_class(const PasswordCounter *pc, long target, DigitSumRows *rows, uint64_t *out) {
+    const PasswordRequirements *reqs = &pc->reqs;
+    int steps = pc->steps, s1 = steps + 1;
+    int w = reqs->req_palindrome ? 2 : 1;
+    int digit_sum = reqs->req_digit_sum;
+    int sums = digit_sum ? (int)target + (pc->centre ? 10 : 1) : 1;
+    int primes = pc->steps * 657 / 2990 + 1; // 95^steps < 2^(6.57 steps), and each prime is above 2^29.9
+    int mins[5] = { reqs->min_uppercase, reqs->min_lowercase, reqs->min_symbols, 0, reqs->min_digits };
+
+    if (count_by_class_work(pc, target) > (double)COUNT_WORK_BUDGET) return -1;
+    // Nonzero digits raise the sum by w or more a step, so they take at most
+    // (sums - 1) / w steps; every polynomial stays below the minimums plus that
+    int reach = digit_sum ? ((sums - 1) / w < steps ? (sums - 1) / w : steps) : 0;
+    int deg = reach + 1;
+    for (int c = 0; c < 5; c++) deg += mins[c] > 0 ? mins[c] / w + 1 : 0;
+    if (deg > steps) deg = steps;
+    int stride = deg + 1;
+    size_t poly_words = (size_t)stride * stride;
+    size_t words = 2 * ((size_t)s1 + stride) + 2 * (size_t)stride + 3 + (size_t)(reach + 1) * (sums * 2 + 10) +
+                   18 * (size_t)sums + poly_words * 20;
+    if (words / 2 + poly_words + sums > COUNT_TABLE_BUDGET) return -1;
+    if (digit_sum && !pc->no_repeat && digit_sum_rows_reserve(rows, reach) != 0) return -1;
+    uint32_t *mem = malloc(words * sizeof(uint32_t));
+    uint64_t *acc = malloc((poly_words + sums) * sizeof(uint64_t)), *sum_row = acc + poly_words;
+    uint32_t *residue = malloc((size_t)primes * 2 * sizeof(uint32_t));
+    uint64_t *x = malloc((size_t)pc->limbs * sizeof(uint64_t));
+    uint64_t *next = malloc((size_t)pc->limbs * sizeof(uint64_t));
+    if (mem == NULL || acc == NULL || residue == NULL || x == NULL || next == NULL) {
+        free(mem);
+        free(acc);
+        free(residue);
+        free(x);
+        free(next);
+        return -1;
+    }
+    uint32_t *fact = mem, *inv_fact = fact + s1 + stride, *f = inv_fact + s1 + stride, *pw = f + stride + 1;
+    uint32_t *runs = pw + stride + 2, *runs_next = runs + (size_t)(reach + 1) * sums; // [steps][sum]
+    uint32_t *block_rows = runs_next + (size_t)(reach + 1) * sums;            // Per digit, two rows of sums
+    uint32_t *ways = block_rows + 18 * (size_t)sums;    // [k][10]: rows' residues at the sums E takes
+    uint32_t *digits = ways + (size_t)(reach + 1) * 10; // E, then E with a nonzero centre block
+    uint32_t *lows = digits + 2 * poly_words;           // Per class, plain and holding the outside block
+    uint32_t *level = lows + 10 * poly_words;           // Products of the parts chosen so far
+    uint32_t *tmp = level + 6 * poly_words;             // Two polynomials' scratch
+    uint32_t *modulus = residue + primes;
+    uint32_t p = 1u << 30 | 1;
+
+    for (int q = 0; q < primes; q++) {
+        p = count_prime_below(p);
+        modulus[q] = p;
+        uint64_t inv = UINT64_MAX / p;
+        fact[0] = 1;
+        for (int i = 1; i <= steps + deg; i++) fact[i] = mod_mul(fact[i - 1], (uint32_t)i, p);
+        inv_fact[steps + deg] = mod_pow(fact[steps + deg], p - 2, p);
+        for (int i = steps + deg; i > 0; i--) inv_fact[i - 1] = mod_mul(inv_fact[i], (uint32_t)i, p);
+
+        // Signed sequences of k nonzero digit blocks: E[k][n] / k! over n steps
+        // add up to the target; with a nonzero centre block last (its digit
+        // counting once, so the blocks add up to target + digit) the other k
+        const uint32_t *digit_polys[2] = { digits, digits + poly_words };
+        if (digit_sum && !pc->no_repeat) {
+            // Blocks are single digits, so n = k, and k nonzero digits adding up
+            // to a sum are sum_i (-1)^i C(k, i) D_(k-i)(sum) by how many of k
+            // digits from 0-9 are zeros. Column 0 is the target, column d the
+            // regular digits around a centre d (w = 2 whenever there is one)
+            uint32_t *e0 = digits, *ec = digits + poly_words;
+            int at[10];
+            at[0] = target % w == 0 ? (int)target / w : -1;
+            for (int d = 1; d <= 9; d++) at[d] = pc->centre && target >= d && (target - d) % 2 == 0 ? (int)(target - d) / 2 : -1;
+            memset(digits, 0, 2 * poly_words * sizeof(uint32_t));
+            for (int k = 0; k <= reach; k++) {
+                for (int d = 0; d <= 9; d++) {
+                    ways[k * 10 + d] = at[d] < 0 ? 0 : count_residue(digit_sum_ways(rows, k, at[d]), rows->limbs, p);
+                }
+            }
+            for (int k = 0; k <= reach; k++) {
+                uint32_t nonzero[10] = { 0 };
+                for (int i = 0; i <= k; i++) {
+                    uint32_t choose = mod_mul(fact[k], mod_mul(inv_fact[i], inv_fact[k - i], p), p);
+                    if (i % 2 == 1) choose = p - choose;
+                    for (int d = 0; d <= 9; d++) {
+                        nonzero[d] = mod_add(nonzero[d], mod_mul(choose, ways[(k - i) * 10 + d], p), p);
+                    }
+                }
+                if (k <= deg) e0[(size_t)k * stride + k] = mod_mul(nonzero[0], inv_fact[k], p);
+                if (pc->centre && k + 1 <= reach && k + 1 <= deg) {
+                    uint32_t *e = &ec[(size_t)k * stride + k + 1];
+                    for (int d = 1; d <= 9; d++) *e = mod_add(*e, mod_mul(nonzero[d], inv_fact[k], p), p);
+                }
+            }
+        } else if (digit_sum) {
+            uint32_t *e0 = digits, *ec = digits + poly_words;
+            memset(digits, 0, 2 * poly_words * sizeof(uint32_t));
+            memset(runs, 0, (size_t)(reach + 1) * sums * sizeof(uint32_t));
+            runs[0] = 1;
+            e0[0] = target == 0;
+            for (int k = 1; k <= reach; k++) {
+                memset(runs_next, 0, (size_t)(reach + 1) * sums * sizeof(uint32_t));
+                memset(block_rows, 0, 18 * (size_t)sums * sizeof(uint32_t));
+                for (int n = k; n <= reach; n++) {
+                    // A last block of d over n steps: one more d after k - 1 blocks, less a longer
+                    // block (the previous step's, in the other row of d). Sums below w n are out of reach
+                    const uint32_t *before = runs + (size_t)(n - 1) * sums;
+                    uint32_t *row = runs_next + (size_t)n * sums;
+                    int lo = w * n;
+                    memset(sum_row, 0, (size_t)sums * sizeof(uint64_t));
+                    for (int d = 1; d <= 9; d++) {
+                        uint32_t *cur = block_rows + (2 * (d - 1) + n % 2) * sums;
+                        const uint32_t *prev = block_rows + (2 * (d - 1) + (n + 1) % 2) * sums;
+                        int shift = w * d;
+                        for (int s = n == k ? 0 : w * (n - 2); s < lo || (s < shift && s < sums); s++) cur[s] = 0;
+                        for (int s = lo > shift ? lo : shift; s < sums; s++) {
+                            uint32_t v = before[s - shift];
+                            cur[s] = pc->no_repeat ? mod_sub(v, prev[s - shift], p) : v;
+                            sum_row[s] += cur[s];
+                        }
+                        if (pc->centre && n <= deg) {
+                            uint32_t *e = &ec[(size_t)(k - 1) * stride + n];
+                            *e = mod_add(*e, mod_mul(cur[target + d], inv_fact[k - 1], p), p);
+                        }
+                    }
+                    for (int s = lo; s < sums; s++) row[s] = mod_reduce(sum_row[s], p, inv);
+                }
+                for (int n = k; n <= reach && n <= deg; n++) {
+                    e0[(size_t)k * stride + n] = mod_mul(runs_next[(size_t)n * sums + target], inv_fact[k], p);
+                }
+                uint32_t *swap = runs;
+                runs = runs_next;
+                runs_next = swap;
+            }
+        }
+
+        // Every class is its full series less its low part; expanding the
+        // product, each choice of parts is a polynomial (the low parts' and
+        // E's product) times the exponential of the other classes' blocks
+        ClassCountPart parts[2][5][3];
+        int nparts[2][5];
+        for (int c = 0; c < 5; c++) {
+            for (int outside = 0; outside < 2; outside++) {
+                int low_deg;
+                const uint32_t **dp = c == COUNT_DIGIT && digit_sum ? digit_polys : NULL;
+                if (outside && dp && !pc->centre) {
+                    nparts[outside][c] = 0;
+                    continue;
+                }
+                nparts[outside][c] = count_class_parts(parts[outside][c], pc, c, outside, outside && pc->centre,
+                                                       dp, reach < deg ? reach : deg,
+                                                       lows + (size_t)(2 * c + outside) * poly_words, &low_deg,
+                                                       fact, inv_fact, stride, acc, tmp, p);
+            }
+        }
+
+        // Digits first: their polynomial is the largest, and later factors multiply each choice made before
+        static const int order[5] = { COUNT_DIGIT, 0, 1, 2, COUNT_SPACE };
+        uint32_t total = 0;
+        for (int held = pc->centre ? 0 : -1; held < (pc->centre ? 5 : 0); held++) {
+            // The classes whose block stands outside: the first and last under start-end, or the centre's
+            int outside[5] = { 0 };
+            if (held >= 0) outside[held] = 1;
+            if (reqs->req_start_upper_end_symbol) outside[0] = outside[2] = 1;
+            int choice[5] = { 0 }, from = 0;
+            const uint32_t *poly[6];
+            int poly_deg[6], sign[6], e[6];
+            uint32_t beta[6], scale[6];
+            level[0] = 1;
+            poly[0] = level;
+            poly_deg[0] = 0;
+            sign[0] = 1;
+            e[0] = 0;
+            beta[0] = 0;
+            scale[0] = 1;
+            for (;;) {
+                for (int i = from; i < 5; i++) {
+                    int c = order[i];
+                    const ClassCountPart *part = &parts[outside[c]][c][choice[i]];
+                    if (part->poly == NULL) {
+                        poly[i + 1] = poly[i];
+                        poly_deg[i + 1] = poly_deg[i];
+                    } else {
+                        uint32_t *into = level + (size_t)(i + 1) * poly_words;
+                        poly_deg[i + 1] = count_poly_mul(into, poly[i], poly_deg[i], part->poly, part->deg, deg,
+                                                         stride, acc, p);
+                        poly[i + 1] = into;
+                    }
+                    sign[i + 1] = sign[i] * part->sign;
+                    e[i + 1] = e[i] + part->e;
+                    beta[i + 1] = mod_add(beta[i], part->beta, p);
+                    scale[i + 1] = mod_mul(scale[i], part->scale, p);
+                }
+                uint32_t term = mod_mul(scale[5], count_term(poly[5], poly_deg[5], stride, beta[5], e[5], steps,
+                                                              pc->no_repeat, fact, inv_fact, f, pw, p), p);
+                total = sign[5] > 0 ? mod_add(total, term, p) : mod_sub(total, term, p);
+                int i = 4;
+                while (i >= 0 && ++choice[i] == nparts[outside[order[i]]][order[i]]) choice[i--] = 0;
+                if (i < 0) break;
+                from = i;
+            }
+        }
+        residue[q] = total;
+    }
+
+    // Garner's mixed-radix digits, then Horner over the moduli; every partial
+    // value is at most the count, so limbs words hold it
+    for (int i = 1; i < primes; i++) {
+        uint32_t pi = modulus[i];
+        for (int j = 0; j < i; j++) {
+            residue[i] = mod_mul(mod_sub(residue[i], residue[j] % pi, pi), mod_pow(modulus[j] % pi, pi - 2, pi), pi);
+        }
+    }
+    memset(x, 0, (size_t)pc->limbs * sizeof(uint64_t));
+    for (int i = primes - 1; i >= 0; i--) {
+        uint64_t carry = residue[i];
+        memset(next, 0, (size_t)pc->limbs * sizeof(uint64_t));
+        count_addmul(next, x, modulus[i], pc->limbs);
+        for (int j = 0; j < pc->limbs && carry != 0; j++) {
+            next[j] += carry;
+            carry = next[j] < carry;
+        }
+        memcpy(x, next, (size_t)pc->limbs * sizeof(uint64_t));
+    }
+    memcpy(out, x, (size_t)pc->limbs * sizeof(uint64_t));
+    free(mem);
+    free(acc);
+    free(residue);
+    free(x);
+    free(next);
+    return 0;
+}
+
+/*
+ * Sampling past the tables. Without no-repeat a password is its characters
+ * outside the shuffle (start-end's first and last, a palindrome's centre),
+ * how many of the other steps each class takes, where those go, and what
+ * they are; only the class counts interact, through the minimums and the
+ * digit sum. So rest[c][r], the ways r steps can be filled from classes c
+ * onwards meeting what each still owes, is the sum over n of C(r, n)
+ * size^n rest[c + 1][r - n], with the digits' last column taken from
+ * DigitSumRows. Drawing from that superset and redrawing every password
+ * with a repeat is uniform over the policy. At a round's own length the
+ * superset is at most 1.85 times the policy, so under half the draws are
+ * redrawn.
+ */
+
+/**
+ * @brief What the shuffled steps owe under option o for the characters
+ * outside the shuffle (the centre's class, then its digit under a digit sum).
+ * @param need Receives, per class, the steps it must still take.
+ * @param offered Receives how many ways o leaves for the characters outside the shuffle.
+ * @return The digit sum the shuffled digits owe, in steps of w; -1 if o can't make it.
+ */
+static long count_superset_needs(const PasswordCounter *pc, int o, int need[5], int *offered) {
+    const PasswordRequirements *reqs = &pc->reqs;
+    int w = reqs->req_palindrome ? 2 : 1;
+    int mins[5] = { reqs->min_uppercase, reqs->min_lowercase, reqs->min_symbols, 0, reqs->min_digits };
+    long owed = reqs->req_digit_sum ? reqs->digit_sum_target : 0;
+    *offered = 1;
+    if (reqs->req_start_upper_end_symbol) {
+        mins[0]--;
+        mins[2]--;
+        *offered = count_class_size[0] * count_class_size[2];
+    }
+    if (pc->centre) {
+        int c = o < COUNT_DIGIT ? o : COUNT_DIGIT;
+        mins[c]--;
+        if (c == COUNT_DIGIT && reqs->req_digit_sum) owed -= o - COUNT_DIGIT;
+        else *offered = count_class_size[c];
+    }
+    for (int c = 0; c < 5; c++) need[c] = mins[c] > 0 ? (mins[c] + w - 1) / w : 0;
+    return owed >= 0 && owed % w == 0 ? owed / w : -1;
+}
+
+/**
+ * @brief Prepares count_superset_sample() for a counter whose root was
+ * counted without tables: the superset's rest counts for every centre option.
+ * @return 0 on success, -1 over COUNT_TABLE_BUDGET, if the superset holds
+ * over COUNT_SUPERSET_DRAWS times the policy's passwords, or if memory runs out.
+ */
+static int count_superset_init(PasswordCounter *pc) {
+    int limbs = pc->limbs, f = pc->steps - (pc->centre ? 1 : 0) - (pc->reqs.req_start_upper_end_symbol ? 2 : 0);
+    int options = !pc->centre ? 1 : pc->reqs.req_digit_sum ? COUNT_DIGIT + 10 : 5;
+    size_t row = (size_t)(f + 1) * limbs;
+    if ((size_t)options * 5 * row + (options + 1 + (size_t)f + 1) * limbs > COUNT_TABLE_BUDGET) return -1;
+    if (pc->reqs.req_digit_sum && digit_sum_rows_reserve(&pc->digit_rows, f) != 0) return -1;
+    pc->options = options;
+    pc->free_steps = f;
+    pc->rest = calloc((size_t)options * 5 * row, sizeof(uint64_t));
+    pc->superset = calloc((size_t)(options + 1) * limbs, sizeof(uint64_t));
+    uint64_t *scaled = malloc(row * sizeof(uint64_t)); // C(r, n) size^n for one r, by n
+    if (pc->rest == NULL || pc->superset == NULL || scaled == NULL) {
+        free(scaled);
+        return -1;
+    }
+
+    uint64_t *all = pc->superset + (size_t)options * limbs;
+    for (int o = 0; o < options; o++) {
+        int need[5], offered;
+        long owed = count_superset_needs(pc, o, need, &offered);
+        uint64_t *rest = pc->rest + (size_t)o * 5 * row;
+        if (owed < 0) continue;
+        uint64_t *digits = rest + (size_t)COUNT_DIGIT * row;
+        for (int r = 0; r <= f; r++) {
+            uint64_t *e = digits + (size_t)r * limbs;
+            if (pc->reqs.req_digit_sum) {
+                if (r >= need[COUNT_DIGIT]) {
+                    memcpy(e, digit_sum_ways(&pc->digit_rows, r, (int)owed), pc->digit_rows.limbs * sizeof(uint64_t));
+                }
+            } else if (r == 0) {
+                e[0] = 1;
+            } else {
+                count_addmul(e, e - limbs, 10, limbs);
+            }
+        }
+        memset(digits, 0, (size_t)need[COUNT_DIGIT] * limbs * sizeof(uint64_t));
+        for (int c = COUNT_DIGIT - 1; c >= 0; c--) {
+            memset(scaled, 0, row * sizeof(uint64_t));
+            scaled[0] = 1;
+            for (int r = 0; r <= f; r++) {
+                for (int n = r; n > 0; n--) {
+                    count_addmul(scaled + (size_t)n * limbs, scaled + (size_t)(n - 1) * limbs,
+                                 (uint64_t)count_class_size[c], limbs);
+                }
+                for (int n = need[c]; n <= r; n++) {
+                    count_mul_add(rest + (size_t)c * row + (size_t)r * limbs, scaled + (size_t)n * limbs,
+                                  rest + (size_t)(c + 1) * row + (size_t)(r - n) * limbs, limbs);
+                }
+            }
+        }
+        count_addmul(pc->superset + (size_t)o * limbs, rest + (size_t)f * limbs, (uint64_t)offered, limbs);
+        count_add(all, pc->superset + (size_t)o * limbs, limbs);
+    }
+    free(scaled);
+    return count_log2(all, limbs) - count_log2(pc->root, limbs) > log2(COUNT_SUPERSET_DRAWS) ? -1 : 0;
+}
+
+/**
+ * @brief password_counter_init() short of sampling past the table budget:
+ * with keep_tables, -1 once the tables would exceed it.
+ */
+static int count_tables_init(PasswordCounter *pc, const PasswordRequirements *reqs, size_t length,
+                             int keep_tables) {
+    memset(pc, 0, sizeof(*pc));
+    pc->reqs = *reqs;
+    pc->length = length;
+    pc->no_repeat = reqs->req_no_consecutive_chars;
+
+    int palindrome = reqs->req_palindrome;
+    size_t steps = palindrome ? (length + 1) / 2 : length;
+    size_t limbs = steps * 657 / 6400 + 1; // 95^steps < 2^(6.57 * steps)
+    if ((steps + 1) * limbs > COUNT_TABLE_BUDGET) return -1;
+    pc->steps = (int)steps;
+    pc->centre = palindrome && length % 2 == 1;
+    pc->limbs = (int)limbs;
+    pc->zero = calloc(limbs, sizeof(uint64_t));
+    if (pc->zero == NULL) return -1;
+    pc->root = pc->zero;
+
+    long target = reqs->req_digit_sum ? reqs->digit_sum_target : 0;
+    if (length < (size_t)(reqs->min_length > 0 ? reqs->min_length : 0) ||
+        target < 0 || (size_t)target > 9 * length ||
+        (reqs->req_digit_sum && reqs->min_digits == 0 && target != 0) || // As check_features() rules
+        (reqs->req_start_upper_end_symbol && (palindrome || length < 2)) || // First = last for palindromes
+        (palindrome && pc->no_repeat && length % 2 == 0 && length > 0)) {   // The middle pair repeats
+        return 0;
+    }
+
+    int mins[4] = { reqs->min_uppercase, reqs->min_lowercase, reqs->min_symbols, reqs->min_digits };
+    size_t vectors = 1;
+    for (int a = 0; a < 4; a++) {
+        pc->radix[a] = (mins[a] > 0 ? mins[a] : 0) + 1;
+        pc->stride[a] = (int)vectors;
+        vectors *= (size_t)pc->radix[a];
+        if (vectors > COUNT_TABLE_BUDGET) return -1;
+    }
+    pc->vectors = (int)vectors;
+    pc->digit_lasts = pc->no_repeat && reqs->req_digit_sum ? 10 : 1;
+    pc->lasts = pc->no_repeat ? 5 + pc->digit_lasts : 1;
+    pc->sums = (int)target + 1;
+    if (reqs->req_digit_sum) digit_sum_rows_init(&pc->digit_rows, (int)steps + 1, (int)target / (palindrome ? 2 : 1) + 1);
+
+    // Without tables to keep, count per class when that is the cheaper way (a
+    // table word costs about a tenth of a residue update, and fewer get touched)
+    double table_words = (double)steps * vectors * pc->lasts * pc->sums * limbs * (15.0 + pc->lasts);
+    if (!keep_tables && table_words > 10.0 * count_by_class_work(pc, target)) {
+        pc->counts = calloc(limbs, sizeof(uint64_t));
+        if (pc->counts == NULL || count_by_class(pc, target, &pc->digit_rows, pc->counts) != 0) {
+            password_counter_free(pc);
+            return -1;
+        }
+        pc->root = pc->counts;
+        return 0;
+    }
+
+    // Layers keep the vectors reachable from the minimums that can still reach zero
+    unsigned char *reach = calloc((steps + 1) * vectors, 1);
+    unsigned char *feasible = calloc((steps + 1) * vectors, 1);
+    pc->rank = malloc((steps + 1) * vectors * sizeof(int32_t));
+    pc->layer_offset = malloc((steps + 2) * sizeof(size_t));
+    uint64_t *acc = malloc((size_t)pc->sums * limbs * sizeof(uint64_t));
+    int status = -1;
+    if (reach == NULL || feasible == NULL || pc->rank == NULL || pc->layer_offset == NULL || acc == NULL) {
+        goto done;
+    }
+    reach[vectors - 1] = 1;
+    for (int i = 0; i < pc->steps; i++) {
+        unsigned mask = count_step_mask(pc, i);
+        int w = count_step_weight(pc, i);
+        for (int v = 0; v < pc->vectors; v++) {
+            if (!reach[i * vectors + v]) continue;
+            for (int c = 0; c < 5; c++) {
+                if (mask >> c & 1) reach[(i + 1) * vectors + count_next_vector(pc, v, c, w)] = 1;
+            }
+        }
+    }
+    feasible[steps * vectors] = 1;
+    for (int i = pc->steps - 1; i >= 0; i--) {
+        unsigned mask = count_step_mask(pc, i);
+        int w = count_step_weight(pc, i);
+        for (int v = 0; v < pc->vectors; v++) {
+            for (int c = 0; c < 5 && !feasible[i * vectors + v]; c++) {
+                if (mask >> c & 1) feasible[i * vectors + v] = feasible[(i + 1) * vectors + count_next_vector(pc, v, c, w)];
+            }
+        }
+    }
+    size_t total = 0, widest = 0;
+    size_t entry = (size_t)pc->lasts * pc->sums;
+    for (size_t i = 0; i <= steps; i++) {
+        int32_t next = 0;
+        pc->layer_offset[i] = total;
+        for (size_t v = 0; v < vectors; v++) {
+            pc->rank[i * vectors + v] = reach[i * vectors + v] && feasible[i * vectors + v] ? next++ : -1;
+        }
+        total += (size_t)next * entry;
+        if ((size_t)next * entry > widest) widest = (size_t)next * entry;
+        if ((keep_tables ? total : 2 * widest) * limbs > COUNT_TABLE_BUDGET) goto done;
+    }
+    pc->layer_offset[steps + 1] = total;
+    if (!keep_tables) {
+        for (size_t i = 0; i <= steps + 1; i++) pc->layer_offset[i] = i % 2 * widest;
+        total = 2 * widest;
+    }
+    if (pc->rank[vectors - 1] < 0) { // Minimums out of reach at this length
+        status = 0;
+        goto done;
+    }
+    pc->counts = malloc((total + 1) * limbs * sizeof(uint64_t));
+    if (pc->counts == NULL) goto done;
+
+    // The last layer holds only the zero vector: done once the digit sum is paid off
+    for (int l = 0; l < pc->lasts; l++) {
+        for (int s = 0; s < pc->sums; s++) {
+            uint64_t *e = count_entry(pc, pc->steps, 0, l, s);
+            memset(e, 0, limbs * sizeof(uint64_t));
+            e[0] = s == 0;
+        }
+    }
+    for (int i = pc->steps - 1; i >= 0; i--) {
+        unsigned mask = count_step_mask(pc, i);
+        int w = count_step_weight(pc, i);
+        const int32_t *below = pc->rank + (size_t)(i + 1) * vectors;
+        for (int v = 0; v < pc->vectors; v++) {
+            int r = pc->rank[(size_t)i * vectors + v];
+            if (r < 0) continue;
+            int next[5];
+            for (int c = 0; c < 5; c++) {
+                next[c] = mask >> c & 1 ? below[count_next_vector(pc, v, c, w)] : -1;
+            }
+            // Every character of every allowed class, ignoring the previous character...
+            memset(acc, 0, (size_t)pc->sums * limbs * sizeof(uint64_t));
+            for (int s = 0; s < pc->sums; s++) {
+                uint64_t *a = acc + (size_t)s * limbs;
+                for (int c = 0; c < COUNT_DIGIT; c++) {
+                    if (next[c] >= 0) {
+                        count_addmul(a, count_entry(pc, i + 1, next[c], count_slot(pc, c, 0), s),
+                                     (uint64_t)count_class_size[c], pc->limbs);
+                    }
+                }
+                if (next[COUNT_DIGIT] < 0) continue;
+                if (!reqs->req_digit_sum) {
+                    count_addmul(a, count_entry(pc, i + 1, next[COUNT_DIGIT], count_slot(pc, COUNT_DIGIT, 0), s),
+                                 10, pc->limbs);
+                    continue;
+                }
+                for (int d = 0; d <= 9 && s - w * d >= 0; d++) {
+                    count_add(a, count_entry(pc, i + 1, next[COUNT_DIGIT], count_slot(pc, COUNT_DIGIT, d),
+                                             s - w * d), pc->limbs);
+                }
+            }
+            // ...less, under no-repeat, the one character equal to the previous
+            for (int l = i == 0 ? 0 : pc->lasts > 1; l < (i == 0 ? 1 : pc->lasts); l++) {
+                int c = l <= 4 ? l - 1 : COUNT_DIGIT;
+                for (int s = 0; s < pc->sums; s++) {
+                    uint64_t *e = count_entry(pc, i, r, l, s);
+                    const uint64_t *a = acc + (size_t)s * limbs;
+                    int owed = s - (c == COUNT_DIGIT && pc->digit_lasts == 10 ? w * (l - 5) : 0);
+                    if (l > 0 && next[c] >= 0 && owed >= 0) {
+                        count_sub(e, a, count_entry(pc, i + 1, next[c], l, owed), pc->limbs);
+                    } else {
+                        memcpy(e, a, limbs * sizeof(uint64_t));
+                    }
+                }
+            }
+        }
+    }
+    pc->root = count_entry(pc, 0, pc->rank[vectors - 1], 0, pc->sums - 1);
+    pc->kept = keep_tables;
+    status = 0;
+
+done:
+    free(reach);
+    free(feasible);
+    free(acc);
+    if (status != 0) password_counter_free(pc);
+    return status;
+}
+
+/**
+ * @brief Counts the passwords of exactly length characters (printable ASCII)
+ * that satisfy reqs, keeping the completion tables for later lookups.
+ * Needs are capped at the minimums and only states that are both reachable
+ * and completable are stored, so cost follows how tight the policy is.
+ * @param pc Receives the counter; release with password_counter_free().
+ * @param reqs The requirements (copied; utf8 makes no difference to ASCII).
+ * @param length Password length.
+ * @param keep_tables Non-zero to keep every layer (for walking the tables
+ * afterwards); otherwise only two are held at a time.
+ * Without keep_tables, policies whose tables would cost more are counted
+ * per class by count_by_class() instead, leaving only the root. With it,
+ * those policies, and any whose tables would exceed COUNT_TABLE_BUDGET,
+ * are counted the same way and sampled from the policy less no-repeat
+ * instead (count_superset_init()).
+ * @return 0 on success (the count is pc->root, pc->limbs words), -1 if the
+ * tables would exceed COUNT_TABLE_BUDGET (or the per-class count
+ * COUNT_WORK_BUDGET) and there is no way past them, or memory runs out.
+ */
+int password_counter_init(PasswordCounter *pc, const PasswordRequirements *reqs, size_t length,
+                          int keep_tables) {
+    if (!keep_tables) return count_tables_init(pc, reqs, length, 0);
+    // Sample past the tables when the root is counted per class anyway...
+    int status = count_tables_init(pc, reqs, length, 0);
+    if (status == 0 && (count_is_zero(pc->root, pc->limbs) || (pc->rank == NULL && count_superset_init(pc) == 0))) {
+        return 0;
+    }
+    password_counter_free(pc);
+    if (count_tables_init(pc, reqs, length, 1) == 0) return 0;
+    // ...or when every layer would not fit
+    password_counter_free(pc);
+    if (status != 0 || count_tables_init(pc, reqs, length, 0) != 0 || count_superset_init(pc) != 0) {
+        password_counter_free(pc);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Releases a counter's tables.
+ */
+void password_counter_free(PasswordCounter *pc) {
+    free(pc->rank);
+    free(pc->layer_offset);
+    free(pc->counts);
+    free(pc->zero);
+    free(pc->digit_rows.ways);
+    free(pc->rest);
+    free(pc->superset);
+    memset(&pc->digit_rows, 0, sizeof(pc->digit_rows));
+    pc->rest = NULL;
+    pc->superset = NULL;
+    pc->rank = NULL;
+    pc->layer_offset = NULL;
+    pc->counts = NULL;
+    pc->zero = NULL;
+    pc->root = NULL;
+}
+
+/**
+ * @brief Uniform count in [0, bound), bound non-zero, by rejection on its bit length.
+ */
+static void count_random_below(uint64_t *x, const uint64_t *bound, int limbs, uint64_t *rng) {
+    int top = limbs - 1;
+    while (bound[top] == 0) top--;
+    uint64_t mask = bound[top];
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+    mask |= mask >> 32;
+    memset(x, 0, (size_t)limbs * sizeof(uint64_t));
+    for (;;) {
+        for (int j = 0; j < top; j++) x[j] = rng_next(rng);
+        x[top] = rng_next(rng) & mask;
+        int j = top;
+        while (j > 0 && x[j] == bound[j]) j--;
+        if (x[j] < bound[j]) return;
+    }
+}
+
+/**
+ * @brief Uniform character from a pool, other than avoid (which may be absent).
+ */
+static inline char sample_pick(const char *pool, uint32_t size, uint64_t *rng, char avoid) {
+    const char *at = avoid ? memchr(pool, avoid, size) : NULL;
+    if (at == NULL) return pool[rng_below(rng, size)];
+    uint32_t i = rng_below(rng, size - 1);
+    return pool[i < (uint32_t)(at - pool) ? i : i + 1];
+}
+
+/**
+ * @brief Draws a password uniformly from a counter prepared by
+ * count_superset_init(): the characters outside the shuffle, the class
+ * counts by the rest counts, the classes' places by a shuffle and the
+ * digits one at a time by DigitSumRows, redrawn while two neighbours repeat.
+ */
+static int count_superset_sample(const PasswordCounter *pc, uint64_t *rng, char *out) {
+    static const char *const pools[5] = { synth_upper, synth_lower, synth_symbols, " ", "0123456789" };
+    uint64_t x[COUNT_SAMPLE_LIMBS], block[COUNT_SAMPLE_LIMBS], scaled[COUNT_SAMPLE_LIMBS];
+    uint64_t binom[COUNT_SAMPLE_LIMBS], power[COUNT_SAMPLE_LIMBS];
+    const DigitSumRows *rows = &pc->digit_rows;
+    int limbs = pc->limbs, f = pc->free_steps, o = 0;
+    size_t row = (size_t)(f + 1) * limbs;
+    char *slot = out + (pc->reqs.req_start_upper_end_symbol ? 1 : 0); // The shuffled steps
+
+    for (;;) {
+        count_random_below(x, pc->superset + (size_t)pc->options * limbs, limbs, rng);
+        for (o = 0; o < pc->options - 1 && !count_less(x, pc->superset + (size_t)o * limbs, limbs); o++) {
+            count_sub(x, x, pc->superset + (size_t)o * limbs, limbs);
+        }
+        int need[5], offered, take[5];
+        long owed = count_superset_needs(pc, o, need, &offered);
+        const uint64_t *rest = pc->rest + (size_t)o * 5 * row;
+
+        // Class counts: n of class c among r steps in C(r, n) size^n rest[c + 1][r - n] ways
+        int r = f;
+        for (int c = 0; c < COUNT_DIGIT; c++) {
+            int n = 0;
+            count_random_below(x, rest + (size_t)c * row + (size_t)r * limbs, limbs, rng);
+            memset(binom, 0, (size_t)limbs * sizeof(uint64_t));
+            memset(power, 0, (size_t)limbs * sizeof(uint64_t));
+            binom[0] = power[0] = 1;
+            for (;; n++) {
+                if (n >= need[c]) {
+                    memset(scaled, 0, (size_t)limbs * sizeof(uint64_t));
+                    memset(block, 0, (size_t)limbs * sizeof(uint64_t));
+                    count_mul_add(scaled, binom, power, limbs);
+                    count_mul_add(block, scaled, rest + (size_t)(c + 1) * row + (size_t)(r - n) * limbs, limbs);
+                    if (n == r || count_less(x, block, limbs)) break;
+                    count_sub(x, x, block, limbs);
+                }
+                count_mul_small(binom, (uint64_t)(r - n), limbs);
+                count_div_small(binom, (uint64_t)(n + 1), limbs);
+                count_mul_small(power, (uint64_t)count_class_size[c], limbs);
+            }
+            take[c] = n;
+            r -= n;
+        }
+        take[COUNT_DIGIT] = r;
+
+        // Their places, then each character; digits left to right, so k of
+        // them owing s leave D_(k-1)(s - d) ways after a d
+        int at = 0;
+        for (int c = 0; c < 5; c++) {
+            for (int n = 0; n < take[c]; n++) slot[at++] = (char)c;
+        }
+        for (int i = f - 1; i > 0; i--) {
+            uint32_t j = rng_below(rng, (uint32_t)i + 1);
+            char t = slot[i];
+            slot[i] = slot[j];
+            slot[j] = t;
+        }
+        int k = take[COUNT_DIGIT];
+        for (int i = 0; i < f; i++) {
+            int c = slot[i];
+            if (c != COUNT_DIGIT || !pc->reqs.req_digit_sum) {
+                slot[i] = pools[c][rng_below(rng, (uint32_t)count_class_size[c])];
+                continue;
+            }
+            memset(block, 0, (size_t)limbs * sizeof(uint64_t));
+            memcpy(block, digit_sum_ways(rows, k, (int)owed), (size_t)rows->limbs * sizeof(uint64_t));
+            count_random_below(x, block, limbs, rng);
+            int d = 0;
+            for (;; d++) {
+                memset(block, 0, (size_t)limbs * sizeof(uint64_t));
+                if (owed >= d) {
+                    memcpy(block, digit_sum_ways(rows, k - 1, (int)owed - d), (size_t)rows->limbs * sizeof(uint64_t));
+                }
+                if (d == 9 || count_less(x, block, limbs)) break;
+                count_sub(x, x, block, limbs);
+            }
+            slot[i] = (char)('0' + d);
+            owed -= d;
+            k--;
+        }
+
+        if (pc->reqs.req_start_upper_end_symbol) {
+            out[0] = synth_upper[rng_below(rng, 26)];
+            out[pc->length - 1] = synth_symbols[rng_below(rng, 32)];
+        }
+        if (pc->centre) {
+            int c = o < COUNT_DIGIT ? o : COUNT_DIGIT;
+            out[pc->steps - 1] = c == COUNT_DIGIT && pc->reqs.req_digit_sum
+                                     ? (char)('0' + o - COUNT_DIGIT)
+                                     : pools[c][rng_below(rng, (uint32_t)count_class_size[c])];
+        }
+        if (pc->reqs.req_palindrome) {
+            for (int i = 0; i < pc->steps; i++) out[pc->length - 1 - i] = out[i];
+        }
+        if (!pc->no_repeat) return 0;
+        size_t i = 1;
+        while (i < pc->length && out[i] != out[i - 1]) i++;
+        if (i >= pc->length) return 0;
+    }
+}
+
+/**
+ * @brief Draws a password uniformly from all that the counter counted. Each
+ * step picks a class (or digit) with probability proportional to its
+ * completions, then a character uniformly within it; O(length) steps.
+ * Counters that sample past their tables go to count_superset_sample().
+ * Safe to call from several threads on one counter.
+ * @param pc A counter built with keep_tables.
+ * @param rng RNG state (non-zero), advanced.
+ * @param out Receives pc->length bytes; not NUL-terminated.
+ * @return 0 on success, -1 if no password qualifies, the counter was built
+ * without keep_tables, or counts are wider than COUNT_SAMPLE_LIMBS.
+ */
+int password_counter_sample(const PasswordCounter *pc, uint64_t *rng, char *out) {
+    static const char *const pools[5] = { synth_upper, synth_lower, synth_symbols, " ", "0123456789" };
+    uint64_t x[COUNT_SAMPLE_LIMBS], block[COUNT_SAMPLE_LIMBS];
+    int limbs = pc->limbs;
+    int vector = pc->vectors - 1, last = 0, owed = pc->sums - 1;
+    char prev = 0;
+
+    if (limbs > COUNT_SAMPLE_LIMBS || count_is_zero(pc->root, limbs)) return -1;
+    if (!pc->kept) return pc->rest != NULL ? count_superset_sample(pc, rng, out) : -1;
+
+    for (int i = 0; i < pc->steps; i++) {
+        unsigned mask = count_step_mask(pc, i);
+        int w = count_step_weight(pc, i);
+        const int32_t *below = pc->rank + (size_t)(i + 1) * pc->vectors;
+        count_random_below(x, count_entry(pc, i, pc->rank[(size_t)i * pc->vectors + vector], last, owed),
+                           limbs, rng);
+
+        int cls = -1, digit = 0, next_rank = -1;
+        for (int c = 0; c < 5 && cls < 0; c++) {
+            if (!(mask >> c & 1)) continue;
+            int next_vector = count_next_vector(pc, vector, c, w);
+            next_rank = below[next_vector];
+            if (next_rank < 0) continue;
+            for (int d = 0; d < (c == COUNT_DIGIT && pc->reqs.req_digit_sum ? 10 : 1) && cls < 0; d++) {
+                int slot = count_slot(pc, c, d);
+                int after = owed - (c == COUNT_DIGIT ? w * d : 0);
+                if (after < 0) break;
+                // Characters of this class (or this digit) allowed after the previous one
+                uint64_t k = c == COUNT_DIGIT && pc->reqs.req_digit_sum ? 1 : (uint64_t)count_class_size[c];
+                if (pc->no_repeat && last == slot && last != 0) k--;
+                if (k == 0) continue;
+                memset(block, 0, (size_t)limbs * sizeof(uint64_t));
+                count_addmul(block, count_entry(pc, i + 1, next_rank, slot, after), k, limbs);
+                int m = limbs - 1;
+                while (m > 0 && x[m] == block[m]) m--;
+                if (x[m] < block[m]) {
+                    cls = c;
+                    digit = d;
+                    vector = next_vector;
+                    last = slot;
+                    owed = after;
+                } else {
+                    count_sub(x, x, block, limbs);
+                }
+            }
+        }
+        if (cls < 0) return -1; // Unreachable with consistent tables
+
+        char ch;
+        if (cls == COUNT_DIGIT && pc->reqs.req_digit_sum) {
+            ch = (char)('0' + digit);
+        } else {
+            ch = sample_pick(pools[cls], (uint32_t)count_class_size[cls], rng, pc->no_repeat ? prev : 0);
+        }
+        out[i] = ch;
+        if (pc->reqs.req_palindrome) out[pc->length - 1 - i] = ch;
+        prev = ch;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes a count in decimal.
+ * @param n The count, limbs little-endian words.
+ * @param limbs Words in n.
+ * @param buf Output buffer (NUL-terminated).
+ * @param size Size of buf.
+ * @return Digits written, or 0 if buf is too small or memory runs out.
+ */
+size_t count_format(const uint64_t *n, int limbs, char *buf, size_t size) {
+    const uint64_t chunk = 10000000000000000000ull; // 10^19, the largest power of ten in a limb
+    uint64_t *t = malloc((size_t)limbs * sizeof(uint64_t));
+    uint64_t *parts = malloc(((size_t)limbs * 2 + 1) * sizeof(uint64_t)); // 64 bits < 2 chunks
+    size_t count = 0, len = 0;
+    int top = limbs;
+
+    if (t == NULL || parts == NULL) {
+        free(t);
+        free(parts);
+        return 0;
+    }
+    memcpy(t, n, (size_t)limbs * sizeof(uint64_t));
+    do {
+        unsigned __int128 rem = 0;
+        while (top > 0 && t[top - 1] == 0) top--;
+        for (int j = top - 1; j >= 0; j--) {
+            rem = rem << 64 | t[j];
+            t[j] = (uint64_t)(rem / chunk);
+            rem %= chunk;
+        }
+        parts[count++] = (uint64_t)rem;
+    } while (top > 0 && !(top == 1 && t[0] == 0));
+
+    int written = snprintf(buf, size, "%llu", (unsigned long long)parts[count - 1]);
+    if (written > 0) len = (size_t)written;
+    for (size_t k = count - 1; k > 0 && len < size; k--) {
+        written = snprintf(buf + len, size - len, "%019llu", (unsigned long long)parts[k - 1]);
+        len += written > 0 ? (size_t)written : 0;
+    }
+    free(t);
+    free(parts);
+    return len < size ? len : 0;
+}
+
+/**
+ * @brief n / 2^(64 * drop) as a double, for ratios of counts too big for one.
+ */
+static double count_scaled(const uint64_t *n, int limbs, int drop) {
+    double r = 0.0;
+    for (int j = limbs - 1; j >= drop; j--) r = r * 18446744073709551616.0 + (double)n[j];
+    return r;
+}
+
+/**
+ * @brief Implements "pw --count [--round N [--seed S] | --policy SPEC] [--length L] [--to L2] [--estimate]".
+ * Prints the exact number of printable-ASCII passwords of each length from L
+ * (the policy's minimum by default) to L2 that satisfy the policy, and their
+ * share of all strings of that length. --estimate prints the leading digits
+ * instead, from password_count_estimate(), for lengths into the millions.
+ * @return Process exit status: 0 on success, 1 if a length is over the table
+ * budget (or the policy can't be estimated), 2 on bad usage.
+ */
+int run_count_mode(int argc, char *argv[]) {
+    const char *spec = NULL;
+    int round = 1;
+    int utf8 = 0;
+    int estimate = 0;
+    int usage_error = 0;
+    uint64_t seed = 0;
+    long from = -1, to = -1;
+
+    for (int i = 2; i < argc && !usage_error; i++) {
+        if (strcmp(argv[i], "--round") == 0 && i + 1 < argc) {
+            round = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            spec = argv[++i];
+        } else if (strcmp(argv[i], "--length") == 0 && i + 1 < argc) {
+            from = atol(argv[++i]);
+            if (from < 0) usage_error = 1;
+        } else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            to = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--utf8") == 0) {
+            utf8 = 1;
+        } else if (strcmp(argv[i], "--estimate") == 0) {
+            estimate = 1;
+        } else {
+            usage_error = 1;
+        }
+    }
+    if (usage_error || round < 1) {
+        fprintf(stderr, "Usage: %s --count [--round N [--seed S] | --policy SPEC] [--length L] [--to L2] [--estimate]\n", argv[0]);
+        return 2;
+    }
+
+    PasswordRequirements reqs;
+    if (policy_from_args(spec, round, seed, utf8, &reqs) != 0) {
+        return 2;
+    }
+    if (from < 0) from = reqs.min_length > 0 ? reqs.min_length : 0;
+    if (to < from) to = from;
+    char desc[256];
+    format_policy_spec(&reqs, desc, sizeof(desc));
+    printf("Policy: %s\n", desc);
+    if (estimate) {
+        for (long length = from; length <= to; length++) {
+            double log2_count;
+            char count_text[32], share_text[32];
+            if (password_count_estimate(&reqs, (size_t)length, &log2_count) != 0) {
+                printf("Length %ld: too many states to estimate\n", length);
+                return 1;
+            }
+            format_log2(log2_count, count_text, sizeof(count_text));
+            format_log2(log2_count - (double)length * log2(95.0), share_text, sizeof(share_text));
+            printf("Length %ld: about %s passwords (%s of all printable strings)\n", length, count_text,
+                   share_text);
+        }
+        return 0;
+    }
+
+    // Counts and 95^length share the precision of the longest non-palindrome
+    int limbs = (int)((size_t)to * 657 / 6400 + 1);
+    uint64_t *all = calloc((size_t)limbs, sizeof(uint64_t));
+    uint64_t *next = calloc((size_t)limbs, sizeof(uint64_t));
+    uint64_t *root = calloc((size_t)limbs, sizeof(uint64_t));
+    char *digits = malloc((size_t)limbs * 20 + 1);
+    int status = 0;
+    if (all == NULL || next == NULL || root == NULL || digits == NULL) {
+        perror("--count");
+        status = 1;
+        goto done;
+    }
+    all[0] = 1;
+    for (long k = 0; k < from; k++) {
+        memset(next, 0, (size_t)limbs * sizeof(uint64_t));
+        count_addmul(next, all, 95, limbs);
+        memcpy(all, next, (size_t)limbs * sizeof(uint64_t));
+    }
+    for (long length = from; length <= to; length++) {
+        PasswordCounter pc;
+        if (password_counter_init(&pc, &reqs, (size_t)length, 0) != 0) {
+            printf("Length %ld: too many states to count\n", length);
+            status = 1;
+        } else {
+            memset(root, 0, (size_t)limbs * sizeof(uint64_t));
+            memcpy(root, pc.root, (size_t)pc.limbs * sizeof(uint64_t));
+            password_counter_free(&pc);
+            count_format(root, limbs, digits, (size_t)limbs * 20 + 1);
+            int drop = limbs > 2 ? limbs - 2 : 0;
+            printf("Length %ld: %s passwords (%.3g of all printable strings)\n", length, digits,
+                   count_scaled(root, limbs, drop) / count_scaled(all, limbs, drop));
+        }
+        memset(next, 0, (size_t)limbs * sizeof(uint64_t));
+        count_addmul(next, all, 95, limbs);
+        memcpy(all, next, (size_t)limbs * sizeof(uint64_t));
+    }
+
+done:
+    free(all);
+    free(next);
+    free(root);
+    free(digits);
+    return status;
+}
+
+// --- Long Password Counting ---
+
+/*
+ * Without a digit sum, the state after each step is small: the class tallies
+ * so far, capped at the minimums, and under no-repeat the previous
+ * character's class. Holding the tallies as the coefficients of a truncated
+ * polynomial leaves at most five states, and every step but the first and
+ * last is the same 5x5 class-transition matrix. While a minimum may still be
+ * unmet the polynomials are stepped one character at a time. Once all but
+ * 2^-80 of the weight has met every minimum, only the capped coefficient
+ * matters, and the remaining steps are the class-transition matrix raised to
+ * a power by repeated squaring. Counts that large only fit in log space:
+ * each vector or matrix is doubles scaled by one shared power of two, and
+ * every term is non-negative, so rounding costs only a few ulps per product.
+ * The log2 handed back is itself one double, though, so its absolute error
+ * (about log2 count * 2^-52) caps what is left of the count: some 9
+ * significant digits at length 10^6, fewer beyond. format_log2() prints 4.
+ */
+
+/**
+ * @brief Sizes a policy's tally polynomials.
+ * @return 0 on success, -1 if five of them would exceed COUNT_TABLE_BUDGET.
+ */
+static int tally_shape_init(TallyShape *ts, const PasswordRequirements *reqs) {
+    int mins[4] = { reqs->min_uppercase, reqs->min_lowercase, reqs->min_symbols, reqs->min_digits };
+    size_t size = 1;
+    for (int d = 0; d < 4; d++) {
+        ts->radix[d] = (mins[d] > 0 ? mins[d] : 0) + 1;
+        ts->stride[d] = (int)size;
+        size *= (size_t)ts->radix[d];
+        if (5 * size > COUNT_TABLE_BUDGET) return -1;
+    }
+    ts->size = (int)size;
+    return 0;
+}
+
+/**
+ * @brief out += k * in - k_sub * sub (sub may be NULL) over len coefficients
+ * (whole polynomials), with every tally on axis raised by w and capped; axis
+ * -1 leaves the tallies alone.
+ */
+static void tally_shift_add(const TallyShape *ts, size_t len, int axis, int w, double k, const double *in,
+                            double k_sub, const double *sub, double *out) {
+    int radix = axis < 0 ? 1 : ts->radix[axis];
+    size_t stride = axis < 0 ? (size_t)ts->size : (size_t)ts->stride[axis];
+    for (size_t hi = 0; hi < len; hi += stride * radix) {
+        for (int t = 0; t < radix; t++) {
+            int to = t + w < radix - 1 ? t + w : radix - 1;
+            const double *x = in + hi + t * stride;
+            double *y = out + hi + to * stride;
+            if (sub == NULL) {
+                for (size_t lo = 0; lo < stride; lo++) y[lo] += k * x[lo];
+            } else {
+                const double *z = sub + hi + t * stride;
+                for (size_t lo = 0; lo < stride; lo++) y[lo] += k * x[lo] - k_sub * z[lo];
+            }
+        }
+    }
+}
+
+/**
+ * @brief One character: next[c] holds the passwords ending in class c (in
+ * state 0 without no-repeat), from v, or from the empty password if first.
+ * @param n States: 5 under no-repeat, else 1.
+ * @param total Scratch for one polynomial.
+ */
+static void tally_step(const TallyShape *ts, int n, int first, unsigned mask, int w, const double *v,
+                       double *next, double *total) {
+    size_t size = (size_t)ts->size;
+    memset(next, 0, (size_t)n * size * sizeof(double));
+    memset(total, 0, size * sizeof(double));
+    if (first) {
+        total[0] = 1.0;
+    } else {
+        for (int r = 0; r < n; r++) {
+            for (size_t j = 0; j < size; j++) total[j] += v[(size_t)r * size + j];
+        }
+    }
+    for (int c = 0; c < 5; c++) {
+        if (!(mask >> c & 1)) continue;
+        int axis = c == COUNT_SPACE ? -1 : c == COUNT_DIGIT ? 3 : c;
+        // Under no-repeat, any character of the class but the previous one
+        const double *sub = n == 5 && !first ? v + (size_t)c * size : NULL;
+        tally_shift_add(ts, size, axis, w, count_class_size[c], total, 1.0, sub,
+                        next + (size_t)(n == 5 ? c : 0) * size);
+    }
+}
+
+/**
+ * @brief Rescales x so its largest entry is in [0.5, 1), adding the shift to
+ * *exp2. Entries 2^500 times smaller than that are dropped before they sink
+ * into slow subnormals: every term is non-negative, so they can only matter
+ * when a product pairs them with entries far above the rest, and digit-sum
+ * polynomials are tilted (see sum_tilt()) so that no coefficient the
+ * target needs is ever that far below the largest.
+ */
+static void log_normalize(double *x, size_t n, int64_t *exp2) {
+    double top = 0.0;
+    int e;
+    for (size_t i = 0; i < n; i++) {
+        if (x[i] > top) top = x[i];
+    }
+    if (top == 0.0) return;
+    frexp(top, &e);
+    double scale = ldexp(1.0, -e);
+    for (size_t i = 0; i < n; i++) {
+        x[i] *= scale;
+        if (x[i] < 0x1p-500) x[i] = 0.0;
+    }
+    *exp2 += e;
+}
+
+/**
+ * @brief u (n states, scaled by 2^*u_exp) times the class-transition matrix
+ * to the power e, by repeated squaring.
+ */
+static void class_matrix_apply_power(int n, double *u, int64_t *u_exp, size_t e) {
+    double m[25], t[25];
+    int64_t m_exp = 0;
+    for (int r = 0; r < n; r++) {
+        for (int c = 0; c < n; c++) m[r * n + c] = n == 5 ? count_class_size[c] - (r == c) : 95.0;
+    }
+    for (; e > 0; e >>= 1) {
+        if (e & 1) {
+            for (int c = 0; c < n; c++) {
+                t[c] = 0.0;
+                for (int s = 0; s < n; s++) t[c] += u[s] * m[s * n + c];
+            }
+            memcpy(u, t, (size_t)n * sizeof(double));
+            *u_exp += m_exp;
+            log_normalize(u, (size_t)n, u_exp);
+        }
+        if (e > 1) {
+            for (int r = 0; r < n; r++) {
+                for (int c = 0; c < n; c++) {
+                    t[r * n + c] = 0.0;
+                    for (int s = 0; s < n; s++) t[r * n + c] += m[r * n + s] * m[s * n + c];
+                }
+            }
+            memcpy(m, t, (size_t)n * n * sizeof(double));
+            m_exp *= 2;
+            log_normalize(m, (size_t)n * n, &m_exp);
+        }
+    }
+}
+
+/*
+ * Digit sums. Under the digit-sum rule every polynomial also gets one
+ * coefficient per digit sum so far, truncated at the target, and under
+ * no-repeat the previous digit's value joins the state (the four other
+ * classes plus ten digits, 14 states). Stepping the tallies until the
+ * minimums are met can take thousands of steps here, because with the sum
+ * fixed nearly every digit is a zero, and zeros are rare. So the walk first
+ * leaves the tallies out: the count without minimums is the target
+ * coefficient of a power of the class-transition matrix of sum polynomials,
+ * taken by evaluating the matrix at N-th roots of unity, squaring each
+ * numeric matrix, and inverting one coefficient of the transform
+ * (sum_finish_walk()). A Chernoff bound per class then shows whether any minimum
+ * can still matter. The bound weights that class's characters by theta < 1,
+ * and (passwords with under m of them) <= theta^-(m-1) * (weighted count).
+ * Only if some minimum still matters are the tallies stepped as above,
+ * within ESTIMATE_WORK_BUDGET.
+ *
+ * Coefficient s of every sum polynomial is held times r^s for one tilt r
+ * per walk, which products preserve. Untilted, the coefficients of a long
+ * walk climb steeply towards the target, so squaring it pairs the low ones
+ * (2^-900 of the largest at length 10^6 and target 120) with the high ones
+ * and rounding loses them. With r chosen so that a step's digit sum
+ * averages the target's share of it, each factor's coefficients peak near
+ * its own share and the terms that reach the target are the largest.
+ */
+
+/**
+ * @brief log2 of how fast middle steps multiply the walk: the largest
+ * eigenvalue of their matrix (classes weighted as in sum_step_matrix()) with
+ * every sum polynomial evaluated at 2^tilt. Digits past the target are left
+ * out, as the polynomials leave them.
+ * @param n States, as sum_step_matrix() takes them.
+ */
+static double sum_step_growth(const EstimateWalk *walk, int n, int sums, const double theta[5], double tilt) {
+    double v[14], total = 0.0; // Under no-repeat the matrix is all rows v less v[c] on the diagonal
+    int w = walk->w, states = 0;
+    for (int c = 0; c <= COUNT_DIGIT; c++) {
+        double weight = w == 2 ? theta[c] * theta[c] : theta[c];
+        if (c != COUNT_DIGIT) {
+            v[states] = weight * count_class_size[c];
+            total += v[states++];
+            continue;
+        }
+        for (int d = 0; d <= 9 && w * d < sums; d++) {
+            v[states] = weight * exp2(tilt * w * d);
+            total += v[states++];
+        }
+    }
+    if (n == 1) return log2(total);
+    // The eigenvalue x solves sum over c of v[c] / (x + g[c]) = 1, where g[c]
+    // is one character's weight: v[c] / size, so v[c] for digits
+    double lo = log2(total) - 1100.0, hi = log2(total);
+    for (int i = 0; i < 64; i++) {
+        double mid = (lo + hi) / 2, x = exp2(mid), f = 0.0;
+        for (int s = 0; s < states; s++) f += v[s] / (x + v[s] / (s < COUNT_DIGIT ? count_class_size[s] : 1));
+        if (f > 1.0) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo + hi) / 2;
+}
+
+/**
+ * @brief Mean and variance of a middle step's digit sum over a long walk,
+ * a sum of s weighted 2^(tilt s): the first and second derivatives of
+ * sum_step_growth() in tilt (the second over ln 2).
+ */
+static void sum_step_moments(const EstimateWalk *walk, int n, int sums, const double theta[5], double tilt,
+                             double *mean, double *var) {
+    const double h = 1.0 / 256;
+    double below = sum_step_growth(walk, n, sums, theta, tilt - h);
+    double at = sum_step_growth(walk, n, sums, theta, tilt);
+    double above = sum_step_growth(walk, n, sums, theta, tilt + h);
+    *mean = (above - below) / (2 * h);
+    *var = (above - 2 * at + below) / (h * h) / M_LN2;
+}
+
+/**
+ * @brief log2 of the tilt for one walk: the r at which a middle step's
+ * digit sum, with a sum of s weighted r^s, averages target / steps.
+ */
+static double sum_tilt(const EstimateWalk *walk, int n, int sums, const double theta[5]) {
+    double share = (double)(sums - 1) / (double)walk->steps;
+    double lo = -200.0 / (9 * walk->w), hi = -lo; // Keeps a step's entries within 2^400 of each other
+    for (int i = 0; i < 40; i++) {
+        double mid = (lo + hi) / 2, mean, var;
+        sum_step_moments(walk, n, sums, theta, mid, &mean, &var);
+        if (mean < share) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo + hi) / 2;
+}
+
+/**
+ * @brief One step's transition matrix over digit-sum polynomials: previous
+ * state (row; a single row for the first step) to next (column). A
+ * character of class c is weighted theta[c] per tally it adds.
+ * @param n States: 14 under no-repeat (the four other classes, then digits
+ * by value), else 1.
+ * @param sums Coefficients per polynomial: the target plus one.
+ * @param tilt log2 of the walk's tilt (sum_tilt()).
+ */
+static void sum_step_matrix(int n, int sums, int first, unsigned mask, int w, const double theta[5],
+                            double tilt, double *m) {
+    int rows = first ? 1 : n;
+    memset(m, 0, (size_t)rows * n * sums * sizeof(double));
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < 5; c++) {
+            if (!(mask >> c & 1)) continue;
+            double weight = w == 2 ? theta[c] * theta[c] : theta[c];
+            if (c != COUNT_DIGIT) {
+                int same = n > 1 && !first && r == c; // No-repeat: not the previous character again
+                m[((size_t)r * n + (n > 1 ? c : 0)) * sums] += weight * (count_class_size[c] - same);
+                continue;
+            }
+            for (int d = 0; d <= 9 && w * d < sums; d++) {
+                int col = n > 1 ? 4 + d : 0;
+                int same = n > 1 && !first && r == col;
+                m[((size_t)r * n + col) * sums + w * d] += weight * exp2(tilt * w * d) * (1 - same);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Points sum_finish_walk() evaluates a walk at: a power of two that
+ * covers the tilted walk's distance from the target and 16 standard
+ * deviations of its spread (or its whole range), so the sums that fold onto
+ * the target weigh nothing.
+ */
+static size_t sum_points(const EstimateWalk *walk, int n, int sums, const double theta[5], double tilt) {
+    double mean, var;
+    sum_step_moments(walk, n, sums, theta, tilt, &mean, &var);
+    double steps = (double)walk->steps, range = 9.0 * walk->w * steps + 1.0;
+    double need = fabs(steps * mean - (sums - 1)) + 16.0 * sqrt(steps * (var > 0.0 ? var : 0.0)) + 64.0;
+    size_t points = 1;
+    while ((double)points < (need < range ? need : range)) points <<= 1;
+    return points;
+}
+
+/**
+ * @brief In-place DFT of points (a power of two) values: a[k] becomes
+ * sum over i of a[i] root[i k mod points].
+ */
+static void sum_dft(double complex *a, size_t points, const double complex *root) {
+    for (size_t i = 1, j = 0; i < points; i++) {
+        size_t bit = points >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            double complex t = a[i];
+            a[i] = a[j];
+            a[j] = t;
+        }
+    }
+    for (size_t len = 2; len <= points; len <<= 1) {
+        size_t stride = points / len;
+        for (size_t at = 0; at < points; at += len) {
+            for (size_t j = 0; j < len / 2; j++) {
+                double complex x = a[at + j], y = a[at + j + len / 2] * root[j * stride];
+                a[at + j] = x + y;
+                a[at + j + len / 2] = x - y;
+            }
+        }
+    }
+}
+
+/**
+ * @brief log_normalize() for complex entries, none dropped: rescales x so
+ * its largest real or imaginary part is in [0.5, 1).
+ */
+static void point_normalize(double complex *x, size_t n, int64_t *exp2) {
+    double top = 0.0;
+    int e;
+    for (size_t i = 0; i < n; i++) {
+        if (fabs(creal(x[i])) > top) top = fabs(creal(x[i]));
+        if (fabs(cimag(x[i])) > top) top = fabs(cimag(x[i]));
+    }
+    if (top == 0.0) return;
+    frexp(top, &e);
+    double scale = ldexp(1.0, -e);
+    for (size_t i = 0; i < n; i++) x[i] *= scale;
+    *exp2 += e;
+}
+
+/**
+ * @brief Finishes a walk from u (a row of digit-sum polynomials after the
+ * first `done` steps): the middle steps, then the last, at every point.
+ * @return log2 of the target coefficient summed over states (untilted),
+ * -INFINITY if zero, or NAN past ESTIMATE_WORK_BUDGET or if memory runs out.
+ */
+static double sum_finish_walk(const EstimateWalk *walk, size_t done, int n, int sums,
+                              const double theta[5], double tilt, const double *u, int64_t u_exp) {
+    double count = 0.0;
+    if (done >= walk->steps) {
+        for (int r = 0; r < n; r++) count += u[(size_t)r * sums + sums - 1];
+        return count > 0.0 ? log2(count) + (double)u_exp - tilt * (sums - 1) : -INFINITY;
+    }
+    size_t points = sum_points(walk, n, sums, theta, tilt), nn = (size_t)n * n;
+    size_t power = walk->steps - 1 - done;
+    int levels = 1, span = 9 * walk->w + 1 < sums ? 9 * walk->w + 1 : sums; // Coefficients a step reaches
+    for (size_t e = power; e > 1; e >>= 1) levels++;
+    if ((double)points * ((double)levels * nn * (n + 1) + (double)n * sums) > (double)ESTIMATE_WORK_BUDGET) {
+        return NAN;
+    }
+
+    double *mid = malloc(nn * sums * sizeof(double));
+    double *last = malloc(nn * sums * sizeof(double));
+    double complex *root = malloc(points * sizeof(double complex));
+    double complex *at = malloc((size_t)n * points * sizeof(double complex));
+    double complex *value = malloc(points * sizeof(double complex));
+    int64_t *value_exp = malloc(points * sizeof(int64_t));
+    double complex *scratch = malloc((2 * nn + 2 * (size_t)n) * sizeof(double complex));
+    double result = NAN;
+    if (mid == NULL || last == NULL || root == NULL || at == NULL || value == NULL || value_exp == NULL ||
+        scratch == NULL) {
+        goto done;
+    }
+    sum_step_matrix(n, sums, 0, 0x1F, walk->w, theta, tilt, mid);
+    sum_step_matrix(n, sums, 0, walk->last_mask, walk->last_w, theta, tilt, last);
+    for (size_t k = 0; k < points; k++) root[k] = cexp(2.0 * M_PI * I * (double)k / (double)points);
+    // u at every point: its coefficients folded modulo points, then a DFT per state
+    for (int r = 0; r < n; r++) {
+        double complex *a = at + (size_t)r * points;
+        memset(a, 0, points * sizeof(double complex));
+        for (int i = 0; i < sums; i++) a[(size_t)i % points] += u[(size_t)r * sums + i];
+        sum_dft(a, points, root);
+    }
+
+    for (size_t k = 0; k <= points / 2; k++) { // Real coefficients: the other half are conjugates
+        double complex *m = scratch, *square = m + nn, *y = square + nn, *next = y + n, z[19];
+        int64_t m_exp = 0, y_exp = 0;
+        for (int i = 0; i < span; i++) z[i] = root[k * (size_t)i % points];
+        for (size_t e = 0; e < nn; e++) {
+            m[e] = 0.0;
+            for (int i = 0; i < span; i++) m[e] += mid[e * sums + i] * z[i];
+        }
+        for (int r = 0; r < n; r++) y[r] = at[(size_t)r * points + k];
+        for (size_t e = power; e > 0; e >>= 1) {
+            if (e & 1) {
+                for (int c = 0; c < n; c++) {
+                    next[c] = 0.0;
+                    for (int s = 0; s < n; s++) next[c] += y[s] * m[s * n + c];
+                }
+                memcpy(y, next, (size_t)n * sizeof(double complex));
+                y_exp += m_exp;
+                point_normalize(y, (size_t)n, &y_exp);
+            }
+            if (e > 1) {
+                for (int r = 0; r < n; r++) {
+                    for (int c = 0; c < n; c++) {
+                        double complex t = 0.0;
+                        for (int s = 0; s < n; s++) t += m[r * n + s] * m[s * n + c];
+                        square[r * n + c] = t;
+                    }
+                }
+                double complex *swap = m;
+                m = square;
+                square = swap;
+                m_exp *= 2;
+                point_normalize(m, nn, &m_exp);
+            }
+        }
+        value[k] = 0.0;
+        for (size_t e = 0; e < nn; e++) {
+            double complex entry = 0.0;
+            for (int i = 0; i < span; i++) entry += last[e * sums + i] * z[i];
+            value[k] += y[e / n] * entry;
+        }
+        value_exp[k] = y_exp;
+        if (k > 0 && k < points - k) {
+            value[points - k] = conj(value[k]);
+            value_exp[points - k] = y_exp;
+        }
+    }
+
+    // The target coefficient is the inverse DFT at the target. Every
+    // coefficient is non-negative, so the value at point 0 is the largest;
+    // anything below 2^-30 of it is rounding, as a coefficient the tilt
+    // centres on is far larger
+    double complex sum = 0.0;
+    size_t target = (size_t)(sums - 1) % points;
+    for (size_t k = 0; k < points; k++) {
+        int64_t shift = value_exp[k] - value_exp[0];
+        double complex v = ldexp(creal(value[k]), (int)(shift < -2000 ? -2000 : shift)) +
+                           ldexp(cimag(value[k]), (int)(shift < -2000 ? -2000 : shift)) * I;
+        sum += v * root[(points - k * target % points) % points];
+    }
+    count = creal(sum) / (double)points;
+    result = count > 0x1p-30 * cabs(value[0]) ? log2(count) + (double)(value_exp[0] + u_exp) - tilt * (sums - 1)
+                                              : -INFINITY;
+
+done:
+    free(mid);
+    free(last);
+    free(root);
+    free(at);
+    free(value);
+    free(value_exp);
+    free(scratch);
+    return result;
+}
+
+/**
+ * @brief log2 of how many passwords meet every rule but the class minimums,
+ * each character of class c weighted theta[c] per tally it adds;
+ * -INFINITY if none, NAN if memory runs out.
+ */
+static double sum_count_free(const EstimateWalk *walk, int n, int sums, const double theta[5]) {
+    double *u = malloc((size_t)n * sums * sizeof(double));
+    if (u == NULL) return NAN;
+    int single = walk->steps == 1;
+    double tilt = sum_tilt(walk, n, sums, theta);
+    sum_step_matrix(n, sums, 1, walk->first_mask & (single ? walk->last_mask : 0x1F),
+                    single ? walk->last_w : walk->w, theta, tilt, u);
+    double result = sum_finish_walk(walk, 1, n, sums, theta, tilt, u, 0);
+    free(u);
+    return result;
+}
+
+/**
+ * @brief One character over tally polynomials with a digit-sum axis
+ * (sums x ts->size coefficients each), as tally_step() without it.
+ * @param tilt log2 of the walk's tilt (sum_tilt()).
+ * @param total Scratch for one polynomial.
+ */
+static void sum_tally_step(const TallyShape *ts, int n, int sums, int first, unsigned mask, int w, double tilt,
+                           const double *v, double *next, double *total) {
+    size_t size = (size_t)ts->size, poly = size * sums;
+    memset(next, 0, (size_t)n * poly * sizeof(double));
+    memset(total, 0, poly * sizeof(double));
+    if (first) {
+        total[0] = 1.0;
+    } else {
+        for (int r = 0; r < n; r++) {
+            for (size_t j = 0; j < poly; j++) total[j] += v[(size_t)r * poly + j];
+        }
+    }
+    for (int c = 0; c < COUNT_DIGIT; c++) {
+        if (!(mask >> c & 1)) continue;
+        const double *sub = n > 1 && !first ? v + (size_t)c * poly : NULL;
+        tally_shift_add(ts, poly, c == COUNT_SPACE ? -1 : c, w, count_class_size[c], total, 1.0, sub,
+                        next + (size_t)(n > 1 ? c : 0) * poly);
+    }
+    if (!(mask >> COUNT_DIGIT & 1)) return;
+    for (int d = 0; d <= 9 && w * d < sums; d++) {
+        size_t state = n > 1 ? 4 + (size_t)d : 0, shift = (size_t)(w * d) * size;
+        const double *sub = n > 1 && !first ? v + state * poly : NULL;
+        double k = exp2(tilt * w * d); // The repeated digit is tilted like any other
+        tally_shift_add(ts, poly - shift, 3, w, k, total, k, sub, next + state * poly + shift);
+    }
+}
+
+/**
+ * @brief The digit-sum estimate with the minimums tracked: tallies stepped
+ * until every minimum is met at every sum, then sum_finish_walk().
+ * @return 0 on success, -1 over COUNT_TABLE_BUDGET or ESTIMATE_WORK_BUDGET,
+ * or when memory runs out.
+ */
+static int sum_count_tallied(const PasswordRequirements *reqs, const EstimateWalk *walk, int n, int sums,
+                             double *log2_count) {
+    static const double unweighted[5] = { 1.0, 1.0, 1.0, 1.0, 1.0 };
+    TallyShape ts;
+    if (tally_shape_init(&ts, reqs) != 0) return -1;
+    size_t size = (size_t)ts.size, poly = size * sums, cells = (size_t)n * poly;
+    if (cells > COUNT_TABLE_BUDGET) return -1;
+
+    double *v = malloc(cells * sizeof(double));
+    double *next = malloc(cells * sizeof(double));
+    double *total = malloc(poly * sizeof(double));
+    int64_t v_exp = 0, work = 0;
+    int status = -1;
+    if (v == NULL || next == NULL || total == NULL) goto done;
+
+    int single = walk->steps == 1;
+    double tilt = sum_tilt(walk, n, sums, unweighted);
+    sum_tally_step(&ts, n, sums, 1, walk->first_mask & (single ? walk->last_mask : 0x1F),
+                   single ? walk->last_w : walk->w, tilt, NULL, v, total);
+    size_t done = 1;
+    for (; done + 1 < walk->steps; done++) {
+        int met = 1;
+        for (int t = 0; t < sums && met; t++) {
+            double capped = 0.0, rest = 0.0;
+            for (int r = 0; r < n; r++) {
+                const double *x = v + (size_t)r * poly + (size_t)t * size;
+                for (size_t j = 0; j + 1 < size; j++) rest += x[j];
+                capped += x[size - 1];
+            }
+            met = rest <= 0x1p-80 * capped; // Every minimum is met at this sum, as far as doubles can tell
+        }
+        if (met) break;
+        work += (int64_t)cells;
+        if (work > ESTIMATE_WORK_BUDGET) goto done;
+        sum_tally_step(&ts, n, sums, 0, 0x1F, walk->w, tilt, v, next, total);
+        double *swap = v;
+        v = next;
+        next = swap;
+        log_normalize(v, cells, &v_exp);
+    }
+
+    if (done + 1 == walk->steps) { // Last step with the tallies still in play
+        sum_tally_step(&ts, n, sums, 0, walk->last_mask, walk->last_w, tilt, v, next, total);
+        double count = 0.0;
+        for (int r = 0; r < n; r++) count += next[(size_t)r * poly + (size_t)(sums - 1) * size + size - 1];
+        *log2_count = count > 0.0 ? log2(count) + (double)v_exp - tilt * (sums - 1) : -INFINITY;
+        status = 0;
+        goto done;
+    }
+    for (int r = 0; r < n; r++) { // Only the capped coefficients are left to carry
+        for (int t = 0; t < sums; t++) next[(size_t)r * sums + t] = v[(size_t)r * poly + (size_t)t * size + size - 1];
+    }
+    *log2_count = sum_finish_walk(walk, done, n, sums, unweighted, tilt, next, v_exp);
+    status = isnan(*log2_count) ? -1 : 0;
+
+done:
+    free(v);
+    free(next);
+    free(total);
+    return status;
+}
+
+/**
+ * @brief password_count_estimate() under the digit-sum rule.
+ */
+static int estimate_with_digit_sum(const PasswordRequirements *reqs, const EstimateWalk *walk,
+                                   double *log2_count) {
+    long target = reqs->digit_sum_target;
+    if (target < 0 || (size_t)target > 9 * walk->steps * (size_t)walk->w ||
+        (reqs->min_digits <= 0 && target != 0)) { // As check_features() rules
+        return 0;
+    }
+    int sums = (int)target + 1;
+    int n = reqs->req_no_consecutive_chars ? 14 : 1;
+    if ((size_t)n * n * sums > COUNT_TABLE_BUDGET) return -1;
+
+    double theta[5] = { 1.0, 1.0, 1.0, 1.0, 1.0 };
+    double free_count = sum_count_free(walk, n, sums, theta);
+    if (isnan(free_count)) return -1;
+    if (free_count == -INFINITY) return 0;
+
+    // Minimums in counting order; any of them can be dropped once its bound is far below the count
+    int mins[5] = { reqs->min_uppercase, reqs->min_lowercase, reqs->min_symbols, 0, reqs->min_digits };
+    int settled = 1;
+    for (int c = 0; c < 5 && settled; c++) {
+        if (mins[c] <= 0) continue;
+        settled = 0;
+        for (int k = 4; k <= 16 && !settled; k *= 2) {
+            theta[c] = ldexp(1.0, -k);
+            double bound = sum_count_free(walk, n, sums, theta);
+            if (isnan(bound)) return -1;
+            settled = bound + (double)k * (mins[c] - 1) <= free_count - 80.0;
+        }
+        theta[c] = 1.0;
+    }
+    if (settled) {
+        *log2_count = free_count;
+        return 0;
+    }
+    return sum_count_tallied(reqs, walk, n, sums, log2_count);
+}
+
+/**
+ * @brief Estimates how many printable-ASCII passwords of exactly length
+ * characters satisfy reqs, for lengths far past what password_counter_init()
+ * can tabulate: steps of truncated tally polynomials until the minimums are
+ * met, then O(log length) class-transition matrix products.
+ * @param reqs The requirements.
+ * @param length Password length.
+ * @param log2_count Receives log2 of the count, or -INFINITY if no password
+ * qualifies. Its relative error is about 2^-52, so the count itself keeps
+ * about 15 - log10(log2 count) significant digits (9 at length 10^6).
+ * @return 0 on success, -1 if the minimums (or, with the digit-sum rule,
+ * their tallies stepped at this length) exceed COUNT_TABLE_BUDGET or
+ * ESTIMATE_WORK_BUDGET, or when memory runs out.
+ */
+int password_count_estimate(const PasswordRequirements *reqs, size_t length, double *log2_count) {
+    int palindrome = reqs->req_palindrome;
+    int n = reqs->req_no_consecutive_chars ? 5 : 1;
+    int centre = palindrome && length % 2 == 1;
+    EstimateWalk walk;
+    TallyShape ts;
+
+    *log2_count = -INFINITY;
+    if (length < (size_t)(reqs->min_length > 0 ? reqs->min_length : 0) ||
+        (reqs->req_start_upper_end_symbol && (palindrome || length < 2)) || // First = last for palindromes
+        (palindrome && n == 5 && length % 2 == 0 && length > 0)) {          // The middle pair repeats
+        return 0;
+    }
+    walk.steps = palindrome ? (length + 1) / 2 : length;
+    walk.first_mask = reqs->req_start_upper_end_symbol ? 1u << 0 : 0x1F;
+    walk.last_mask = reqs->req_start_upper_end_symbol ? 1u << 2 : 0x1F;
+    walk.w = palindrome ? 2 : 1;
+    walk.last_w = centre ? 1 : walk.w;
+    if (walk.steps == 0) {
+        if (reqs->min_uppercase <= 0 && reqs->min_lowercase <= 0 && reqs->min_symbols <= 0 &&
+            reqs->min_digits <= 0 && !(reqs->req_digit_sum && reqs->digit_sum_target != 0)) {
+            *log2_count = 0.0;
+        }
+        return 0;
+    }
+    if (reqs->req_digit_sum) return estimate_with_digit_sum(reqs, &walk, log2_count);
+    if (tally_shape_init(&ts, reqs) != 0) return -1;
+
+    size_t size = (size_t)ts.size, cells = (size_t)n * size;
+    double *v = malloc(cells * sizeof(double));
+    double *next = malloc(cells * sizeof(double));
+    double *total = malloc(size * sizeof(double));
+    int64_t v_exp = 0;
+    if (v == NULL || next == NULL || total == NULL) {
+        free(v);
+        free(next);
+        free(total);
+        return -1;
+    }
+
+    int single = walk.steps == 1;
+    tally_step(&ts, n, 1, walk.first_mask & (single ? walk.last_mask : 0x1F), single ? walk.last_w : walk.w,
+               NULL, v, total);
+    size_t middle = walk.steps >= 2 ? walk.steps - 2 : 0;
+    for (; middle > 0; middle--) {
+        double capped = 0.0, rest = 0.0;
+        for (int r = 0; r < n; r++) {
+            for (size_t j = 0; j + 1 < size; j++) rest += v[(size_t)r * size + j];
+            capped += v[(size_t)r * size + size - 1];
+        }
+        if (rest <= 0x1p-80 * capped) break; // Every minimum is met, as far as doubles can tell
+        tally_step(&ts, n, 0, 0x1F, walk.w, v, next, total);
+        double *swap = v;
+        v = next;
+        next = swap;
+        log_normalize(v, cells, &v_exp);
+    }
+    if (middle > 0) {
+        double u[5];
+        for (int r = 0; r < n; r++) u[r] = v[(size_t)r * size + size - 1];
+        class_matrix_apply_power(n, u, &v_exp, middle);
+        memset(v, 0, cells * sizeof(double));
+        for (int r = 0; r < n; r++) v[(size_t)r * size + size - 1] = u[r];
+    }
+    if (walk.steps >= 2) {
+        tally_step(&ts, n, 0, walk.last_mask, walk.last_w, v, next, total);
+        double *swap = v;
+        v = next;
+        next = swap;
+    }
+
+    double count = 0.0;
+    for (int r = 0; r < n; r++) count += v[(size_t)r * size + size - 1];
+    if (count > 0.0) *log2_count = log2(count) + (double)v_exp;
+    free(v);
+    free(next);
+    free(total);
+    return 0;
+}
+
+/**
+ * @brief Writes 2^log2_value in decimal, as mantissa and power of ten once
+ * it leaves double range.
+ */
+static void format_log2(double log2_value, char *buf, size_t size) {
+    if (log2_value == -INFINITY) {
+        snprintf(buf, size, "0");
+        return;
+    }
+    if (fabs(log2_value) < 1000.0) {
+        snprintf(buf, size, "%.4g", exp2(log2_value));
+        return;
+    }
+    double decimal = log2_value * 0.30102999566398119521; // log10(2)
+    double exponent = floor(decimal);
+    double mantissa = pow(10.0, decimal - exponent);
+    if (mantissa >= 9.9995) { // Would round up to 10.000
+        mantissa /= 10.0;
+        exponent += 1.0;
+    }
+    snprintf(buf, size, "%.3fe%+.0f", mantissa, exponent);
+}
+
+// --- Benchmark ---
+
+/**
+ * @brief Returns a monotonic timestamp in seconds.
+ */
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Reports whether two feature summaries are identical.
+ */
+static int scan_equal(const PasswordFeatures *a, const PasswordFeatures *b) {
+    return a->length == b->length &&
+           memcmp(&a->counts, &b->counts, sizeof(ClassCounts)) == 0 &&
+           a->first_repeat == b->first_repeat &&
+           a->max_run == b->max_run &&
+           a->is_palindrome == b->is_palindrome &&
+           a->first_class == b->first_class &&
+           a->last_class == b->last_class;
+}
+
+/**
+ * @brief Compares the scalar scan kernel with the dispatched one on
+ * random printable passwords of 64-256 bytes and prints the speedup.
+ * Also cross-checks that both kernels agree.
+ * @return 0 on success, 1 if the kernels disagree.
+ */
+int run_benchmark(void) {
+    static const size_t lengths[] = {64, 128, 256};
+    enum { POOL = 1024 }; // Distinct inputs cycled through to defeat branch history
+    const char *name;
+    scan_kernel_fn fast = select_scan_kernel(&name);
+    volatile int sink = 0;
+
+    srand(12345);
+    printf("Scan kernel: %s\n", name);
+    printf("%8s %14s %14s %9s\n", "length", "scalar MB/s", "kernel MB/s", "speedup");
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        size_t len = lengths[l];
+        unsigned char *pool = malloc(POOL * len);
+        if (pool == NULL) {
+            perror("malloc");
+            return 1;
+        }
+        for (size_t i = 0; i < POOL * len; i++) {
+            pool[i] = (unsigned char)(0x20 + rand() % 95); // Printable ASCII
+        }
+
+        for (int k = 0; k < POOL; k++) {
+            PasswordFeatures a, b;
+            scan_password_scalar(pool + k * len, len, &a);
+            fast(pool + k * len, len, &b);
+            if (!scan_equal(&a, &b)) {
+                printf("Kernel mismatch at length %zu\n", len);
+                free(pool);
+                return 1;
+            }
+        }
+
+        long iterations = BENCH_ITERATIONS * 64L / (long)len;
+        double rates[2];
+        for (int pass = 0; pass < 2; pass++) {
+            scan_kernel_fn kernel = pass == 0 ? scan_password_scalar : fast;
+            PasswordFeatures c;
+            double start = bench_now();
+            for (long it = 0; it < iterations; it++) {
+                kernel(pool + (it % POOL) * len, len, &c);
+                sink += c.counts.symbols;
+            }
+            double elapsed = bench_now() - start;
+            rates[pass] = (double)iterations * len / elapsed / 1e6;
+        }
+        printf("%8zu %14.1f %14.1f %8.1fx\n", len, rates[0], rates[1], rates[1] / rates[0]);
+        free(pool);
+    }
+    (void)sink;
+    if (run_long_input_benchmark() != 0) return 1;
+    if (run_utf8_benchmark() != 0) return 1;
+    if (run_policy_benchmark() != 0) return 1;
+    if (run_synthesis_benchmark() != 0) return 1;
+    return run_count_benchmark();
+}
+
+/**
+ * @brief Times UTF-8 mode on ~256-byte passwords: the validator against its
+ * portable loop, and the UTF-8 scan against the dispatched byte kernel, on
+ * ASCII and on mixed Latin, Cyrillic and CJK text.
+ * @return 0 on success, 1 if the validators disagree or allocation fails.
+ */
+static int run_utf8_benchmark(void) {
+    enum { LEN = 256, POOL = 1024 };
+    static const uint32_t blocks[][2] = { {0x41, 26}, {0xC0, 64}, {0x410, 64}, {0x4E00, 512} };
+    unsigned char *text[2];
+    size_t lens[2][POOL];
+    volatile long sink = 0;
+    double rates[2][4];
+
+    text[0] = malloc(POOL * LEN);
+    text[1] = malloc(POOL * LEN);
+    if (text[0] == NULL || text[1] == NULL) {
+        perror("malloc");
+        free(text[0]);
+        free(text[1]);
+        return 1;
+    }
+    for (int k = 0; k < POOL; k++) {
+        unsigned char *a = text[0] + k * LEN, *m = text[1] + k * LEN;
+        size_t n = 0;
+        for (size_t j = 0; j < LEN; j++) a[j] = (unsigned char)(0x20 + rand() % 95);
+        lens[0][k] = LEN;
+        while (n + 3 <= LEN) {
+            const uint32_t *b = blocks[rand() % 4];
+            uint32_t cp = b[0] + (uint32_t)rand() % b[1];
+            if (cp < 0x80)       { m[n++] = (unsigned char)cp; }
+            else if (cp < 0x800) { m[n++] = (unsigned char)(0xC0 | cp >> 6); m[n++] = (unsigned char)(0x80 | (cp & 0x3F)); }
+            else { m[n++] = (unsigned char)(0xE0 | cp >> 12); m[n++] = (unsigned char)(0x80 | (cp >> 6 & 0x3F));
+                   m[n++] = (unsigned char)(0x80 | (cp & 0x3F)); }
+        }
+        lens[1][k] = n;
+        for (int t = 0; t < 2; t++) {
+            const unsigned char *p = text[t] + k * LEN;
+            unsigned char broken[LEN];
+            memcpy(broken, p, lens[t][k]);
+            broken[rand() % lens[t][k]] = 0xFF;
+            if (utf8_check_scalar(p, lens[t][k]) != utf8_check((const char *)p, lens[t][k]) ||
+                utf8_check((const char *)broken, lens[t][k]) != UTF8_INVALID) {
+                printf("UTF-8 validator mismatch\n");
+                free(text[0]);
+                free(text[1]);
+                return 1;
+            }
+        }
+    }
+
+    long iterations = BENCH_ITERATIONS / 4;
+    for (int t = 0; t < 2; t++) {
+        size_t bytes = 0;
+        for (int pass = 0; pass < 4; pass++) {
+            PasswordFeatures c;
+            double start = bench_now();
+            bytes = 0;
+            for (long it = 0; it < iterations; it++) {
+                const unsigned char *p = text[t] + (it % POOL) * LEN;
+                size_t len = lens[t][it % POOL];
+                switch (pass) {
+                case 0:  sink += utf8_check_scalar(p, len); break;
+                case 1:  sink += utf8_check((const char *)p, len); break;
+                case 2:  scan_password((const char *)p, len, &c); sink += c.counts.symbols; break;
+                default: scan_password_utf8(p, len, &c); sink += c.counts.symbols; break;
+                }
+                bytes += len;
+            }
+            rates[t][pass] = (double)bytes / (bench_now() - start) / 1e6;
+        }
+    }
+    (void)sink;
+    printf("\nUTF-8 mode (MB/s)       ASCII      mixed\n");
+    printf("  validate scalar  %10.1f %10.1f\n", rates[0][0], rates[1][0]);
+    printf("  validate kernel  %10.1f %10.1f\n", rates[0][1], rates[1][1]);
+    printf("  byte scan kernel %10.1f %10.1f\n", rates[0][2], rates[1][2]);
+    printf("  UTF-8 scan       %10.1f %10.1f\n", rates[0][3], rates[1][3]);
+    printf("  UTF-8 slowdown   %9.2fx %9.2fx\n", rates[0][2] / rates[0][3], rates[1][2] / rates[1][3]);
+    free(text[0]);
+    free(text[1]);
+    return 0;
+}
+
+/**
+ * @brief Times the standalone early-exit checks on long generated candidates:
+ * the palindrome check on palindromes (every pair is compared) and the
+ * repeat search on strings whose only repeat, if any, is in the back half.
+ * Scalar loops versus is_palindrome_n() and find_first_repeat_n().
+ * @return 0 on success, 1 if a vector routine disagrees with its scalar loop.
+ */
+static int run_long_input_benchmark(void) {
+    enum { LEN = 4096, POOL = 64 };
+    unsigned char *pals = malloc(POOL * LEN);
+    unsigned char *runs = malloc(POOL * LEN);
+    volatile long sink = 0;
+    double rates[2][2];
+
+    if (pals == NULL || runs == NULL) {
+        perror("malloc");
+        free(pals);
+        free(runs);
+        return 1;
+    }
+    for (int k = 0; k < POOL; k++) {
+        unsigned char *p = pals + k * LEN;
+        unsigned char *r = runs + k * LEN;
+        for (size_t j = 0; j < LEN / 2; j++) {
+            p[j] = p[LEN - 1 - j] = (unsigned char)(0x21 + rand() % 94);
+        }
+        if (k % 2) p[LEN / 2 + rand() % (LEN / 2)] ^= 1; // Half of them break somewhere in the back
+        for (size_t j = 0; j < LEN; j++) {
+            r[j] = (unsigned char)(0x21 + rand() % 94);
+            if (j > 0 && r[j] == r[j - 1]) r[j] = r[j] == 0x7E ? 0x21 : r[j] + 1; // Adjacent bytes differ
+        }
+        if (k % 2) { size_t at = LEN / 2 + rand() % (LEN / 2 - 1); r[at + 1] = r[at]; }
+        if (palindrome_from_scalar(p, LEN, 0) != is_palindrome_n((const char *)p, LEN) ||
+            first_repeat_from_scalar(r, LEN, 0) != find_first_repeat_n((const char *)r, LEN)) {
+            printf("Long input mismatch\n");
+            free(pals);
+            free(runs);
+            return 1;
+        }
+    }
+    long iterations = BENCH_ITERATIONS / 64;
+    for (int pass = 0; pass < 2; pass++) {
+        double start = bench_now();
+        for (long it = 0; it < iterations; it++) {
+            const unsigned char *p = pals + (it % POOL) * LEN;
+            sink += pass == 0 ? palindrome_from_scalar(p, LEN, 0) : is_palindrome_n((const char *)p, LEN);
+        }
+        rates[0][pass] = (double)iterations * LEN / (bench_now() - start) / 1e6;
+
+        start = bench_now();
+        for (long it = 0; it < iterations; it++) {
+            const unsigned char *r = runs + (it % POOL) * LEN;
+            sink += pass == 0 ? first_repeat_from_scalar(r, LEN, 0) : find_first_repeat_n((const char *)r, LEN);
+        }
+        rates[1][pass] = (double)iterations * LEN / (bench_now() - start) / 1e6;
+    }
+    (void)sink;
+    printf("\n%d-byte candidates      scalar MB/s    kernel MB/s   speedup\n", LEN);
+    printf("  palindrome check  %14.1f %14.1f %8.1fx\n", rates[0][0], rates[0][1], rates[0][1] / rates[0][0]);
+    printf("  first repeat      %14.1f %14.1f %8.1fx\n", rates[1][0], rates[1][1], rates[1][1] / rates[1][0]);
+    free(pals);
+    free(runs);
+    return 0;
+}
+
+/**
+ * @brief Times matching one password against a table of policies: every round's
+ * requirements with each combination of ridiculous rules. Cross-checks the
+ * dispatched kernel against the scalar one and against check_features().
+ * @return 0 on success, 1 on mismatch or allocation failure.
+ */
+static int run_policy_benchmark(void) {
+    enum { ROUNDS = 256, POLICIES = ROUNDS * RULESET_COUNT, SAMPLES = 256 };
+    PasswordRequirements *policies = malloc(POLICIES * sizeof(PasswordRequirements));
+    PasswordFeatures *samples = malloc(SAMPLES * sizeof(PasswordFeatures));
+    uint64_t fast_bits[(POLICIES + 63) / 64], ref_bits[(POLICIES + 63) / 64];
+    PolicyTable table;
+    int status = 0;
+
+    if (policies == NULL || samples == NULL) {
+        perror("malloc");
+        free(policies);
+        free(samples);
+        return 1;
+    }
+
+    for (int i = 0; i < POLICIES; i++) {
+        PasswordRequirements *r = &policies[i];
+        generate_requirements(r, 1 + (i / RULESET_COUNT) % 12);
+        r->req_start_upper_end_symbol = (i & RULESET_START_END) != 0;
+        r->req_no_consecutive_chars = (i & RULESET_NO_REPEAT) != 0;
+        r->req_palindrome = (i & RULESET_PALINDROME) != 0;
+        r->req_digit_sum = (i & RULESET_DIGIT_SUM) != 0;
+        r->digit_sum_target = rand() % 40;
+    }
+    for (int k = 0; k < SAMPLES; k++) {
+        char pw[48];
+        size_t len = 8 + rand() % 40;
+        for (size_t j = 0; j < len; j++) pw[j] = (char)(0x21 + rand() % 94);
+        scan_password(pw, len, &samples[k]);
+    }
+    if (policy_table_init(&table, policies, POLICIES) != 0) {
+        perror("malloc");
+        free(policies);
+        free(samples);
+        return 1;
+    }
+
+    for (int k = 0; k < SAMPLES && status == 0; k++) {
+        size_t fast = match_policies(&table, &samples[k], fast_bits);
+        size_t ref = match_policies_scalar(&table, &samples[k], ref_bits);
+        for (int i = 0; i < POLICIES; i++) {
+            int expect = check_features(&samples[k], &policies[i]) == 0;
+            if (expect != (int)((fast_bits[i / 64] >> (i % 64)) & 1)) status = 1;
+        }
+        if (fast != ref || memcmp(fast_bits, ref_bits, sizeof(fast_bits)) != 0) status = 1;
+    }
+    if (status) {
+        printf("Policy match mismatch\n");
+    } else {
+        long iterations = 20000;
+        volatile size_t sink = 0;
+        double rates[2];
+        for (int pass = 0; pass < 2; pass++) {
+            double start = bench_now();
+            for (long it = 0; it < iterations; it++) {
+                const PasswordFeatures *f = &samples[it % SAMPLES];
+                sink += pass == 0 ? match_policies_scalar(&table, f, ref_bits)
+                                  : match_policies(&table, f, fast_bits);
+            }
+            rates[pass] = (double)iterations * POLICIES / (bench_now() - start) / 1e6;
+        }
+        (void)sink;
+        printf("\n%d policies per password: scalar %.1f, kernel %.1f Mpolicies/s (%.1fx)\n",
+               POLICIES, rates[0], rates[1], rates[1] / rates[0]);
+    }
+    policy_table_free(&table);
+    free(policies);
+    free(samples);
+    return status;
+}
+
+/**
+ * @brief Synthesizes passwords for every satisfiable game policy up to round
+ * 20, checks them all, then reports the synthesis rate.
+ */
+static int run_synthesis_benchmark(void) {
+    enum { MAX_PLANS = 512, CHECKED = 64 };
+    SynthesisPlan plans[MAX_PLANS];
+    PasswordRequirements reqs[MAX_PLANS];
+    uint64_t rng = 0x9E3779B97F4A7C15ull;
+    char pw[1024];
+    size_t count = 0, total_length = 0;
+
+    for (int round = 1; round <= SWEEP_DEFAULT_ROUNDS; round++) {
+        for (int roll = 0; roll < requirement_rolls(round) && count < MAX_PLANS; roll++) {
+            generate_requirements_roll(&reqs[count], round, roll);
+            if (synthesis_plan(&reqs[count], &plans[count]) == 0 && plans[count].length <= sizeof(pw)) {
+                total_length += plans[count].length;
+                count++;
+            }
+        }
+    }
+    if (count == 0) return 0;
+
+    for (size_t i = 0; i < count; i++) {
+        for (int k = 0; k < CHECKED; k++) {
+            size_t len = synthesize_password(&plans[i], &rng, pw);
+            ValidationResult result;
+            if (check_password(pw, len, &reqs[i], &result) != 0) {
+                printf("Synthesized password fails its policy: %.*s\n", (int)len, pw);
+                return 1;
+            }
+        }
+    }
+
+    long iterations = 2000000;
+    volatile size_t sink = 0;
+    double start = bench_now();
+    for (long it = 0; it < iterations; it++) {
+        sink += synthesize_password(&plans[it % count], &rng, pw);
+    }
+    double elapsed = bench_now() - start;
+    (void)sink;
+    printf("\nSynthesis over %zu game policies (mean length %.1f): %.2f Mpasswords/s\n",
+           count, (double)total_length / count, iterations / elapsed / 1e6);
+    return 0;
+}
+
+/**
+ * @brief log2 of an exact count, -INFINITY for zero.
+ */
+static double count_log2(const uint64_t *n, int limbs) {
+    int top = limbs - 1;
+    while (top > 0 && n[top] == 0) top--;
+    int drop = top > 0 ? top - 1 : 0; // Two limbs are plenty for a double
+    double scaled = count_scaled(n, limbs, drop);
+    return scaled > 0.0 ? log2(scaled) + 64.0 * drop : -INFINITY;
+}
+
+/**
+ * @brief Checks the exact counter, by its tables and by count_by_class(), and
+ * the estimate against brute force over every printable string of length 1
+ * to 3, for each mix of rules under a few minimums and digit-sum targets.
+ * Every password sampled, from the tables and past them
+ * (count_superset_sample()), must also pass check_password().
+ * @return 0 if all agree, 1 otherwise.
+ */
+static int check_counts_by_brute_force(void) {
+    enum { MINS = 3, TARGETS = 3, POLICIES = RULESET_COUNT * MINS * TARGETS, MAX_LENGTH = 3, SAMPLES = 16 };
+    // Upper, lower, symbols, digits; the last fills length 3 exactly
+    static const int mins[MINS][4] = { { 0, 0, 0, 0 }, { 1, 0, 0, 1 }, { 0, 1, 1, 1 } };
+    static const int targets[TARGETS] = { 0, 4, 13 };
+    PasswordRequirements reqs[POLICIES];
+    uint64_t tally[POLICIES], rng = 0x9E3779B97F4A7C15ull;
+    size_t count = 0;
+
+    for (unsigned rules = 0; rules < RULESET_COUNT; rules++) {
+        for (int m = 0; m < MINS; m++) {
+            for (int t = 0; t < ((rules & RULESET_DIGIT_SUM) ? TARGETS : 1); t++) {
+                PasswordRequirements *r = &reqs[count++];
+                memset(r, 0, sizeof(*r));
+                r->min_uppercase = mins[m][0];
+                r->min_lowercase = mins[m][1];
+                r->min_symbols = mins[m][2];
+                r->min_digits = mins[m][3];
+                r->req_start_upper_end_symbol = (rules & RULESET_START_END) != 0;
+                r->req_no_consecutive_chars = (rules & RULESET_NO_REPEAT) != 0;
+                r->req_palindrome = (rules & RULESET_PALINDROME) != 0;
+                r->req_digit_sum = (rules & RULESET_DIGIT_SUM) != 0;
+                r->digit_sum_target = r->req_digit_sum ? targets[t] : 0;
+            }
+        }
+    }
+
+    for (size_t length = 1; length <= MAX_LENGTH; length++) {
+        char pw[MAX_LENGTH];
+        size_t strings = 1;
+        for (size_t i = 0; i < length; i++) strings *= 95;
+        memset(tally, 0, sizeof(tally));
+        for (size_t k = 0; k < strings; k++) {
+            PasswordFeatures features;
+            size_t rest = k;
+            for (size_t i = 0; i < length; i++, rest /= 95) pw[i] = (char)(' ' + rest % 95);
+            scan_password(pw, length, &features);
+            for (size_t i = 0; i < count; i++) tally[i] += check_features(&features, &reqs[i]) == 0;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            PasswordCounter pc;
+            uint64_t by_class[2] = { 0, 0 };
+            double log2_count;
+            if (password_counter_init(&pc, &reqs[i], length, 1) != 0) return 1;
+            long target = reqs[i].req_digit_sum ? reqs[i].digit_sum_target : 0;
+            int bad = pc.limbs > 2 || pc.root[0] != tally[i] ||
+                      (pc.sums > 0 && // Past the early checks
+                       (count_by_class(&pc, target, &pc.digit_rows, by_class) != 0 || by_class[0] != tally[i])) ||
+                      password_count_estimate(&reqs[i], length, &log2_count) != 0 ||
+                      !(tally[i] == 0 ? log2_count == -INFINITY
+                                      : fabs(log2_count - log2((double)tally[i])) <= 1e-9);
+            for (int k = 0; k < SAMPLES && !bad && tally[i] != 0; k++) {
+                ValidationResult result;
+                bad = password_counter_sample(&pc, &rng, pw) != 0 ||
+                      check_password(pw, length, &reqs[i], &result) != 0;
+            }
+            password_counter_free(&pc);
+            if (!bad && tally[i] != 0) { // The sampler past the tables, too
+                bad = count_tables_init(&pc, &reqs[i], length, 0) != 0 || count_superset_init(&pc) != 0;
+                for (int k = 0; k < SAMPLES && !bad; k++) {
+                    ValidationResult result;
+                    bad = password_counter_sample(&pc, &rng, pw) != 0 ||
+                          check_password(pw, length, &reqs[i], &result) != 0;
+                }
+                password_counter_free(&pc);
+            }
+            if (bad) {
+                printf("Count mismatch: policy %zu, length %zu, %llu by brute force\n", i, length,
+                       (unsigned long long)tally[i]);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Cross-checks password_count_estimate(): against the exact counter
+ * with round 6's minimums under every mix of rules, for small and large
+ * digit-sum targets at two lengths, and under the digit-sum rule at length
+ * 10^6 against a sum over the number of digits j of C(L, j) 85^(L - j)
+ * times the ways j digits add up to 120 (with every minimum 1, a negligible
+ * share of those passwords miss one), worked out separately in log space.
+ * @return 0 if all agree, 1 otherwise.
+ */
+static int check_count_estimates(void) {
+    const double reference = 6427226.6513176; // log2 of the count for the policy below at length 10^6
+    const int targets[3] = { 0, 7, 60 };
+    const size_t lengths[2] = { 25, 60 };
+    PasswordRequirements reqs;
+    uint64_t rng = 0x9E3779B97F4A7C15ull;
+    char pw[64];
+    double log2_count;
+    for (unsigned rules = 0; rules < RULESET_COUNT; rules++) {
+        for (int t = 0; t < ((rules & RULESET_DIGIT_SUM) ? 3 : 1); t++) {
+            for (int k = 0; k < 4; k++) {
+                PasswordCounter pc;
+                size_t length = lengths[k / 2] + (size_t)(k % 2); // Odd lengths give palindromes a centre
+                generate_requirements_roll(&reqs, 6, 0);
+                reqs.req_start_upper_end_symbol = (rules & RULESET_START_END) != 0;
+                reqs.req_no_consecutive_chars = (rules & RULESET_NO_REPEAT) != 0;
+                reqs.req_palindrome = (rules & RULESET_PALINDROME) != 0;
+                reqs.req_digit_sum = (rules & RULESET_DIGIT_SUM) != 0;
+                reqs.digit_sum_target = targets[t];
+                int kept = password_counter_init(&pc, &reqs, length, 1) == 0; // Sampled unless over every budget
+                if (!kept) {
+                    password_counter_free(&pc);
+                    if (password_counter_init(&pc, &reqs, length, 0) != 0) return 1;
+                }
+                double exact = count_log2(pc.root, pc.limbs);
+                int bad = password_count_estimate(&reqs, length, &log2_count) != 0 ||
+                          !(exact == log2_count || fabs(exact - log2_count) <= 1e-9 * fabs(exact));
+                for (int s = 0; s < 4 && kept && !bad && exact != -INFINITY; s++) {
+                    ValidationResult result;
+                    bad = password_counter_sample(&pc, &rng, pw) != 0 ||
+                          check_password(pw, length, &reqs, &result) != 0;
+                }
+                password_counter_free(&pc);
+                if (bad) {
+                    printf("Count mismatch: rules %u, target %d, length %zu\n", rules,
+                           targets[t], length);
+                    return 1;
+                }
+            }
+        }
+    }
+    if (parse_policy_spec("len=8,upper=1,lower=1,digits=1,symbols=1,digit-sum=120", &reqs) != 0 ||
+        password_count_estimate(&reqs, 1000000, &log2_count) != 0 ||
+        !(fabs(log2_count - reference) <= 1e-6)) {
+        printf("Digit-sum estimate mismatch at length 10^6\n");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Samples every roll of rounds 1-20 at its own length, through the
+ * tables or past them (their tables outgrow COUNT_TABLE_BUDGET from round
+ * 10), and checks each password drawn.
+ * @return 0 if all sample and pass, 1 otherwise.
+ */
+static int check_round_samples(void) {
+    uint64_t rng = 0x9E3779B97F4A7C15ull;
+    for (int round = 1; round <= SWEEP_DEFAULT_ROUNDS; round++) {
+        for (int roll = 0; roll < requirement_rolls(round); roll++) {
+            PasswordRequirements reqs;
+            PasswordCounter pc;
+            generate_requirements_roll(&reqs, round, roll);
+            size_t length = reqs.min_length > 0 ? (size_t)reqs.min_length : 0;
+            char *pw = malloc(length + 1);
+            int ready = pw != NULL && password_counter_init(&pc, &reqs, length, 1) == 0, bad = !ready;
+            for (int s = 0; s < 4 && !bad && !count_is_zero(pc.root, pc.limbs); s++) {
+                ValidationResult result;
+                bad = password_counter_sample(&pc, &rng, pw) != 0 ||
+                      check_password(pw, length, &reqs, &result) != 0;
+            }
+            if (ready) password_counter_free(&pc);
+            free(pw);
+            if (bad) {
+                printf("Uniform sampling failed: round %d, roll %d, length %zu\n", round, roll, length);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Times exact counting for each round's policy (first digit-sum target)
+ * at its minimum length and at length 100, and estimates at length 10^6,
+ * after check_counts_by_brute_force(), check_count_estimates() and
+ * check_round_samples().
+ * @return 0 on success, 1 on a mismatch or an estimate over budget.
+ */
+static int run_count_benchmark(void) {
+    const size_t lengths[2] = { 0, 100 };
+    if (check_counts_by_brute_force() != 0 || check_count_estimates() != 0 || check_round_samples() != 0) {
+        return 1;
+    }
+    printf("\nExact counts (ms per policy):\n");
+    for (int k = 0; k < 2; k++) {
+        double slowest = 0.0, sum = 0.0;
+        int slowest_round = 0, counted = 0, skipped = 0;
+        for (int round = 1; round <= SWEEP_DEFAULT_ROUNDS; round++) {
+            PasswordRequirements reqs;
+            PasswordCounter pc;
+            generate_requirements_roll(&reqs, round, 0);
+            size_t length = lengths[k] ? lengths[k] : (size_t)reqs.min_length;
+            double start = bench_now();
+            if (password_counter_init(&pc, &reqs, length, 0) != 0) {
+                skipped++;
+                continue;
+            }
+            double ms = (bench_now() - start) * 1e3;
+            password_counter_free(&pc);
+            sum += ms;
+            counted++;
+            if (ms > slowest) {
+                slowest = ms;
+                slowest_round = round;
+            }
+        }
+        printf("  %-15s mean %7.2f, slowest %7.2f (round %d), %d over budget\n",
+               lengths[k] ? "length 100:" : "minimum length:", counted ? sum / counted : 0.0,
+               slowest, slowest_round, skipped);
+    }
+
+    double slowest = 0.0, sum = 0.0;
+    int slowest_round = 0;
+    for (int round = 1; round <= SWEEP_DEFAULT_ROUNDS; round++) {
+        PasswordRequirements reqs;
+        double log2_count;
+        generate_requirements_roll(&reqs, round, 0);
+        double start = bench_now();
+        if (password_count_estimate(&reqs, 1000000, &log2_count) != 0) return 1;
+        double ms = (bench_now() - start) * 1e3;
+        sum += ms;
+        if (ms > slowest) {
+            slowest = ms;
+            slowest_round = round;
+        }
+    }
+    printf("Estimates at length 10^6 (ms per policy):\n");
+    printf("  %-15s mean %7.2f, slowest %7.2f (round %d)\n", "rounds 1-20:", sum / SWEEP_DEFAULT_ROUNDS,
+           slowest, slowest_round);
+    return 0;
+}